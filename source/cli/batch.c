@@ -0,0 +1,336 @@
+/****************************************************************************
+ *  batch.c
+ *
+ *  SMS Plus GX headless frontend: parallel ROM corpus runner
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ ***************************************************************************/
+
+#include "shared.h"
+#include "cli.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* Worker status */
+enum
+{
+  RUN_OK = 0,
+  RUN_STUCK,
+  RUN_LOAD_ERROR,
+  RUN_CRASH,
+  RUN_TIMEOUT,
+  RUN_STATUS_MAX
+};
+
+static const char *status_name[RUN_STATUS_MAX] =
+{
+  "ok", "stuck", "loaderr", "crash", "timeout"
+};
+
+/* Worker process */
+typedef struct
+{
+  pid_t pid;
+  int fd;           /* result pipe (read end) */
+  int index;        /* ROM index */
+  double start;     /* spawn time */
+} worker_t;
+
+/* ROM file list */
+static char **rom_list = NULL;
+static int rom_count = 0;
+static int rom_alloc = 0;
+
+static const char *rom_ext[] =
+{
+  ".sms", ".gg", ".sg", ".sc", ".mv", ".col", ".rom", ".bin", ".zip", NULL
+};
+
+static int is_rom(const char *name)
+{
+  const char *ext = strrchr(name, '.');
+  int i;
+
+  if (!ext) return 0;
+
+  for (i = 0; rom_ext[i]; i++)
+  {
+    if (!strcasecmp(ext, rom_ext[i]))
+      return 1;
+  }
+
+  return 0;
+}
+
+static int add_rom(const char *path)
+{
+  if (rom_count == rom_alloc)
+  {
+    char **list = realloc(rom_list, (rom_alloc + 256) * sizeof(char *));
+    if (!list) return 0;
+    rom_list = list;
+    rom_alloc += 256;
+  }
+
+  rom_list[rom_count] = strdup(path);
+  if (!rom_list[rom_count]) return 0;
+  rom_count++;
+
+  return 1;
+}
+
+/* Recursively collect ROM files */
+static void scan_dir(const char *dir)
+{
+  char path[PATH_MAX];
+  struct dirent *entry;
+  struct stat st;
+  DIR *d = opendir(dir);
+
+  if (!d)
+  {
+    fprintf(stderr, "can't open directory '%s'\n", dir);
+    return;
+  }
+
+  while ((entry = readdir(d)) != NULL)
+  {
+    if (entry->d_name[0] == '.')
+      continue;
+
+    snprintf(path, PATH_MAX, "%s/%s", dir, entry->d_name);
+    if (stat(path, &st) < 0)
+      continue;
+
+    if (S_ISDIR(st.st_mode))
+      scan_dir(path);
+    else if (S_ISREG(st.st_mode) && is_rom(entry->d_name))
+      add_rom(path);
+  }
+
+  closedir(d);
+}
+
+static int compare_path(const void *a, const void *b)
+{
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* Start a worker process for one ROM */
+static int spawn(worker_t *w, int index, run_config_t *config)
+{
+  int fds[2];
+
+  if (pipe(fds) < 0)
+    return 0;
+
+  fflush(stdout);
+  fflush(stderr);
+
+  w->pid = fork();
+  if (w->pid < 0)
+  {
+    close(fds[0]);
+    close(fds[1]);
+    return 0;
+  }
+
+  if (w->pid == 0)
+  {
+    /* worker: result is written at once (smaller than PIPE_BUF) */
+    run_result_t result;
+    int status = RUN_LOAD_ERROR;
+
+    close(fds[0]);
+    if (run_rom(rom_list[index], config, &result))
+      status = result.stuck ? RUN_STUCK : RUN_OK;
+    if ((write(fds[1], &status, sizeof(status)) < 0) || (write(fds[1], &result, sizeof(result)) < 0))
+      _exit(1);
+    _exit(0);
+  }
+
+  close(fds[1]);
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  w->fd = fds[0];
+  w->index = index;
+  w->start = get_time();
+
+  return 1;
+}
+
+/* Collect the result of a terminated worker */
+static int reap(worker_t *w, int wstatus, int timed_out, run_result_t *result)
+{
+  int status = RUN_CRASH;
+  char buf[sizeof(int) + sizeof(run_result_t)];
+
+  memset(result, 0, sizeof(run_result_t));
+
+  if (timed_out)
+  {
+    status = RUN_TIMEOUT;
+  }
+  else if (WIFEXITED(wstatus) && !WEXITSTATUS(wstatus) && (read(w->fd, buf, sizeof(buf)) == sizeof(buf)))
+  {
+    memcpy(&status, buf, sizeof(int));
+    memcpy(result, buf + sizeof(int), sizeof(run_result_t));
+  }
+
+  close(w->fd);
+  w->pid = 0;
+
+  return status;
+}
+
+static void report(int done, worker_t *w, int status, int wstatus, run_result_t *r)
+{
+  double wall = get_time() - w->start;
+
+  printf("[%5d/%d] %-7s ", done, rom_count, status_name[status]);
+
+  switch (status)
+  {
+    case RUN_OK:
+    case RUN_STUCK:
+      printf("%9.1f fps %8.3f s  pc=%04x%s video=%016llx audio=%016llx  ",
+             r->frames / r->elapsed, wall, r->pc, r->halted ? " (halt)" : "       ",
+             r->video_hash, r->audio_hash);
+      break;
+
+    case RUN_CRASH:
+      if (WIFSIGNALED(wstatus))
+        printf("signal %-3d %-13s %8.3f s  ", WTERMSIG(wstatus), "", wall);
+      else
+        printf("exit %-5d %-13s %8.3f s  ", WEXITSTATUS(wstatus), "", wall);
+      break;
+
+    default:
+      printf("%23s %8.3f s  ", "", wall);
+      break;
+  }
+
+  printf("%s\n", rom_list[w->index]);
+  fflush(stdout);
+}
+
+/* Run every ROM found in a directory using parallel worker processes */
+int run_batch(char *dir, run_config_t *config, int jobs, int timeout)
+{
+  int count[RUN_STATUS_MAX];
+  worker_t *workers;
+  run_result_t result;
+  int i, next = 0, done = 0;
+  double start = get_time();
+
+  scan_dir(dir);
+  if (!rom_count)
+  {
+    fprintf(stderr, "no ROM found in '%s'\n", dir);
+    return 1;
+  }
+  qsort(rom_list, rom_count, sizeof(char *), compare_path);
+
+  if (jobs <= 0)
+    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  if (jobs <= 0)
+    jobs = 1;
+  if (jobs > rom_count)
+    jobs = rom_count;
+
+  workers = calloc(jobs, sizeof(worker_t));
+  if (!workers)
+    return 1;
+
+  memset(count, 0, sizeof(count));
+  printf("%d ROM(s), %d frames each, %d worker(s)\n", rom_count, config->frames, jobs);
+
+  while (done < rom_count)
+  {
+    pid_t pid;
+    int wstatus;
+
+    /* keep all workers busy */
+    for (i = 0; (i < jobs) && (next < rom_count); i++)
+    {
+      if (!workers[i].pid)
+      {
+        if (!spawn(&workers[i], next, config))
+        {
+          perror("fork");
+          free(workers);
+          return 1;
+        }
+        next++;
+      }
+    }
+
+    /* wait for any worker to terminate */
+    pid = waitpid(-1, &wstatus, WNOHANG);
+    if (pid < 0)
+    {
+      if (errno == EINTR) continue;
+      break;
+    }
+
+    if (pid > 0)
+    {
+      for (i = 0; i < jobs; i++)
+      {
+        if (workers[i].pid == pid)
+        {
+          int status = reap(&workers[i], wstatus, 0, &result);
+          count[status]++;
+          report(++done, &workers[i], status, wstatus, &result);
+          break;
+        }
+      }
+      continue;
+    }
+
+    /* kill hung workers */
+    for (i = 0; i < jobs; i++)
+    {
+      if (workers[i].pid && (timeout > 0) && ((get_time() - workers[i].start) > timeout))
+      {
+        int status;
+        pid = workers[i].pid;
+        kill(pid, SIGKILL);
+        waitpid(pid, &wstatus, 0);
+        status = reap(&workers[i], wstatus, 1, &result);
+        count[status]++;
+        report(++done, &workers[i], status, wstatus, &result);
+      }
+    }
+
+    usleep(1000);
+  }
+
+  printf("%d ROM(s) in %.3f s:", rom_count, get_time() - start);
+  for (i = 0; i < RUN_STATUS_MAX; i++)
+    printf(" %s %d%s", status_name[i], count[i], (i < RUN_STATUS_MAX - 1) ? "," : "\n");
+
+  for (i = 0; i < rom_count; i++)
+    free(rom_list[i]);
+  free(rom_list);
+  free(workers);
+
+  return (count[RUN_OK] == rom_count) ? 0 : 2;
+}
@@ -0,0 +1,78 @@
+/****************************************************************************
+ *  cli.h
+ *
+ *  SMS Plus GX headless frontend
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ ***************************************************************************/
+
+#ifndef _CLI_H_
+#define _CLI_H_
+
+/* Frames without any CPU or work RAM progress before a game is reported stuck */
+#define STUCK_FRAMES 120
+
+/* Emulation run result */
+typedef struct
+{
+  int frames;                     /* frames emulated */
+  double elapsed;                 /* emulation wall time (seconds) */
+  int fps;                        /* emulated console refresh rate */
+  uint16 pc;                      /* Z80 PC after last frame */
+  uint8 halted;                   /* Z80 HALT state after last frame */
+  uint8 stuck;                    /* 1= PC and work RAM frozen for STUCK_FRAMES */
+  unsigned long long video_hash;  /* FNV-1a hash of last frame */
+  unsigned long long audio_hash;  /* FNV-1a hash of all audio output */
+  profile_t profile;              /* subsystem timing (PROFILE builds) */
+} run_result_t;
+
+/* Input movie: one record per frame (pad 1, pad 2, system buttons) */
+#define MOVIE_RECORD_SIZE 3
+
+typedef struct
+{
+  uint8 *data;
+  int frames;
+  int alloc;
+} movie_t;
+
+/* Emulation run settings */
+typedef struct
+{
+  int frames;                     /* frames to emulate */
+  int skip_render;                /* SKIP_VIDEO / SKIP_AUDIO flags */
+  int depth;                      /* output bitmap bits per pixel (8, 15, 16 or 32) */
+  int pipeline;                   /* 0= off, else output buffers handed to a presentation thread */
+  int render_thread;              /* 1= lines are drawn by a render thread */
+  int ntsc_threads;               /* 0= NTSC filter runs line by line, else whole frames on n threads */
+  int psg_blep;                   /* 1= PSG uses band-limited step synthesis */
+  movie_t *replay;                /* input movie to replay (optional) */
+  movie_t *record;                /* input movie to record (optional) */
+  unsigned int seed;              /* 0= no input, else pseudo-random input seed */
+} run_config_t;
+
+/* Function prototypes */
+extern double get_time(void);
+extern int run_rom(char *rom, run_config_t *config, run_result_t *result);
+extern int run_batch(char *dir, run_config_t *config, int jobs, int timeout);
+extern int movie_load(movie_t *mv, char *file);
+extern int movie_save(movie_t *mv, char *file);
+extern void movie_free(movie_t *mv);
+extern void movie_play(movie_t *mv, int frame);
+extern int movie_record(movie_t *mv);
+extern void movie_random(unsigned int *seed, int frame);
+
+#endif /* _CLI_H_ */
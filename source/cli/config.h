@@ -0,0 +1,46 @@
+/****************************************************************************
+ *  config.h
+ *
+ *  SMS Plus GX headless frontend configuration
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ ***************************************************************************/
+
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+
+/****************************************************************************
+ * Config Option
+ *
+ ****************************************************************************/
+typedef struct
+{
+  int sndrate;
+  int country;
+  int console;
+  int fm;
+  uint8 overscan;
+  uint8 ntsc;
+  uint8 tms_pal;
+  uint8 use_bios;
+  uint8 spritelimit;
+  uint8 extra_gg;
+} t_option;
+
+/* Global data */
+extern t_option option;
+
+#endif /* _CONFIG_H_ */
@@ -0,0 +1,451 @@
+/****************************************************************************
+ *  main.c
+ *
+ *  SMS Plus GX headless frontend (throughput benchmarking)
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ ***************************************************************************/
+
+#include "shared.h"
+#include "sms_ntsc.h"
+#include "cli.h"
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+/* Global data */
+t_option option;
+sms_ntsc_t sms_ntsc;
+
+/* No SRAM file: initialize memory */
+void system_manage_sram(uint8 *sram, int which, int mode)
+{
+  if (mode == SRAM_LOAD)
+    memset(sram, 0x00, 0x8000);
+}
+
+double get_time(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long long fnv_hash(unsigned long long h, void *data, int size)
+{
+  uint8 *p = data;
+  while (size--)
+  {
+    h ^= *p++;
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+/* Hash of a picture (palette indexes include the colors) */
+static unsigned long long picture_hash(uint8 *data, int x, int y, int w, int h, uint8 *pal)
+{
+  unsigned long long hash = 0xcbf29ce484222325ULL;
+  int line;
+
+  for (line = 0; line < h + 2*y; line++)
+    hash = fnv_hash(hash, &data[line * bitmap.pitch], (w + 2*x) * bitmap.granularity);
+
+  if (bitmap.depth == 8)
+    hash = fnv_hash(hash, pal, PALETTE_SIZE * 3);
+
+  return hash;
+}
+
+/* Presentation thread (pipelined output) */
+typedef struct
+{
+  machine_t *m;
+  int done;                       /* set once the last frame is published */
+  int pictures;                   /* # of pictures presented */
+  unsigned long long video_hash;  /* last picture */
+  unsigned long long audio_hash;  /* all audio output */
+} presenter_t;
+
+static void *present_frames(void *arg)
+{
+  presenter_t *p = arg;
+  output_frame_t *f;
+  int done;
+
+  machine_select(p->m);
+
+  for (;;)
+  {
+    done = __atomic_load_n(&p->done, __ATOMIC_ACQUIRE);
+    f = output_acquire();
+    if (!f)
+    {
+      if (done) break;
+      sched_yield();
+      continue;
+    }
+
+    if (!(f->skip & SKIP_AUDIO))
+    {
+      p->audio_hash = fnv_hash(p->audio_hash, f->audio[0], f->sample_count * 2);
+      p->audio_hash = fnv_hash(p->audio_hash, f->audio[1], f->sample_count * 2);
+    }
+
+    if (!(f->skip & SKIP_VIDEO))
+    {
+      p->video_hash = picture_hash(f->data, f->viewport.x, f->viewport.y, f->viewport.w, f->viewport.h, &f->pal[0][0]);
+      p->pictures++;
+    }
+
+    output_release();
+  }
+
+  return NULL;
+}
+
+/* Run a ROM for a number of frames into an off-screen bitmap */
+int run_rom(char *rom, run_config_t *config, run_result_t *result)
+{
+  static uint8 ram[0x2000];
+  unsigned int seed = config->seed;
+  presenter_t presenter;
+  pthread_t thread;
+  machine_t *m;
+  double start;
+  int i, still = 0;
+  int pipeline = config->pipeline;
+
+  memset(result, 0, sizeof(run_result_t));
+  result->video_hash = result->audio_hash = 0xcbf29ce484222325ULL;
+
+  m = machine_new();
+  if (!m) return 0;
+  machine_select(m);
+
+  /* NTSC filter frame pass */
+  m->render.ntsc_threads = config->ntsc_threads;
+
+  /* PSG synthesis (used by sound_init) */
+  snd.psg_blep = config->psg_blep;
+
+  /* allocate work bitmap (never displayed) */
+  bitmap.width = 720;
+  bitmap.height = 288;
+  bitmap.depth = config->depth;
+  bitmap.granularity = (config->depth + 7) >> 3;
+  bitmap.pitch = bitmap.width * bitmap.granularity;
+  bitmap.viewport.w = 256;
+  bitmap.viewport.h = 192;
+  bitmap.viewport.x = 0;
+  bitmap.viewport.y = 0;
+  bitmap.data = calloc(bitmap.height, bitmap.pitch);
+
+  if (!bitmap.data || !load_rom(m, rom))
+  {
+    free(bitmap.data);
+    machine_delete(m);
+    return 0;
+  }
+
+  system_poweron();
+  profile_reset();
+
+  /* lines are drawn from the VDP log by another thread */
+  if (config->render_thread)
+    vdplog_init();
+
+  /* completed frames are hashed by another thread */
+  if (pipeline)
+  {
+    memset(&presenter, 0, sizeof(presenter));
+    presenter.m = m;
+    presenter.audio_hash = result->audio_hash;
+    if (!output_init(pipeline) || pthread_create(&thread, NULL, present_frames, &presenter))
+    {
+      output_shutdown();
+      pipeline = 0;
+    }
+  }
+
+  for (i = 0; i < config->frames; i++)
+  {
+    if (config->replay)
+      movie_play(config->replay, i);
+    else if (seed)
+      movie_random(&seed, i);
+
+    if (config->record)
+      movie_record(config->record);
+
+    start = get_time();
+    while (!output_begin())
+      sched_yield();
+    system_frame(m, config->skip_render);
+    output_end();
+    result->elapsed += get_time() - start;
+
+    if (snd.enabled && !(config->skip_render & SKIP_AUDIO) && !pipeline)
+    {
+      result->audio_hash = fnv_hash(result->audio_hash, snd.output[0], snd.sample_count * 2);
+      result->audio_hash = fnv_hash(result->audio_hash, snd.output[1], snd.sample_count * 2);
+    }
+
+    /* CPU is stuck when neither PC nor work RAM change between frames */
+    if ((m->z80.regs.pc.w.l == result->pc) && !memcmp(ram, sms.wram, 0x2000))
+    {
+      still++;
+    }
+    else
+    {
+      still = 0;
+      result->pc = m->z80.regs.pc.w.l;
+      memcpy(ram, sms.wram, 0x2000);
+    }
+  }
+
+  if (pipeline)
+  {
+    /* wait for the last frame to be presented */
+    __atomic_store_n(&presenter.done, 1, __ATOMIC_RELEASE);
+    pthread_join(thread, NULL);
+    output_shutdown();
+    result->audio_hash = presenter.audio_hash;
+    result->video_hash = presenter.video_hash;
+  }
+
+  /* last frame */
+  if (!pipeline || !presenter.pictures)
+  {
+    result->video_hash = picture_hash(bitmap.data, bitmap.viewport.x, bitmap.viewport.y,
+                                      bitmap.viewport.w, bitmap.viewport.h, &bitmap.pal.color[0][0]);
+  }
+
+  result->frames = config->frames;
+  result->fps = (sms.display == DISPLAY_NTSC) ? FPS_NTSC : FPS_PAL;
+  result->halted = m->z80.regs.halt;
+  result->stuck = (still >= STUCK_FRAMES);
+  result->profile = m->profile;
+
+  system_poweroff();
+  system_shutdown();
+  free(bitmap.data);
+  machine_delete(m);
+
+  return 1;
+}
+
+#ifdef PROFILE
+/* Print time spent per emulated subsystem (exclusive of nested sections) */
+static void print_profile(run_result_t *r)
+{
+  static const char *name[PROF_MAX] =
+  {
+    "system_frame (other)", "z80_execute", "render_line (other)", "update_bg_pattern_cache",
+    "remap_line/sms_ntsc_blit", "sound_end (other)", "SN76489_Update", "FM_Update", "mixer"
+  };
+  unsigned long long total = 0;
+  int i;
+
+  for (i = 0; i < PROF_MAX; i++)
+    total += r->profile.time[i];
+
+  printf("%-28s %12s %8s %10s\n", "section", "ns/frame", "%", "calls");
+  for (i = 0; i < PROF_MAX; i++)
+  {
+    printf("%-28s %12.0f %7.2f%% %10u\n", name[i], (double)r->profile.time[i] / r->frames,
+           total ? 100.0 * r->profile.time[i] / total : 0.0, r->profile.calls[i]);
+  }
+  printf("%-28s %12.0f\n", "total", (double)total / r->frames);
+}
+#endif
+
+static void usage(char *name)
+{
+  printf("usage: %s [options] <rom>\n", name);
+  printf("       %s [options] --batch <dir>\n", name);
+  printf("  -n, --frames <n>   number of frames to run (default: 3600 or movie length)\n");
+  printf("  --skip             skip video output (VDP status flags are still emulated)\n");
+  printf("  --nosound          skip audio output (sound chips are still emulated)\n");
+  printf("  --fm               enable YM2413 emulation\n");
+  printf("  --rate <hz>        audio sample rate (8000 to 96000, default: 44100)\n");
+  printf("  --psg-blep         synthesise PSG with band-limited steps at its clock rate\n");
+  printf("  --console <n>      force console type (0: auto)\n");
+  printf("  --country <n>      force country (0: auto, 1: USA, 2: EUR, 3: JAP)\n");
+  printf("  --depth <n>        output bits per pixel (8: palette indexes, 15, 16, 32; default: 16)\n");
+  printf("  --ntsc             enable NTSC filter (16 bits per pixel only)\n");
+  printf("  --ntsc-threads <n> filter whole frames on n threads (default: 0, line by line)\n");
+  printf("  --pipeline <n>     hand frames to a presentation thread through n buffers (2 or 3)\n");
+  printf("  --render-thread    draw lines on a render thread fed by a VDP state log\n");
+  printf("  --nolimit          disable sprite limit\n");
+  printf("  --overscan         emulate overscan area\n");
+  printf("  --movie <file>     replay input movie\n");
+  printf("  --record <file>    record input movie\n");
+  printf("  --random <seed>    generate pseudo-random input\n");
+  printf("  --batch <dir>      run every ROM found in directory\n");
+  printf("  -j, --jobs <n>     number of worker processes (default: all cores)\n");
+  printf("  --timeout <s>      kill workers running longer (default: 300)\n");
+}
+
+int main(int argc, char **argv)
+{
+  run_config_t config;
+  run_result_t result;
+  movie_t replay, record;
+  char *rom = NULL;
+  char *dir = NULL;
+  char *replay_file = NULL;
+  char *record_file = NULL;
+  int jobs = 0;
+  int timeout = 300;
+  int i;
+
+  memset(&config, 0, sizeof(config));
+  memset(&record, 0, sizeof(record));
+  config.depth = 16;
+
+  /* default virtual console emulation settings */
+  option.sndrate = 44100;
+  option.country = 0;
+  option.console = 0;
+  option.fm = 0;
+  option.overscan = 0;
+  option.ntsc = 0;
+  option.tms_pal = 2;
+  option.use_bios = 0;
+  option.spritelimit = 1;
+  option.extra_gg = 0;
+
+  for (i = 1; i < argc; i++)
+  {
+    if ((!strcmp(argv[i], "-n") || !strcmp(argv[i], "--frames")) && (i + 1 < argc))
+    {
+      config.frames = atoi(argv[++i]);
+      if (config.frames <= 0) break;
+    }
+    else if (!strcmp(argv[i], "--skip"))
+      config.skip_render |= SKIP_VIDEO;
+    else if (!strcmp(argv[i], "--nosound"))
+      config.skip_render |= SKIP_AUDIO;
+    else if (!strcmp(argv[i], "--fm"))
+      option.fm = SND_EMU2413;
+    else if (!strcmp(argv[i], "--rate") && (i + 1 < argc))
+    {
+      option.sndrate = atoi(argv[++i]);
+      if ((option.sndrate < 8000) || (option.sndrate > 96000)) break;
+    }
+    else if (!strcmp(argv[i], "--psg-blep"))
+      config.psg_blep = 1;
+    else if (!strcmp(argv[i], "--console") && (i + 1 < argc))
+      option.console = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--country") && (i + 1 < argc))
+      option.country = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--depth") && (i + 1 < argc))
+    {
+      config.depth = atoi(argv[++i]);
+      if ((config.depth != 8) && (config.depth != 15) && (config.depth != 16) && (config.depth != 32)) break;
+    }
+    else if (!strcmp(argv[i], "--ntsc"))
+      option.ntsc = 1;
+    else if (!strcmp(argv[i], "--ntsc-threads") && (i + 1 < argc))
+    {
+      config.ntsc_threads = atoi(argv[++i]);
+      if ((config.ntsc_threads < 0) || (config.ntsc_threads > WORKER_MAX)) break;
+    }
+    else if (!strcmp(argv[i], "--pipeline") && (i + 1 < argc))
+    {
+      config.pipeline = atoi(argv[++i]);
+      if ((config.pipeline < 2) || (config.pipeline > OUTPUT_MAX)) break;
+    }
+    else if (!strcmp(argv[i], "--render-thread"))
+      config.render_thread = 1;
+    else if (!strcmp(argv[i], "--nolimit"))
+      option.spritelimit = 0;
+    else if (!strcmp(argv[i], "--overscan"))
+      option.overscan = 1;
+    else if (!strcmp(argv[i], "--movie") && (i + 1 < argc))
+      replay_file = argv[++i];
+    else if (!strcmp(argv[i], "--record") && (i + 1 < argc))
+      record_file = argv[++i];
+    else if (!strcmp(argv[i], "--random") && (i + 1 < argc))
+      config.seed = strtoul(argv[++i], NULL, 0);
+    else if (!strcmp(argv[i], "--batch") && (i + 1 < argc))
+      dir = argv[++i];
+    else if ((!strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs")) && (i + 1 < argc))
+      jobs = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--timeout") && (i + 1 < argc))
+      timeout = atoi(argv[++i]);
+    else if ((argv[i][0] != '-') && !rom)
+      rom = argv[i];
+    else
+      break;
+  }
+
+  if ((i < argc) || (!rom == !dir))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (replay_file)
+  {
+    if (!movie_load(&replay, replay_file))
+    {
+      fprintf(stderr, "can't load movie '%s'\n", replay_file);
+      return 1;
+    }
+    config.replay = &replay;
+    if (!config.frames)
+      config.frames = replay.frames;
+  }
+
+  if (record_file)
+    config.record = &record;
+
+  if (config.frames <= 0)
+    config.frames = 3600;
+
+  if (option.ntsc)
+  {
+    sms_ntsc_setup_t setup = sms_ntsc_composite;
+    sms_ntsc_init(&sms_ntsc, &setup);
+  }
+
+  if (dir)
+    return run_batch(dir, &config, jobs, timeout);
+
+  if (!run_rom(rom, &config, &result))
+  {
+    fprintf(stderr, "can't load '%s'\n", rom);
+    return 1;
+  }
+
+  printf("%s: %d frames in %.3f s, %.1f fps (%.1fx realtime)\n", rom, result.frames, result.elapsed,
+         result.frames / result.elapsed, result.frames / result.elapsed / result.fps);
+  printf("video=%016llx audio=%016llx\n", result.video_hash, result.audio_hash);
+#ifdef PROFILE
+  print_profile(&result);
+#endif
+  worker_shutdown();
+
+  if (record_file && !movie_save(&record, record_file))
+  {
+    fprintf(stderr, "can't save movie '%s'\n", record_file);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,120 @@
+/****************************************************************************
+ *  movie.c
+ *
+ *  SMS Plus GX headless frontend: input movie recording & playback
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ ***************************************************************************/
+
+#include "shared.h"
+#include "cli.h"
+
+int movie_load(movie_t *mv, char *file)
+{
+  FILE *fd = fopen(file, "rb");
+  long size;
+
+  memset(mv, 0, sizeof(movie_t));
+  if (!fd) return 0;
+
+  fseek(fd, 0, SEEK_END);
+  size = ftell(fd);
+  fseek(fd, 0, SEEK_SET);
+
+  mv->frames = size / MOVIE_RECORD_SIZE;
+  mv->alloc = mv->frames;
+  mv->data = malloc(mv->frames * MOVIE_RECORD_SIZE + 1);
+  if (!mv->data || (fread(mv->data, MOVIE_RECORD_SIZE, mv->frames, fd) != mv->frames))
+  {
+    fclose(fd);
+    movie_free(mv);
+    return 0;
+  }
+
+  fclose(fd);
+  return 1;
+}
+
+int movie_save(movie_t *mv, char *file)
+{
+  FILE *fd = fopen(file, "wb");
+  int ok;
+
+  if (!fd) return 0;
+  ok = (fwrite(mv->data, MOVIE_RECORD_SIZE, mv->frames, fd) == mv->frames);
+  fclose(fd);
+
+  return ok;
+}
+
+void movie_free(movie_t *mv)
+{
+  free(mv->data);
+  memset(mv, 0, sizeof(movie_t));
+}
+
+/* Set current machine input from frame record (input is released past the end) */
+void movie_play(movie_t *mv, int frame)
+{
+  uint8 *rec;
+
+  if (frame >= mv->frames)
+  {
+    input.pad[0] = input.pad[1] = input.system = 0;
+    return;
+  }
+
+  rec = &mv->data[frame * MOVIE_RECORD_SIZE];
+  input.pad[0] = rec[0];
+  input.pad[1] = rec[1];
+  input.system = rec[2];
+}
+
+/* Append current machine input to the movie */
+int movie_record(movie_t *mv)
+{
+  uint8 *rec;
+
+  if (mv->frames == mv->alloc)
+  {
+    uint8 *data = realloc(mv->data, (mv->alloc + 3600) * MOVIE_RECORD_SIZE);
+    if (!data) return 0;
+    mv->data = data;
+    mv->alloc += 3600;
+  }
+
+  rec = &mv->data[mv->frames++ * MOVIE_RECORD_SIZE];
+  rec[0] = input.pad[0];
+  rec[1] = input.pad[1];
+  rec[2] = input.system;
+
+  return 1;
+}
+
+/* Generate pseudo-random input from a seed (new input every 8 frames) */
+void movie_random(unsigned int *seed, int frame)
+{
+  if (frame & 7) return;
+
+  *seed = *seed * 1103515245 + 12345;
+  input.pad[0] = (*seed >> 16) & 0x3f;
+  *seed = *seed * 1103515245 + 12345;
+  input.pad[1] = (*seed >> 16) & 0x3f;
+
+  /* only press START now and then (PAUSE/RESET would stall progress) */
+  *seed = *seed * 1103515245 + 12345;
+  input.system = ((*seed >> 16) & 0x0f) ? 0 : INPUT_START;
+}
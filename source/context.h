@@ -0,0 +1,63 @@
+/******************************************************************************
+ *  Sega Master System / GameGear Emulator
+ *  Copyright (C) 1998-2007  Charles MacDonald
+ *
+ *  additionnal code by Eke-Eke (SMS Plus GX)
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *   Machine context accessors private to the emulation core
+ *
+ ******************************************************************************/
+
+#ifndef _CONTEXT_H_
+#define _CONTEXT_H_
+
+/* Current machine context (not part of the porting interface, see system.h) */
+#define bios                (machine->bios)
+#define slot                (machine->slot)
+#define coleco              (machine->coleco)
+#define cart                (machine->cart)
+#define vdp                 (machine->vdp)
+#define dummy_write         (machine->dummy_write)
+#define dummy_read          (machine->dummy_read)
+#define data_bus_pullup     (machine->data_bus_pullup)
+#define data_bus_pulldown   (machine->data_bus_pulldown)
+
+/* Z80 CPU */
+#define Z80                 (machine->z80.regs)
+#define z80_cycle_count     (machine->z80.cycle_count)
+#define cpu_readmap         (machine->z80.readmap)
+#define cpu_writemap        (machine->z80.writemap)
+#define cpu_writemem16      (machine->z80.writemem16)
+#define cpu_writeport16     (machine->z80.writeport16)
+#define cpu_readport16      (machine->z80.readport16)
+
+/* Renderer */
+#define render_bg           (machine->render.render_bg)
+#define render_obj          (machine->render.render_obj)
+#define linebuf             (machine->render.linebuf)
+#define bg_name_dirty       (machine->render.bg_name_dirty)
+#define bg_name_list        (machine->render.bg_name_list)
+#define bg_list_index       (machine->render.bg_list_index)
+#define spr_mask            (machine->render.spr_mask)
+#define spr_key             (machine->render.spr_key)
+#define spr_end             (machine->render.spr_end)
+#define spr_dirty           (machine->render.spr_dirty)
+
+/* TMS9918 modes */
+#define text_counter        (machine->tms.text_counter)
+
+#endif /* _CONTEXT_H_ */
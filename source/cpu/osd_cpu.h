@@ -26,7 +26,7 @@
 #define OSD_CPU_H
 
 #ifndef NGC
-#ifndef DOS
+#if defined(_WIN32) && !defined(DOS)
 #include "basetsd.h"
 #endif
 #undef TRUE
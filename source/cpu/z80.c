@@ -121,6 +121,7 @@
  *      http://www.msxnet.org/tech/z80-documented.pdf
  *****************************************************************************/
 #include "shared.h"
+#include "context.h"
 #include "z80.h"
 
 #define VERBOSE 0
@@ -133,12 +134,17 @@
 #define LOG(x)
 #endif
 
-int z80_cycle_count = 0;        /* running total of cycles executed */
-
 #define cpu_readmem16(a)        cpu_readmap[(a) >> 10][(a) & 0x03FF]
 #define cpu_readop(a)           cpu_readmap[(a) >> 10][(a) & 0x03FF]
 #define cpu_readop_arg(a)       cpu_readmap[(a) >> 10][(a) & 0x03FF]
 
+/* fast-forward HALT and side-effect free polling loops to the end of the timeslice */
+#ifndef Z80_IDLE_LOOPS
+#define Z80_IDLE_LOOPS  1
+#endif
+
+#define Z80_IDLE_LEN    16      /* maximal idle loop length (bytes) */
+
 /* execute main opcodes inside a big switch statement */
 #ifndef BIG_SWITCH
 #define BIG_SWITCH      1
@@ -207,13 +213,13 @@ int z80_cycle_count = 0;        /* running total of cycles executed */
 #define IFF2 Z80.iff2
 #define HALT Z80.halt
 
-int z80_ICount;
-Z80_Regs Z80;
+/* current machine Z80 context */
+#define z80_ICount            (machine->z80.icount)
+#define z80_op_icount         (machine->z80.op_icount)
+#define z80_exec              (machine->z80.exec)
+#define z80_requested_cycles  (machine->z80.requested_cycles)
 
-static int z80_exec = 0;               /* 1= in exec loop, 0= out of */
-static int z80_requested_cycles = 0;   /* requested cycles to execute this timeslice */
-
-static UINT32 EA;
+#define EA (machine->z80.ea)
 
 static UINT8 SZ[256];       /* zero and sign flags */
 static UINT8 SZ_BIT[256];   /* zero, sign and parity/overflow (=zero) flags for BIT opcode */
@@ -221,8 +227,9 @@ static UINT8 SZP[256];      /* zero, sign and parity flags */
 static UINT8 SZHV_inc[256]; /* zero, sign, half carry and overflow flags INC r8 */
 static UINT8 SZHV_dec[256]; /* zero, sign, half carry and overflow flags DEC r8 */
 
-static UINT8 *SZHVC_add = 0;
-static UINT8 *SZHVC_sub = 0;
+static UINT8 SZHVC_add[2*256*256];
+static UINT8 SZHVC_sub[2*256*256];
+static worker_once_t tables_once = WORKER_ONCE_INIT;
 
 static const UINT8 cc_op[0x100] = {
  4,10, 7, 6, 4, 4, 7, 4, 4,11, 7, 6, 4, 4, 7, 4,
@@ -576,6 +583,135 @@ INLINE void BURNODD(int cycles, int opcodes, int cyclesum)
 #define EXEC_INLINE EXEC
 #endif
 
+/***************************************************************
+ * Threaded dispatch (GCC "labels as values" extension):
+ * each opcode handler jumps straight to the next one, which
+ * gives every opcode its own (better predicted) indirect jump.
+ ***************************************************************/
+#if !defined(Z80_THREADED) && defined(__GNUC__)
+#define Z80_THREADED    1
+#endif
+
+#if Z80_THREADED
+#define THREADED_TABLE \
+  &&L_00, &&L_01, &&L_02, &&L_03, &&L_04, &&L_05, &&L_06, &&L_07, \
+  &&L_08, &&L_09, &&L_0a, &&L_0b, &&L_0c, &&L_0d, &&L_0e, &&L_0f, \
+  &&L_10, &&L_11, &&L_12, &&L_13, &&L_14, &&L_15, &&L_16, &&L_17, \
+  &&L_18, &&L_19, &&L_1a, &&L_1b, &&L_1c, &&L_1d, &&L_1e, &&L_1f, \
+  &&L_20, &&L_21, &&L_22, &&L_23, &&L_24, &&L_25, &&L_26, &&L_27, \
+  &&L_28, &&L_29, &&L_2a, &&L_2b, &&L_2c, &&L_2d, &&L_2e, &&L_2f, \
+  &&L_30, &&L_31, &&L_32, &&L_33, &&L_34, &&L_35, &&L_36, &&L_37, \
+  &&L_38, &&L_39, &&L_3a, &&L_3b, &&L_3c, &&L_3d, &&L_3e, &&L_3f, \
+  &&L_40, &&L_41, &&L_42, &&L_43, &&L_44, &&L_45, &&L_46, &&L_47, \
+  &&L_48, &&L_49, &&L_4a, &&L_4b, &&L_4c, &&L_4d, &&L_4e, &&L_4f, \
+  &&L_50, &&L_51, &&L_52, &&L_53, &&L_54, &&L_55, &&L_56, &&L_57, \
+  &&L_58, &&L_59, &&L_5a, &&L_5b, &&L_5c, &&L_5d, &&L_5e, &&L_5f, \
+  &&L_60, &&L_61, &&L_62, &&L_63, &&L_64, &&L_65, &&L_66, &&L_67, \
+  &&L_68, &&L_69, &&L_6a, &&L_6b, &&L_6c, &&L_6d, &&L_6e, &&L_6f, \
+  &&L_70, &&L_71, &&L_72, &&L_73, &&L_74, &&L_75, &&L_76, &&L_77, \
+  &&L_78, &&L_79, &&L_7a, &&L_7b, &&L_7c, &&L_7d, &&L_7e, &&L_7f, \
+  &&L_80, &&L_81, &&L_82, &&L_83, &&L_84, &&L_85, &&L_86, &&L_87, \
+  &&L_88, &&L_89, &&L_8a, &&L_8b, &&L_8c, &&L_8d, &&L_8e, &&L_8f, \
+  &&L_90, &&L_91, &&L_92, &&L_93, &&L_94, &&L_95, &&L_96, &&L_97, \
+  &&L_98, &&L_99, &&L_9a, &&L_9b, &&L_9c, &&L_9d, &&L_9e, &&L_9f, \
+  &&L_a0, &&L_a1, &&L_a2, &&L_a3, &&L_a4, &&L_a5, &&L_a6, &&L_a7, \
+  &&L_a8, &&L_a9, &&L_aa, &&L_ab, &&L_ac, &&L_ad, &&L_ae, &&L_af, \
+  &&L_b0, &&L_b1, &&L_b2, &&L_b3, &&L_b4, &&L_b5, &&L_b6, &&L_b7, \
+  &&L_b8, &&L_b9, &&L_ba, &&L_bb, &&L_bc, &&L_bd, &&L_be, &&L_bf, \
+  &&L_c0, &&L_c1, &&L_c2, &&L_c3, &&L_c4, &&L_c5, &&L_c6, &&L_c7, \
+  &&L_c8, &&L_c9, &&L_ca, &&L_cb, &&L_cc, &&L_cd, &&L_ce, &&L_cf, \
+  &&L_d0, &&L_d1, &&L_d2, &&L_d3, &&L_d4, &&L_d5, &&L_d6, &&L_d7, \
+  &&L_d8, &&L_d9, &&L_da, &&L_db, &&L_dc, &&L_dd, &&L_de, &&L_df, \
+  &&L_e0, &&L_e1, &&L_e2, &&L_e3, &&L_e4, &&L_e5, &&L_e6, &&L_e7, \
+  &&L_e8, &&L_e9, &&L_ea, &&L_eb, &&L_ec, &&L_ed, &&L_ee, &&L_ef, \
+  &&L_f0, &&L_f1, &&L_f2, &&L_f3, &&L_f4, &&L_f5, &&L_f6, &&L_f7, \
+  &&L_f8, &&L_f9, &&L_fa, &&L_fb, &&L_fc, &&L_fd, &&L_fe, &&L_ff
+
+#define THREADED_NEXT                                               \
+{                                                                   \
+  if (z80_ICount <= 0) goto threaded_exit;                          \
+  if (Z80.irq_state != CLEAR_LINE && IFF1 && !Z80.after_ei)         \
+  {                                                                 \
+    take_interrupt();                                               \
+    Z80.after_ei = FALSE;                                           \
+    if (z80_ICount <= 0) goto threaded_exit;                        \
+  }                                                                 \
+  Z80.after_ei = FALSE;                                             \
+  z80_op_icount = z80_ICount;                                       \
+  R++;                                                              \
+  op = ROP();                                                       \
+  CC(op,op);                                                        \
+  goto *threaded_table[op];                                         \
+}
+
+#define THREADED_OPS \
+  L_00: op_00(); THREADED_NEXT; L_01: op_01(); THREADED_NEXT; L_02: op_02(); THREADED_NEXT; L_03: op_03(); THREADED_NEXT; \
+  L_04: op_04(); THREADED_NEXT; L_05: op_05(); THREADED_NEXT; L_06: op_06(); THREADED_NEXT; L_07: op_07(); THREADED_NEXT; \
+  L_08: op_08(); THREADED_NEXT; L_09: op_09(); THREADED_NEXT; L_0a: op_0a(); THREADED_NEXT; L_0b: op_0b(); THREADED_NEXT; \
+  L_0c: op_0c(); THREADED_NEXT; L_0d: op_0d(); THREADED_NEXT; L_0e: op_0e(); THREADED_NEXT; L_0f: op_0f(); THREADED_NEXT; \
+  L_10: op_10(); THREADED_NEXT; L_11: op_11(); THREADED_NEXT; L_12: op_12(); THREADED_NEXT; L_13: op_13(); THREADED_NEXT; \
+  L_14: op_14(); THREADED_NEXT; L_15: op_15(); THREADED_NEXT; L_16: op_16(); THREADED_NEXT; L_17: op_17(); THREADED_NEXT; \
+  L_18: op_18(); THREADED_NEXT; L_19: op_19(); THREADED_NEXT; L_1a: op_1a(); THREADED_NEXT; L_1b: op_1b(); THREADED_NEXT; \
+  L_1c: op_1c(); THREADED_NEXT; L_1d: op_1d(); THREADED_NEXT; L_1e: op_1e(); THREADED_NEXT; L_1f: op_1f(); THREADED_NEXT; \
+  L_20: op_20(); THREADED_NEXT; L_21: op_21(); THREADED_NEXT; L_22: op_22(); THREADED_NEXT; L_23: op_23(); THREADED_NEXT; \
+  L_24: op_24(); THREADED_NEXT; L_25: op_25(); THREADED_NEXT; L_26: op_26(); THREADED_NEXT; L_27: op_27(); THREADED_NEXT; \
+  L_28: op_28(); THREADED_NEXT; L_29: op_29(); THREADED_NEXT; L_2a: op_2a(); THREADED_NEXT; L_2b: op_2b(); THREADED_NEXT; \
+  L_2c: op_2c(); THREADED_NEXT; L_2d: op_2d(); THREADED_NEXT; L_2e: op_2e(); THREADED_NEXT; L_2f: op_2f(); THREADED_NEXT; \
+  L_30: op_30(); THREADED_NEXT; L_31: op_31(); THREADED_NEXT; L_32: op_32(); THREADED_NEXT; L_33: op_33(); THREADED_NEXT; \
+  L_34: op_34(); THREADED_NEXT; L_35: op_35(); THREADED_NEXT; L_36: op_36(); THREADED_NEXT; L_37: op_37(); THREADED_NEXT; \
+  L_38: op_38(); THREADED_NEXT; L_39: op_39(); THREADED_NEXT; L_3a: op_3a(); THREADED_NEXT; L_3b: op_3b(); THREADED_NEXT; \
+  L_3c: op_3c(); THREADED_NEXT; L_3d: op_3d(); THREADED_NEXT; L_3e: op_3e(); THREADED_NEXT; L_3f: op_3f(); THREADED_NEXT; \
+  L_40: op_40(); THREADED_NEXT; L_41: op_41(); THREADED_NEXT; L_42: op_42(); THREADED_NEXT; L_43: op_43(); THREADED_NEXT; \
+  L_44: op_44(); THREADED_NEXT; L_45: op_45(); THREADED_NEXT; L_46: op_46(); THREADED_NEXT; L_47: op_47(); THREADED_NEXT; \
+  L_48: op_48(); THREADED_NEXT; L_49: op_49(); THREADED_NEXT; L_4a: op_4a(); THREADED_NEXT; L_4b: op_4b(); THREADED_NEXT; \
+  L_4c: op_4c(); THREADED_NEXT; L_4d: op_4d(); THREADED_NEXT; L_4e: op_4e(); THREADED_NEXT; L_4f: op_4f(); THREADED_NEXT; \
+  L_50: op_50(); THREADED_NEXT; L_51: op_51(); THREADED_NEXT; L_52: op_52(); THREADED_NEXT; L_53: op_53(); THREADED_NEXT; \
+  L_54: op_54(); THREADED_NEXT; L_55: op_55(); THREADED_NEXT; L_56: op_56(); THREADED_NEXT; L_57: op_57(); THREADED_NEXT; \
+  L_58: op_58(); THREADED_NEXT; L_59: op_59(); THREADED_NEXT; L_5a: op_5a(); THREADED_NEXT; L_5b: op_5b(); THREADED_NEXT; \
+  L_5c: op_5c(); THREADED_NEXT; L_5d: op_5d(); THREADED_NEXT; L_5e: op_5e(); THREADED_NEXT; L_5f: op_5f(); THREADED_NEXT; \
+  L_60: op_60(); THREADED_NEXT; L_61: op_61(); THREADED_NEXT; L_62: op_62(); THREADED_NEXT; L_63: op_63(); THREADED_NEXT; \
+  L_64: op_64(); THREADED_NEXT; L_65: op_65(); THREADED_NEXT; L_66: op_66(); THREADED_NEXT; L_67: op_67(); THREADED_NEXT; \
+  L_68: op_68(); THREADED_NEXT; L_69: op_69(); THREADED_NEXT; L_6a: op_6a(); THREADED_NEXT; L_6b: op_6b(); THREADED_NEXT; \
+  L_6c: op_6c(); THREADED_NEXT; L_6d: op_6d(); THREADED_NEXT; L_6e: op_6e(); THREADED_NEXT; L_6f: op_6f(); THREADED_NEXT; \
+  L_70: op_70(); THREADED_NEXT; L_71: op_71(); THREADED_NEXT; L_72: op_72(); THREADED_NEXT; L_73: op_73(); THREADED_NEXT; \
+  L_74: op_74(); THREADED_NEXT; L_75: op_75(); THREADED_NEXT; L_76: op_76(); THREADED_NEXT; L_77: op_77(); THREADED_NEXT; \
+  L_78: op_78(); THREADED_NEXT; L_79: op_79(); THREADED_NEXT; L_7a: op_7a(); THREADED_NEXT; L_7b: op_7b(); THREADED_NEXT; \
+  L_7c: op_7c(); THREADED_NEXT; L_7d: op_7d(); THREADED_NEXT; L_7e: op_7e(); THREADED_NEXT; L_7f: op_7f(); THREADED_NEXT; \
+  L_80: op_80(); THREADED_NEXT; L_81: op_81(); THREADED_NEXT; L_82: op_82(); THREADED_NEXT; L_83: op_83(); THREADED_NEXT; \
+  L_84: op_84(); THREADED_NEXT; L_85: op_85(); THREADED_NEXT; L_86: op_86(); THREADED_NEXT; L_87: op_87(); THREADED_NEXT; \
+  L_88: op_88(); THREADED_NEXT; L_89: op_89(); THREADED_NEXT; L_8a: op_8a(); THREADED_NEXT; L_8b: op_8b(); THREADED_NEXT; \
+  L_8c: op_8c(); THREADED_NEXT; L_8d: op_8d(); THREADED_NEXT; L_8e: op_8e(); THREADED_NEXT; L_8f: op_8f(); THREADED_NEXT; \
+  L_90: op_90(); THREADED_NEXT; L_91: op_91(); THREADED_NEXT; L_92: op_92(); THREADED_NEXT; L_93: op_93(); THREADED_NEXT; \
+  L_94: op_94(); THREADED_NEXT; L_95: op_95(); THREADED_NEXT; L_96: op_96(); THREADED_NEXT; L_97: op_97(); THREADED_NEXT; \
+  L_98: op_98(); THREADED_NEXT; L_99: op_99(); THREADED_NEXT; L_9a: op_9a(); THREADED_NEXT; L_9b: op_9b(); THREADED_NEXT; \
+  L_9c: op_9c(); THREADED_NEXT; L_9d: op_9d(); THREADED_NEXT; L_9e: op_9e(); THREADED_NEXT; L_9f: op_9f(); THREADED_NEXT; \
+  L_a0: op_a0(); THREADED_NEXT; L_a1: op_a1(); THREADED_NEXT; L_a2: op_a2(); THREADED_NEXT; L_a3: op_a3(); THREADED_NEXT; \
+  L_a4: op_a4(); THREADED_NEXT; L_a5: op_a5(); THREADED_NEXT; L_a6: op_a6(); THREADED_NEXT; L_a7: op_a7(); THREADED_NEXT; \
+  L_a8: op_a8(); THREADED_NEXT; L_a9: op_a9(); THREADED_NEXT; L_aa: op_aa(); THREADED_NEXT; L_ab: op_ab(); THREADED_NEXT; \
+  L_ac: op_ac(); THREADED_NEXT; L_ad: op_ad(); THREADED_NEXT; L_ae: op_ae(); THREADED_NEXT; L_af: op_af(); THREADED_NEXT; \
+  L_b0: op_b0(); THREADED_NEXT; L_b1: op_b1(); THREADED_NEXT; L_b2: op_b2(); THREADED_NEXT; L_b3: op_b3(); THREADED_NEXT; \
+  L_b4: op_b4(); THREADED_NEXT; L_b5: op_b5(); THREADED_NEXT; L_b6: op_b6(); THREADED_NEXT; L_b7: op_b7(); THREADED_NEXT; \
+  L_b8: op_b8(); THREADED_NEXT; L_b9: op_b9(); THREADED_NEXT; L_ba: op_ba(); THREADED_NEXT; L_bb: op_bb(); THREADED_NEXT; \
+  L_bc: op_bc(); THREADED_NEXT; L_bd: op_bd(); THREADED_NEXT; L_be: op_be(); THREADED_NEXT; L_bf: op_bf(); THREADED_NEXT; \
+  L_c0: op_c0(); THREADED_NEXT; L_c1: op_c1(); THREADED_NEXT; L_c2: op_c2(); THREADED_NEXT; L_c3: op_c3(); THREADED_NEXT; \
+  L_c4: op_c4(); THREADED_NEXT; L_c5: op_c5(); THREADED_NEXT; L_c6: op_c6(); THREADED_NEXT; L_c7: op_c7(); THREADED_NEXT; \
+  L_c8: op_c8(); THREADED_NEXT; L_c9: op_c9(); THREADED_NEXT; L_ca: op_ca(); THREADED_NEXT; L_cb: op_cb(); THREADED_NEXT; \
+  L_cc: op_cc(); THREADED_NEXT; L_cd: op_cd(); THREADED_NEXT; L_ce: op_ce(); THREADED_NEXT; L_cf: op_cf(); THREADED_NEXT; \
+  L_d0: op_d0(); THREADED_NEXT; L_d1: op_d1(); THREADED_NEXT; L_d2: op_d2(); THREADED_NEXT; L_d3: op_d3(); THREADED_NEXT; \
+  L_d4: op_d4(); THREADED_NEXT; L_d5: op_d5(); THREADED_NEXT; L_d6: op_d6(); THREADED_NEXT; L_d7: op_d7(); THREADED_NEXT; \
+  L_d8: op_d8(); THREADED_NEXT; L_d9: op_d9(); THREADED_NEXT; L_da: op_da(); THREADED_NEXT; L_db: op_db(); THREADED_NEXT; \
+  L_dc: op_dc(); THREADED_NEXT; L_dd: op_dd(); THREADED_NEXT; L_de: op_de(); THREADED_NEXT; L_df: op_df(); THREADED_NEXT; \
+  L_e0: op_e0(); THREADED_NEXT; L_e1: op_e1(); THREADED_NEXT; L_e2: op_e2(); THREADED_NEXT; L_e3: op_e3(); THREADED_NEXT; \
+  L_e4: op_e4(); THREADED_NEXT; L_e5: op_e5(); THREADED_NEXT; L_e6: op_e6(); THREADED_NEXT; L_e7: op_e7(); THREADED_NEXT; \
+  L_e8: op_e8(); THREADED_NEXT; L_e9: op_e9(); THREADED_NEXT; L_ea: op_ea(); THREADED_NEXT; L_eb: op_eb(); THREADED_NEXT; \
+  L_ec: op_ec(); THREADED_NEXT; L_ed: op_ed(); THREADED_NEXT; L_ee: op_ee(); THREADED_NEXT; L_ef: op_ef(); THREADED_NEXT; \
+  L_f0: op_f0(); THREADED_NEXT; L_f1: op_f1(); THREADED_NEXT; L_f2: op_f2(); THREADED_NEXT; L_f3: op_f3(); THREADED_NEXT; \
+  L_f4: op_f4(); THREADED_NEXT; L_f5: op_f5(); THREADED_NEXT; L_f6: op_f6(); THREADED_NEXT; L_f7: op_f7(); THREADED_NEXT; \
+  L_f8: op_f8(); THREADED_NEXT; L_f9: op_f9(); THREADED_NEXT; L_fa: op_fa(); THREADED_NEXT; L_fb: op_fb(); THREADED_NEXT; \
+  L_fc: op_fc(); THREADED_NEXT; L_fd: op_fd(); THREADED_NEXT; L_fe: op_fe(); THREADED_NEXT; L_ff: op_ff(); THREADED_NEXT;
+
+#endif
+
 
 /***************************************************************
  * Enter HALT state; write 1 to fake port on first execution
@@ -585,6 +721,20 @@ INLINE void BURNODD(int cycles, int opcodes, int cyclesum)
   HALT = 1;                                   \
 }
 
+/***************************************************************
+ * Stay in HALT state until the end of the timeslice if no
+ * interrupt can be taken before: each skipped HALT takes 4
+ * cycles and increments R (as z80_burn does)
+ ***************************************************************/
+#if Z80_IDLE_LOOPS
+#define IDLE_HALT {                                         \
+  if ((z80_ICount > 0) && !(Z80.irq_state != CLEAR_LINE && IFF1)) \
+    z80_burn(z80_ICount);                                   \
+}
+#else
+#define IDLE_HALT
+#endif
+
 /***************************************************************
  * Leave HALT state; write 0 to fake port
  ***************************************************************/
@@ -596,15 +746,22 @@ INLINE void BURNODD(int cycles, int opcodes, int cyclesum)
   }                                           \
 }
 
+/***************************************************************
+ * Let the machine catch up with the cycle current instruction
+ * started at before any I/O port access
+ ***************************************************************/
+#define IO_SYNC() (machine->z80.io_sync ? \
+  machine->z80.io_sync(z80_cycle_count + z80_requested_cycles - z80_op_icount) : (void)0)
+
 /***************************************************************
  * Input a byte from given I/O port
  ***************************************************************/
-#define IN(port) ((UINT8)cpu_readport16(port))
+#define IN(port) (IO_SYNC(), (UINT8)cpu_readport16(port))
 
 /***************************************************************
  * Output a byte to given I/O port
  ***************************************************************/
-#define OUT(port,value) cpu_writeport16(port,value)
+#define OUT(port,value) do { IO_SYNC(); cpu_writeport16(port,value); } while (0)
 
 /***************************************************************
  * Read a byte from given memory location
@@ -684,12 +841,32 @@ INLINE UINT32 ARG16(void)
 #define PUSH(SR) do { SP -= 2; WM16( SPD, &Z80.SR ); } while (0)
 
 /***************************************************************
- * JP
+ * Idle loop detection on short backward jumps
  ***************************************************************/
-#define JP {                                    \
+#if Z80_IDLE_LOOPS
+static void idle_loop(int dist);
+#define IDLE_LOOP(dist) {                       \
+  if (((dist) < 0) && ((dist) >= -Z80_IDLE_LEN)) \
+    idle_loop(dist);                            \
+}
+#define JP_ARG16 {                              \
+  int next = PC + 2;                            \
   PCD = ARG16();                                \
   WZ = PCD;                                 \
+  IDLE_LOOP((int)PCD - next);                   \
 }
+#else
+#define IDLE_LOOP(dist)
+#define JP_ARG16 {                              \
+  PCD = ARG16();                                \
+  WZ = PCD;                                 \
+}
+#endif
+
+/***************************************************************
+ * JP
+ ***************************************************************/
+#define JP JP_ARG16
 
 /***************************************************************
  * JP_COND
@@ -697,8 +874,7 @@ INLINE UINT32 ARG16(void)
 #define JP_COND(cond) {                         \
   if (cond)                                     \
   {                                             \
-    PCD = ARG16();                              \
-    WZ = PCD;                               \
+    JP_ARG16;                                   \
   }                                             \
   else                                          \
   {                                             \
@@ -713,6 +889,7 @@ INLINE UINT32 ARG16(void)
   INT8 arg = (INT8)ARG(); /* ARG() also increments PC */    \
   PC += arg;        /* so don't do PC += ARG() */    \
   WZ = PC;                                              \
+  IDLE_LOOP(arg);                                       \
 }
 
 /***************************************************************
@@ -721,12 +898,26 @@ INLINE UINT32 ARG16(void)
 #define JR_COND(cond, opcode) {   \
   if (cond)                       \
   {                               \
-    JR();                         \
     CC(ex, opcode);               \
+    JR();                         \
   }                               \
   else PC++;                      \
 }
 
+/***************************************************************
+ * DJNZ (counting loops are never idle)
+ ***************************************************************/
+#define DJNZ {                                              \
+  if (--B)                                                  \
+  {                                                         \
+    INT8 arg = (INT8)ARG(); /* ARG() also increments PC */  \
+    PC += arg;                                              \
+    WZ = PC;                                                \
+    CC(ex, 0x10);                                           \
+  }                                                         \
+  else PC++;                                                \
+}
+
 /***************************************************************
  * CALL
  ***************************************************************/
@@ -2939,7 +3130,7 @@ OP(op,0d) { C = DEC(C);
 OP(op,0e) { C = ARG();                                                                                     } /* LD   C,n         */
 OP(op,0f) { RRCA;                                                                                          } /* RRCA             */
 
-OP(op,10) { B--; JR_COND( B, 0x10 );                                                                       } /* DJNZ o           */
+OP(op,10) { DJNZ;                                                                                          } /* DJNZ o           */
 OP(op,11) { DE = ARG16();                                                                                  } /* LD   DE,w        */
 OP(op,12) { WM( DE, A ); WZ_L = (DE + 1) & 0xFF;  WZ_H = A;                                        } /* LD   (DE),A      */
 OP(op,13) { DE++;                                                                                          } /* INC  DE          */
@@ -3053,7 +3244,7 @@ OP(op,72) { WM( HL, D );
 OP(op,73) { WM( HL, E );                                                                                   } /* LD   (HL),E      */
 OP(op,74) { WM( HL, H );                                                                                   } /* LD   (HL),H      */
 OP(op,75) { WM( HL, L );                                                                                   } /* LD   (HL),L      */
-OP(op,76) { ENTER_HALT;                                                                                    } /* HALT             */
+OP(op,76) { ENTER_HALT; IDLE_HALT;                                                                         } /* HALT             */
 OP(op,77) { WM( HL, A );                                                                                   } /* LD   (HL),A      */
 
 OP(op,78) { A = B;                                                                                         } /* LD   A,B         */
@@ -3275,68 +3466,273 @@ static void take_interrupt(void)
   WZ=PCD;
 }
 
+#if Z80_IDLE_LOOPS
+/* main opcodes length (prefixes excluded) */
+static const UINT8 op_size[0x100] = {
+  1,3,1,1,1,1,2,1,1,1,1,1,1,1,2,1,
+  2,3,1,1,1,1,2,1,2,1,1,1,1,1,2,1,
+  2,3,3,1,1,1,2,1,2,1,3,1,1,1,2,1,
+  2,3,3,1,1,1,2,1,2,1,3,1,1,1,2,1,
+  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+  1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+  1,1,3,3,3,1,2,1,1,1,3,1,3,3,2,1,
+  1,1,3,2,3,1,2,1,1,1,3,2,3,1,2,1,
+  1,1,3,1,3,1,2,1,1,1,3,1,3,1,2,1,
+  1,1,3,1,3,1,2,1,1,1,3,1,3,1,2,1
+};
+#endif
+
+#if Z80_IDLE_LOOPS
 /****************************************************************************
- * Processor initialization
+ * Idle loops: once a full iteration of a short backward loop which neither
+ * writes to memory or ports nor reads ports with side effects (polling of
+ * the VDP status and V counter excepted) leaves all registers unchanged,
+ * every following iteration does the same until an interrupt is taken or
+ * a polled port changes. These iterations are skipped at once up to the
+ * end of the timeslice (where system_frame raises interrupts), adjusting
+ * cycles and R register as if they had been executed.
  ****************************************************************************/
-void z80_init(int index, int clock, const void *config, int (*irqcallback)(int))
+#define Z80_IDLE_PORTS  4       /* maximal number of polled ports */
+
+/* Return cycles taken by one iteration of a side-effect free loop (0= not idle) */
+static int idle_scan(unsigned pc, int len, UINT8 *ports, int *count)
 {
-  int i, p;
+  unsigned end = pc + len;
+  int cycles = 0;
+
+  *count = 0;
 
-  if( !SZHVC_add || !SZHVC_sub )
+  while (pc < end)
   {
-    int oldval, newval, val;
-    UINT8 *padd, *padc, *psub, *psbc;
-    /* allocate big flag arrays once */
-    SZHVC_add = (UINT8 *)malloc(2*256*256);
-    SZHVC_sub = (UINT8 *)malloc(2*256*256);
-    if( !SZHVC_add || !SZHVC_sub )
+    unsigned op = RM(pc & 0xffff);
+    int size = op_size[op];
+
+    cycles += cc[Z80_TABLE_op][op];
+
+    if ((op >= 0x40) && (op < 0xc0))
     {
-      return;
+      /* LD r,r' / LD r,(HL) / ALU A,r / ALU A,(HL) (LD (HL),r & HALT excepted) */
+      if ((op & 0xf8) == 0x70)
+        return 0;
     }
-    padd = &SZHVC_add[  0*256];
-    padc = &SZHVC_add[256*256];
-    psub = &SZHVC_sub[  0*256];
-    psbc = &SZHVC_sub[256*256];
-    for (oldval = 0; oldval < 256; oldval++)
+    else switch (op)
     {
-      for (newval = 0; newval < 256; newval++)
-      {
-        /* add or adc w/o carry set */
-        val = newval - oldval;
-        *padd = (newval) ? ((newval & 0x80) ? SF : 0) : ZF;
-        *padd |= (newval & (YF | XF));  /* undocumented flag bits 5+3 */
-        if( (newval & 0x0f) < (oldval & 0x0f) ) *padd |= HF;
-        if( newval < oldval ) *padd |= CF;
-        if( (val^oldval^0x80) & (val^newval) & 0x80 ) *padd |= VF;
-        padd++;
-
-        /* adc with carry set */
-        val = newval - oldval - 1;
-        *padc = (newval) ? ((newval & 0x80) ? SF : 0) : ZF;
-        *padc |= (newval & (YF | XF));  /* undocumented flag bits 5+3 */
-        if( (newval & 0x0f) <= (oldval & 0x0f) ) *padc |= HF;
-        if( newval <= oldval ) *padc |= CF;
-        if( (val^oldval^0x80) & (val^newval) & 0x80 ) *padc |= VF;
-        padc++;
-
-        /* cp, sub or sbc w/o carry set */
-        val = oldval - newval;
-        *psub = NF | ((newval) ? ((newval & 0x80) ? SF : 0) : ZF);
-        *psub |= (newval & (YF | XF));  /* undocumented flag bits 5+3 */
-        if( (newval & 0x0f) > (oldval & 0x0f) ) *psub |= HF;
-        if( newval > oldval ) *psub |= CF;
-        if( (val^oldval) & (oldval^newval) & 0x80 ) *psub |= VF;
-        psub++;
-
-        /* sbc with carry set */
-        val = oldval - newval - 1;
-        *psbc = NF | ((newval) ? ((newval & 0x80) ? SF : 0) : ZF);
-        *psbc |= (newval & (YF | XF));  /* undocumented flag bits 5+3 */
-        if( (newval & 0x0f) >= (oldval & 0x0f) ) *psbc |= HF;
-        if( newval >= oldval ) *psbc |= CF;
-        if( (val^oldval) & (oldval^newval) & 0x80 ) *psbc |= VF;
-        psbc++;
-      }
+      case 0x00:                                          /* NOP */
+      case 0x01: case 0x11: case 0x21: case 0x31:         /* LD rr,nn */
+      case 0x03: case 0x13: case 0x23: case 0x33:         /* INC rr */
+      case 0x0b: case 0x1b: case 0x2b: case 0x3b:         /* DEC rr */
+      case 0x09: case 0x19: case 0x29: case 0x39:         /* ADD HL,rr */
+      case 0x04: case 0x0c: case 0x14: case 0x1c:         /* INC r */
+      case 0x24: case 0x2c: case 0x3c:
+      case 0x05: case 0x0d: case 0x15: case 0x1d:         /* DEC r */
+      case 0x25: case 0x2d: case 0x3d:
+      case 0x06: case 0x0e: case 0x16: case 0x1e:         /* LD r,n */
+      case 0x26: case 0x2e: case 0x3e:
+      case 0x07: case 0x0f: case 0x17: case 0x1f:         /* RLCA/RRCA/RLA/RRA */
+      case 0x27: case 0x2f: case 0x37: case 0x3f:         /* DAA/CPL/SCF/CCF */
+      case 0x0a: case 0x1a: case 0x2a: case 0x3a:         /* LD A,(BC)/(DE)/(nn), LD HL,(nn) */
+      case 0xc6: case 0xce: case 0xd6: case 0xde:         /* ALU A,n */
+      case 0xe6: case 0xee: case 0xf6: case 0xfe:
+      case 0xc0: case 0xc8: case 0xd0: case 0xd8:         /* RET cc (loop exit) */
+      case 0xe0: case 0xe8: case 0xf0: case 0xf8:
+      case 0xc2: case 0xca: case 0xd2: case 0xda:         /* JP cc */
+      case 0xe2: case 0xea: case 0xf2: case 0xfa:
+      case 0xeb: case 0xf9:                               /* EX DE,HL / LD SP,HL */
+        break;
+
+      case 0x20: case 0x28: case 0x30: case 0x38:         /* JR cc */
+        if (pc + size == end)
+          cycles += cc[Z80_TABLE_ex][op];
+        break;
+
+      case 0x18: case 0xc3:                               /* JR / JP (loop end) */
+        if (pc + size != end)
+          return 0;
+        break;
+
+      case 0xdb:                                          /* IN A,(n) */
+        if (*count == Z80_IDLE_PORTS)
+          return 0;
+        ports[(*count)++] = RM((pc + 1) & 0xffff);
+        break;
+
+      case 0xcb:
+        /* (HL) is only read by BIT b,(HL) */
+        op = RM((pc + 1) & 0xffff);
+        if (((op & 7) == 6) && ((op & 0xc0) != 0x40))
+          return 0;
+        cycles += cc[Z80_TABLE_cb][op];
+        size = 2;
+        break;
+
+      case 0xdd:
+      case 0xfd:
+        op = RM((pc + 1) & 0xffff);
+        cycles += cc[Z80_TABLE_xy][op];
+        if (op == 0xcb)
+        {
+          /* BIT b,(IX+d) */
+          op = RM((pc + 3) & 0xffff);
+          if ((op & 0xc0) != 0x40)
+            return 0;
+          cycles += cc[Z80_TABLE_xycb][op];
+          size = 4;
+        }
+        else
+        {
+          /* LD r,(IX+d) / ALU A,(IX+d) */
+          if ((op < 0x40) || (op >= 0xc0) || ((op & 7) != 6) || (op == 0x76))
+            return 0;
+          size = 3;
+        }
+        break;
+
+      default:
+        return 0;
+    }
+
+    pc += size;
+  }
+
+  return (pc == end) ? cycles : 0;
+}
+
+/* Called after a short backward jump: 'dist' is minus the loop length */
+static void idle_loop(int dist)
+{
+  z80_idle_t *idle = &machine->z80.idle;
+  const UINT8 *site = &cpu_readmap[PC >> 10][PC & 0x03FF];
+  int elapsed = z80_cycle_count + z80_requested_cycles - z80_ICount;
+  UINT8 ports[Z80_IDLE_PORTS];
+  UINT8 r = R - idle->r;
+  int i, n, count, limit;
+
+  if ((site != idle->site) || (dist != idle->dist))
+  {
+    /* new loop */
+    idle->site = site;
+    idle->dist = dist;
+    idle->cycles = idle_scan(PCD, -dist, ports, &count);
+    idle->count = 0;
+  }
+  else if (!idle->cycles)
+  {
+    return;
+  }
+  else if ((elapsed - idle->stamp == idle->cycles) && (AFD == idle->af) &&
+           (BCD == idle->bc) && (DED == idle->de) && (HLD == idle->hl) &&
+           (IXD == idle->ix) && (IYD == idle->iy) && (SPD == idle->sp) &&
+           (Z80.wz.d == idle->wz))
+  {
+    /* one more iteration without any register change */
+    idle->count++;
+  }
+  else
+  {
+    idle->count = 0;
+  }
+
+  idle->stamp = elapsed;
+  idle->af = AFD;
+  idle->bc = BCD;
+  idle->de = DED;
+  idle->hl = HLD;
+  idle->ix = IXD;
+  idle->iy = IYD;
+  idle->sp = SPD;
+  idle->wz = Z80.wz.d;
+  idle->r = R;
+
+  /* two unchanged iterations in this timeslice (the first one cleared any */
+  /* polled VDP flag) and no interrupt to be taken before its end */
+  if ((idle->count < 2) || (elapsed - 2 * idle->cycles < z80_cycle_count) ||
+      ((Z80.irq_state != CLEAR_LINE) && IFF1))
+    return;
+
+  /* loop code in RAM could have been modified meanwhile */
+  if (idle_scan(PCD, -dist, ports, &count) != idle->cycles)
+  {
+    idle->site = NULL;
+    return;
+  }
+
+  /* skip whole iterations, the interpreter ends the timeslice */
+  n = (z80_ICount - 1) / idle->cycles;
+  for (i = 0; i < count; i++)
+  {
+    limit = memz80_port_idle(ports[i], elapsed - 2 * idle->cycles) - elapsed;
+    if (limit < n * idle->cycles)
+      n = limit / idle->cycles;
+  }
+
+  if (n > 0)
+  {
+    R += n * r;
+    z80_ICount -= n * idle->cycles;
+    idle->stamp += n * idle->cycles;
+    idle->r = R;
+  }
+}
+#endif
+
+/****************************************************************************
+ * Build flag and cycle tables (shared by all machine contexts)
+ ****************************************************************************/
+static void z80_init_tables(void)
+{
+  int i, p;
+  int oldval, newval, val;
+  UINT8 *padd, *padc, *psub, *psbc;
+
+  padd = &SZHVC_add[  0*256];
+  padc = &SZHVC_add[256*256];
+  psub = &SZHVC_sub[  0*256];
+  psbc = &SZHVC_sub[256*256];
+  for (oldval = 0; oldval < 256; oldval++)
+  {
+    for (newval = 0; newval < 256; newval++)
+    {
+      /* add or adc w/o carry set */
+      val = newval - oldval;
+      *padd = (newval) ? ((newval & 0x80) ? SF : 0) : ZF;
+      *padd |= (newval & (YF | XF));  /* undocumented flag bits 5+3 */
+      if( (newval & 0x0f) < (oldval & 0x0f) ) *padd |= HF;
+      if( newval < oldval ) *padd |= CF;
+      if( (val^oldval^0x80) & (val^newval) & 0x80 ) *padd |= VF;
+      padd++;
+
+      /* adc with carry set */
+      val = newval - oldval - 1;
+      *padc = (newval) ? ((newval & 0x80) ? SF : 0) : ZF;
+      *padc |= (newval & (YF | XF));  /* undocumented flag bits 5+3 */
+      if( (newval & 0x0f) <= (oldval & 0x0f) ) *padc |= HF;
+      if( newval <= oldval ) *padc |= CF;
+      if( (val^oldval^0x80) & (val^newval) & 0x80 ) *padc |= VF;
+      padc++;
+
+      /* cp, sub or sbc w/o carry set */
+      val = oldval - newval;
+      *psub = NF | ((newval) ? ((newval & 0x80) ? SF : 0) : ZF);
+      *psub |= (newval & (YF | XF));  /* undocumented flag bits 5+3 */
+      if( (newval & 0x0f) > (oldval & 0x0f) ) *psub |= HF;
+      if( newval > oldval ) *psub |= CF;
+      if( (val^oldval) & (oldval^newval) & 0x80 ) *psub |= VF;
+      psub++;
+
+      /* sbc with carry set */
+      val = oldval - newval - 1;
+      *psbc = NF | ((newval) ? ((newval & 0x80) ? SF : 0) : ZF);
+      *psbc |= (newval & (YF | XF));  /* undocumented flag bits 5+3 */
+      if( (newval & 0x0f) >= (oldval & 0x0f) ) *psbc |= HF;
+      if( newval >= oldval ) *psbc |= CF;
+      if( (val^oldval) & (oldval^newval) & 0x80 ) *psbc |= VF;
+      psbc++;
     }
   }
 
@@ -3364,14 +3760,6 @@ void z80_init(int index, int clock, const void *config, int (*irqcallback)(int))
     if( (i & 0x0f) == 0x0f ) SZHV_dec[i] |= HF;
   }
 
-  /* Reset registers to their initial values */
-  memset(&Z80, 0, sizeof(Z80));
-  IX = IY = 0xffff; /* IX and IY are FFFF after a reset! */
-  F = ZF;      /* Zero flag is set */
-  SP = 0xdff0; /* fix Shadow Dancer & Ace of Aces (normally set by BIOS) */
-  Z80.daisy = config;
-  Z80.irq_callback = irqcallback;
-
   /* setup cycle tables */
   cc[Z80_TABLE_op] = cc_op;
   cc[Z80_TABLE_cb] = cc_cb;
@@ -3381,6 +3769,23 @@ void z80_init(int index, int clock, const void *config, int (*irqcallback)(int))
   cc[Z80_TABLE_ex] = cc_ex;
 }
 
+/****************************************************************************
+ * Processor initialization
+ ****************************************************************************/
+void z80_init(int index, int clock, const void *config, int (*irqcallback)(int))
+{
+  /* Flag tables are only built once */
+  worker_once(&tables_once, z80_init_tables);
+
+  /* Reset registers to their initial values */
+  memset(&Z80, 0, sizeof(Z80));
+  IX = IY = 0xffff; /* IX and IY are FFFF after a reset! */
+  F = ZF;      /* Zero flag is set */
+  SP = 0xdff0; /* fix Shadow Dancer & Ace of Aces (normally set by BIOS) */
+  Z80.daisy = config;
+  Z80.irq_callback = irqcallback;
+}
+
 /****************************************************************************
  * Do a reset
  ****************************************************************************/
@@ -3397,14 +3802,13 @@ void z80_reset(void)
   Z80.after_ei = FALSE;
 
   WZ=PCD;
+
+  memset(&machine->z80.idle, 0, sizeof(z80_idle_t));
 }
 
+
 void z80_exit(void)
 {
-  if (SZHVC_add) free(SZHVC_add);
-  SZHVC_add = NULL;
-  if (SZHVC_sub) free(SZHVC_sub);
-  SZHVC_sub = NULL;
 }
 
 /****************************************************************************
@@ -3432,6 +3836,16 @@ int z80_execute(int cycles)
     Z80.nmi_pending = FALSE;
   }
 
+#if Z80_THREADED
+  {
+    static const void *const threaded_table[0x100] = { THREADED_TABLE };
+    unsigned op;
+
+    THREADED_NEXT;
+    THREADED_OPS;
+  }
+threaded_exit:
+#else
   while( z80_ICount > 0 )
   {
     /* check for IRQs before each instruction */
@@ -3441,15 +3855,33 @@ int z80_execute(int cycles)
 
     if (z80_ICount > 0)
     {
+      z80_op_icount = z80_ICount;
       R++;
       EXEC_INLINE(op,ROP());
     }
   } 
+#endif
 
   z80_exec = 0;
-  z80_cycle_count += (cycles - z80_ICount);
+  z80_cycle_count += (z80_requested_cycles - z80_ICount);
+
+  return z80_requested_cycles - z80_ICount;
+}
 
-  return cycles - z80_ICount;
+/****************************************************************************
+ * End current timeslice at given cycle count, if it would end later
+ ****************************************************************************/
+void z80_end_timeslice(int cycles)
+{
+  if (z80_exec)
+  {
+    int left = cycles - z80_get_elapsed_cycles();
+    if (left < z80_ICount)
+    {
+      z80_requested_cycles -= z80_ICount - left;
+      z80_ICount = left;
+    }
+  }
 }
 
 /****************************************************************************
@@ -40,14 +40,47 @@ typedef struct
   int    (*irq_callback)(int irqline);
 }  Z80_Regs;
 
+/****************************************************************************/
+/* Idle loop detection: last short backward jump taken and register state   */
+/****************************************************************************/
+typedef struct
+{
+  const unsigned char *site;  /* host address of the loop start (NULL= none) */
+  int    dist;                /* jump distance (minus loop length) */
+  int    cycles;              /* cycles per iteration (0= not an idle loop) */
+  int    count;               /* iterations in a row without state change */
+  int    stamp;               /* elapsed cycles at last iteration */
+  UINT32 af,bc,de,hl,ix,iy,sp,wz;
+  UINT8  r;
+} z80_idle_t;
+
+/****************************************************************************/
+/* The Z80 execution context: registers, timeslice and memory/port handlers */
+/****************************************************************************/
+typedef struct
+{
+  Z80_Regs regs;
+  int    icount;              /* cycles left in current timeslice */
+  int    op_icount;           /* cycles left when current instruction started */
+  int    cycle_count;         /* running total of cycles executed */
+  int    exec;                /* 1= in exec loop, 0= out of */
+  int    requested_cycles;    /* requested cycles to execute this timeslice */
+  UINT32 ea;
+  z80_idle_t idle;             /* idle loop detection */
+  void (*io_sync)(int cycles);  /* called before I/O port accesses (optional) */
+  unsigned char *readmap[64];
+  unsigned char *writemap[64];
+  void (*writemem16)(int address, int data);
+  void (*writeport16)(uint16 port, uint8 data);
+  uint8 (*readport16)(uint16 port);
+} z80_t;
 
-extern int z80_cycle_count;
-extern Z80_Regs Z80;
 
 void z80_init(int index, int clock, const void *config, int (*irqcallback)(int));
 void z80_reset (void);
 void z80_exit (void);
 int z80_execute(int cycles);
+void z80_end_timeslice(int cycles);
 void z80_burn(int cycles);
 void z80_get_context (void *dst);
 void z80_set_context (void *src);
@@ -55,13 +88,6 @@ void z80_set_irq_line(int irqline, int state);
 void z80_reset_cycle_count(void);
 int z80_get_elapsed_cycles(void);
 
-unsigned char *cpu_readmap[64];
-unsigned char *cpu_writemap[64];
-
-void (*cpu_writemem16)(int address, int data);
-void (*cpu_writeport16)(uint16 port, uint8 data);
-uint8 (*cpu_readport16)(uint16 port);
-
 
 
 #endif
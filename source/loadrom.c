@@ -21,6 +21,7 @@
  ******************************************************************************/
 
 #include "shared.h"
+#include "context.h"
 
 #define GAME_DATABASE_CNT 93
 
@@ -258,7 +259,7 @@ void set_config()
   sms.glasses_3d = 0;
   sms.device[0] = DEVICE_PAD2B;
   sms.device[1] = DEVICE_PAD2B;
-  sms.use_fm = option.fm;
+  sms.use_fm = machine->option.fm;
 
   /* console type detection */
   /* SMS Header is located at 0x7ff0 */
@@ -318,47 +319,49 @@ void set_config()
 
   /* enable BIOS on SMS only */
   bios.enabled &= 2;
-  if (IS_SMS) bios.enabled |= option.use_bios;
+  if (IS_SMS) bios.enabled |= machine->option.use_bios;
 
   /* force settings if AUTO is not set*/
-  if (option.console == 1)
+  if (machine->option.console == 1)
     sms.console = CONSOLE_SMS;
-  else if (option.console == 2)
+  else if (machine->option.console == 2)
     sms.console = CONSOLE_SMS2;
-  else if (option.console == 3)
+  else if (machine->option.console == 3)
     sms.console = CONSOLE_GG;
-  else if (option.console == 4)
+  else if (machine->option.console == 4)
     sms.console = CONSOLE_GGMS;
-  else if (option.console == 5)
+  else if (machine->option.console == 5)
   {
     sms.console = CONSOLE_SG1000;
     cart.mapper = MAPPER_NONE;
   }
-  else if (option.console == 6)
+  else if (machine->option.console == 6)
   {
     sms.console = CONSOLE_COLECO;
     cart.mapper = MAPPER_NONE;
   }
 
-  if (option.country == 1) /* USA */
+  if (machine->option.country == 1) /* USA */
   {
     sms.display = DISPLAY_NTSC;
     sms.territory = TERRITORY_EXPORT;
   }
-  else if (option.country == 2) /* EUROPE */
+  else if (machine->option.country == 2) /* EUROPE */
   {
     sms.display = DISPLAY_PAL;
     sms.territory = TERRITORY_EXPORT;
   }
-  else if (option.country == 3) /* JAPAN */
+  else if (machine->option.country == 3) /* JAPAN */
   {
     sms.display = DISPLAY_NTSC;
     sms.territory = TERRITORY_DOMESTIC;
   }
 }
 
-int load_rom (char *filename)
+int load_rom (machine_t *m, char *filename)
 {
+  machine_select(m);
+
 #ifdef NGC
   memset (&cart, 0, sizeof (cart));
   cart.rom = &smsrom[0];
@@ -377,7 +380,14 @@ int load_rom (char *filename)
     int size = cart.size;
     cart.rom = loadFromZipByName(filename, name, &size);
     if(!cart.rom) return 0;
-    strcpy(game_name, name);
+    cart.size = size;
+    if (cart.size < 0x4000)
+    {
+      cart.size = 0x4000;
+      cart.rom = realloc(cart.rom, cart.size);
+      if(!cart.rom) return 0;
+    }
+    strcpy(machine->game_name, name);
   }
   else
   {
@@ -396,6 +406,8 @@ int load_rom (char *filename)
     fread(cart.rom, cart.size, 1, fd);
 
     fclose(fd);
+
+    strncpy(machine->game_name, filename, PATH_MAX - 1);
   }
 #endif
 
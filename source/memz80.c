@@ -23,10 +23,7 @@
  ******************************************************************************/
 
 #include "shared.h"
-
-/* Pull-up resistors on data bus */
-uint8 data_bus_pullup   = 0x00;
-uint8 data_bus_pulldown = 0x00;
+#include "context.h"
 
 /* Read unmapped memory */
 uint8 z80_read_unmapped(void)
@@ -38,6 +35,32 @@ uint8 z80_read_unmapped(void)
   return ((data | data_bus_pullup) & ~data_bus_pulldown);
 }
 
+/* Return the cycle until which port reads keep returning the value read */
+/* at cycle 'start' without other side effect (used by Z80 idle loops)   */
+int memz80_port_idle(uint16 port, int start)
+{
+  port &= 0xFF;
+
+  if ((cpu_readport16 == sms_port_r) || (cpu_readport16 == md_port_r) ||
+      (((cpu_readport16 == gg_port_r) || (cpu_readport16 == ggms_port_r)) && (port > 0x20)))
+  {
+    switch(port & 0xC1)
+    {
+      case 0x40:
+        return vdp_counter_idle(start);
+
+      case 0x81:
+        return vdp_status_idle(start);
+    }
+  }
+  else if ((cpu_readport16 == tms_port_r) && ((port & 0xC1) == 0x81))
+  {
+    return vdp_status_idle(start);
+  }
+
+  return 0;
+}
+
 /* Port $3E (Memory Control Port) */
 void memctrl_w(uint8 data)
 {
@@ -47,7 +70,7 @@ void memctrl_w(uint8 data)
     /* autodetect loaded BIOS ROM */
     if (!(bios.enabled & 2) && ((data & 0xE8) == 0xE8))
     {
-      bios.enabled = option.use_bios | 2;
+      bios.enabled = machine->option.use_bios | 2;
       memcpy(bios.rom, cart.rom, cart.size);
       memcpy(bios.fcr, cart.fcr, 4);
       bios.pages = cart.pages;
@@ -25,12 +25,9 @@
 #ifndef _MEMZ80_H_
 #define _MEMZ80_H_
 
-/* Global data */
-extern uint8 data_bus_pullup;
-extern uint8 data_bus_pulldown;
-
 /* Function prototypes */
 extern uint8 z80_read_unmapped(void);
+extern int memz80_port_idle(uint16 port, int start);
 extern void gg_port_w(uint16 port, uint8 data);
 extern uint8 gg_port_r(uint16 port);
 extern void ggms_port_w(uint16 port, uint8 data);
@@ -113,7 +113,7 @@ static int FAT_ManageFile(char *filename, int direction)
   {
     case 0: /* SAVING */
       /* save sate into buffer */
-      filesize = system_save_state(savebuffer);
+      filesize = system_save_state(machine, savebuffer);
 
       /* write buffer */
       while (filesize > FATCHUNK)
@@ -149,7 +149,7 @@ static int FAT_ManageFile(char *filename, int direction)
       fclose(fp);
 
       /* load STATE */
-      system_load_state(savebuffer);
+      system_load_state(machine, savebuffer);
 
       sprintf (filename, "Loaded %d bytes successfully", done);
       WaitPrompt (filename);
@@ -168,7 +168,7 @@ static int FAT_ManageFile(char *filename, int direction)
  *
  * Function returns TRUE on success.
  *****************************************************************************/
-static int MountTheCard (u8 slot)
+static int MountTheCard (u8 chn)
 {
   int tries = 0;
   int CardError;
@@ -181,7 +181,7 @@ static int MountTheCard (u8 slot)
   while (tries < 10)
   {
     VIDEO_WaitVSync ();
-    CardError = CARD_Mount (slot, SysArea, NULL); /*** Don't need or want a callback ***/
+    CardError = CARD_Mount (chn, SysArea, NULL); /*** Don't need or want a callback ***/
     if (CardError == 0)
       return 1;
     else
@@ -197,9 +197,9 @@ static int MountTheCard (u8 slot)
  * Wrapper to search through the files on the card.
  * Returns TRUE if found.
  ****************************************************************************/
-static int CardFileExists (char *filename, u8 slot)
+static int CardFileExists (char *filename, u8 chn)
 {
-  int CardError = CARD_FindFirst (slot, &CardDir, TRUE);
+  int CardError = CARD_FindFirst (chn, &CardDir, TRUE);
   while (CardError != CARD_ERROR_NOFILE)
   {
     CardError = CARD_FindNext (&CardDir);
@@ -250,7 +250,7 @@ int ManageState (u8 direction, u8 device)
   int state_size = 0;
 
   /* First, build a filename */
-  sprintf (filename, "%08X.spz", (u32)crc32 (0, &cart.rom[0], smsromsize));
+  sprintf (filename, "%08X.spz", (u32)crc32 (0, &machine->cart.rom[0], smsromsize));
   strcpy (comment[1], filename);
 
   /* set MCARD slot nr. */
@@ -262,7 +262,7 @@ int ManageState (u8 direction, u8 device)
     /*** Build the output buffer ***/
     memcpy (&savebuffer, &icon, 2048);
     memcpy (&savebuffer[2048], &comment[0], 64);
-    state_size = system_save_state(&savebuffer[2112]);
+    state_size = system_save_state(machine, &savebuffer[2112]);
   }
 
   outbytes = 2048 + 64 + state_size;
@@ -390,7 +390,7 @@ int ManageState (u8 direction, u8 device)
         CARD_Unmount (CARDSLOT);
 
         /*** Load State ***/
-        system_load_state(&savebuffer[2112]);
+        system_load_state(machine, &savebuffer[2112]);
 
         /*** Inform user ***/
         sprintf (action, "Loaded %d bytes successfully", size);
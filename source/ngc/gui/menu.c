@@ -313,10 +313,12 @@ void dispmenu ()
       case 4: /*** NTSC filter ***/
         option.ntsc ++;
         if (option.ntsc > 3) option.ntsc = 0;
+        machine->option = option;
         break;
         
       case 5: /*** overscan emulation ***/
         option.overscan ^= 1;
+        machine->option = option;
         vdp_init();
         break;
 
@@ -412,7 +414,8 @@ void sysmenu ()
     {
       case 0:  /*** FM chip emulation ***/
         option.fm = (option.fm + 1) % 3;
-        if ((bios.enabled == 3) || smsromsize)
+        machine->option = option;
+        if ((machine->bios.enabled == 3) || smsromsize)
         {
           set_config();
           system_init();
@@ -421,7 +424,8 @@ void sysmenu ()
 
       case 1:  /*** Console Region ***/
         option.country  = (option.country + 1) % 4;
-        if ((bios.enabled == 3) || smsromsize)
+        machine->option = option;
+        if ((machine->bios.enabled == 3) || smsromsize)
         {
           set_config();
           system_init();
@@ -430,7 +434,8 @@ void sysmenu ()
 
       case 2:  /*** Console Type ***/
         option.console = (option.console + 1) % 7;
-        if ((bios.enabled == 3) || smsromsize) 
+        machine->option = option;
+        if ((machine->bios.enabled == 3) || smsromsize) 
         {
           set_config();
           system_poweron();
@@ -439,6 +444,7 @@ void sysmenu ()
 
       case 3: /*** Sprite flickering ***/
         option.spritelimit ^= 1;
+        machine->option = option;
         break;
 
       case 4: /*** SMS palette intensity ***/
@@ -467,16 +473,18 @@ void sysmenu ()
 
      case 5: /*** TMS9918 palette intensity ***/
         option.tms_pal = (option.tms_pal + 1) % 3;
+        machine->option = option;
         for(i = 0; i < PALETTE_SIZE; i++) palette_sync(i);
         break;
 
      case 6: /*** SMS BIOS support ***/
         option.use_bios ^= 1;
+        machine->option = option;
 
         /* enable BIOS on SMS only */
-        bios.enabled &= 2;
-        if (IS_SMS) bios.enabled |= option.use_bios;
-        if ((bios.enabled == 3) || smsromsize)
+        machine->bios.enabled &= 2;
+        if (IS_SMS) machine->bios.enabled |= option.use_bios;
+        if ((machine->bios.enabled == 3) || smsromsize)
         {
           system_poweron();
         }
@@ -484,7 +492,8 @@ void sysmenu ()
 
       case 7: /*** GG screen extra mode ***/
         option.extra_gg ^= 1;
-        if ((bios.enabled == 3) || smsromsize)
+        machine->option = option;
+        if ((machine->bios.enabled == 3) || smsromsize)
         {
           system_init();
         }
@@ -824,7 +833,7 @@ int loadmenu ()
           dvd_on = 1;
           memfile_autosave();
           smsromsize = size;
-          load_rom("");
+          load_rom(machine, "");
           system_poweron ();
           sprintf(rom_filename,"%s",filelist[selection].filename);
           rom_filename[strlen(rom_filename) - 4] = 0;
@@ -846,7 +855,7 @@ int loadmenu ()
         {
           memfile_autosave();
           smsromsize = size;
-          load_rom ("");
+          load_rom (machine, "");
           system_poweron ();
           sprintf(rom_filename,"%s",filelist[selection].filename);
           rom_filename[strlen(rom_filename) - 4] = 0;
@@ -873,7 +882,7 @@ int loadmenu ()
         {
           memfile_autosave();
           smsromsize = size;
-          load_rom ("");
+          load_rom (machine, "");
           system_poweron ();
           sprintf(rom_filename,"%s",filelist[selection].filename);
           rom_filename[strlen(rom_filename) - 4] = 0;
@@ -929,7 +938,7 @@ void MainMenu ()
         break;
 
       case 1: /*** Emulator Reset ***/
-        if ((bios.enabled == 3) || smsromsize)
+        if ((machine->bios.enabled == 3) || smsromsize)
         {
           system_poweron();
           quit = 1;
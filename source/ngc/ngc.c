@@ -45,7 +45,7 @@ void Power_Off(void)
 }
 #endif
 
-void system_manage_sram(uint8 *sram, int slot, int mode)
+void system_manage_sram(uint8 *sram, int which, int mode)
 {
 }
 
@@ -65,12 +65,12 @@ static void load_bios()
   FILE *fp = fopen(pathname, "rb");
   if (fp)
   {
-    fread(coleco.rom, 0x2000, 1, fp);
+    fread(machine->coleco.rom, 0x2000, 1, fp);
     fclose(fp);
   }
 
   /* Master System BIOS */
-  bios.enabled = 0;
+  machine->bios.enabled = 0;
   sprintf (pathname, "%s/BIOS.sms",DEFAULT_PATH);
   fp = fopen(pathname, "rb");
   if (fp)
@@ -84,19 +84,19 @@ static void load_bios()
     int done = 0;
     while (filesize > FATCHUNK)
     {
-      fread(bios.rom + done, FATCHUNK, 1, fp);
+      fread(machine->bios.rom + done, FATCHUNK, 1, fp);
       done+=FATCHUNK;
       filesize-=FATCHUNK;
     }
-    fread(bios.rom + done, filesize, 1, fp);
+    fread(machine->bios.rom + done, filesize, 1, fp);
     fclose(fp);
   
     /* set BIOS size */
     if (filesize < 0x4000) filesize = 0x4000;
-    bios.pages = filesize / 0x4000;
+    machine->bios.pages = filesize / 0x4000;
 
     /* set BIOS flag */
-    bios.enabled = option.use_bios | 2;
+    machine->bios.enabled = option.use_bios | 2;
     set_config();
   }
 
@@ -104,12 +104,15 @@ static void load_bios()
 
 static void init_machine (void)
 {
+  /* emulation settings */
+  machine->option = option;
+
   /* allocate Cartridge ROM */
   smsrom = memalign(32, 1048576);
   smsromsize = 0;
 
   /* allocate internal BIOS ROM */
-  bios.rom = memalign(32, 1048576);
+  machine->bios.rom = memalign(32, 1048576);
   load_bios();
 
   /* allocate global work bitmap */
@@ -205,7 +208,7 @@ int main (int argc, char *argv[])
       {
         /* Frame skipping */
         prev = now;
-        system_frame(1);
+        system_frame(machine, 1);
       }
       else
       {
@@ -214,7 +217,7 @@ int main (int argc, char *argv[])
 
         /* Render Frame */
         prev = now;
-        system_frame(0);
+        system_frame(machine, 0);
       }
     }
     else
@@ -224,14 +227,14 @@ int main (int argc, char *argv[])
       {
         /* Frame skipping */
         frameticker--;
-        system_frame (1);
+        system_frame (machine, 1);
       }
       else
       {
         /* Delay */
         while (!frameticker) usleep(10);  
         
-        system_frame (0);
+        system_frame (machine, 0);
       }
 
       frameticker--;
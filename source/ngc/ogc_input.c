@@ -277,7 +277,7 @@ static void pad_update()
 
       if (d & PAD_TRIGGER_R)
       {
-        pad = (coleco.keypad[i] & 0x0f) + 1;
+        pad = (machine->coleco.keypad[i] & 0x0f) + 1;
         if (pad > 11) pad = 0;
         if (pad == 11)
           sprintf(osd.msg,"KeyPad(%d) #",i+1);
@@ -285,11 +285,11 @@ static void pad_update()
           sprintf(osd.msg,"KeyPad(%d) *",i+1);
         else  sprintf(osd.msg,"KeyPad(%d) %d",i+1,pad);
         osd.frames = 30;
-        coleco.keypad[i] = (coleco.keypad[i] & 0xf0) | pad;
+        machine->coleco.keypad[i] = (machine->coleco.keypad[i] & 0xf0) | pad;
       }
 
       if (p & PAD_TRIGGER_L)
-        coleco.keypad[i] &= 0x0f;
+        machine->coleco.keypad[i] &= 0x0f;
     }
   }
 }
@@ -572,7 +572,7 @@ static void wpad_update(void)
         input.system = 0;
         if (d & WPAD_CLASSIC_BUTTON_PLUS)
         {
-          pad = (coleco.keypad[i] & 0x0f) + 1;
+          pad = (machine->coleco.keypad[i] & 0x0f) + 1;
           if (pad > 11) pad = 0;
           if (pad == 11)
             sprintf(osd.msg,"KeyPad(%d) #",i+1);
@@ -580,17 +580,17 @@ static void wpad_update(void)
             sprintf(osd.msg,"KeyPad(%d) *",i+1);
           else  sprintf(osd.msg,"KeyPad(%d) %d",i+1,pad);
           osd.frames = 60;
-          coleco.keypad[i] = (coleco.keypad[i] & 0xf0) | pad;
+          machine->coleco.keypad[i] = (machine->coleco.keypad[i] & 0xf0) | pad;
         }
 
         if (p & WPAD_CLASSIC_BUTTON_MINUS)
-          coleco.keypad[i] &= 0x0f;
+          machine->coleco.keypad[i] &= 0x0f;
 
         if (use_wpad)
         {
           if (d & WPAD_BUTTON_PLUS)
           {
-            pad = (coleco.keypad[1] & 0x0f) + 1;
+            pad = (machine->coleco.keypad[1] & 0x0f) + 1;
             if (pad > 11) pad = 0;
             if (pad == 11)
               sprintf(osd.msg,"KeyPad(2) #");
@@ -599,17 +599,17 @@ static void wpad_update(void)
             else
               sprintf(osd.msg,"KeyPad(2) %d",pad);
             osd.frames = 60;
-            coleco.keypad[1] = (coleco.keypad[1] & 0xf0) | pad;
+            machine->coleco.keypad[1] = (machine->coleco.keypad[1] & 0xf0) | pad;
           }
 
           if (p & WPAD_BUTTON_MINUS)
-            coleco.keypad[1] &= 0x0f;
+            machine->coleco.keypad[1] &= 0x0f;
         }
         else
         {
           if (d & WPAD_BUTTON_PLUS)
           {
-            pad = (coleco.keypad[i] & 0x0f) + 1;
+            pad = (machine->coleco.keypad[i] & 0x0f) + 1;
             if (pad > 11) pad = 0;
             if (pad == 11)
               sprintf(osd.msg,"KeyPad(%d) #",i+1);
@@ -617,11 +617,11 @@ static void wpad_update(void)
               sprintf(osd.msg,"KeyPad(%d) *",i+1);
             else  sprintf(osd.msg,"KeyPad(%d) %d",i+1,pad);
             osd.frames = 30;
-            coleco.keypad[i] = (coleco.keypad[i] & 0xf0) | pad;
+            machine->coleco.keypad[i] = (machine->coleco.keypad[i] & 0xf0) | pad;
           }
 
           if (p & WPAD_BUTTON_MINUS)
-            coleco.keypad[i] &= 0x0f;
+            machine->coleco.keypad[i] &= 0x0f;
         }
       }
     }
@@ -650,8 +650,8 @@ void ogc_input__init(void)
 void ogc_input__update(void)
 {
   /* reset inputs */
-  coleco.keypad[0] |= 0xf0;
-  coleco.keypad[1] |= 0xf0;
+  machine->coleco.keypad[0] |= 0xf0;
+  machine->coleco.keypad[1] |= 0xf0;
   input.pad[0] = 0;
   input.pad[1] = 0;
   input.system = 0;
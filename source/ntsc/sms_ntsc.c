@@ -1,6 +1,7 @@
 /* sms_ntsc 0.2.3. http://www.slack.net/~ant/ */
 
 #include "shared.h"
+#include "context.h"
 #include "sms_ntsc.h"
 
 /* Copyright (C) 2006-2007 Shay Green. This module is free software; you
@@ -52,6 +53,10 @@ static void correct_errors( sms_ntsc_rgb_t color, sms_ntsc_rgb_t* out )
   }
 }
 
+#ifndef SMS_NTSC_NO_BLITTERS
+static void sms_ntsc_pick_row( void );
+#endif
+
 void sms_ntsc_init( sms_ntsc_t* ntsc, sms_ntsc_setup_t const* setup )
 {
   int entry;
@@ -80,12 +85,16 @@ void sms_ntsc_init( sms_ntsc_t* ntsc, sms_ntsc_setup_t const* setup )
       correct_errors( rgb, ntsc->table [entry] );
     }
   }
+
+#ifndef SMS_NTSC_NO_BLITTERS
+  sms_ntsc_pick_row();
+#endif
 }
 
 #ifndef SMS_NTSC_NO_BLITTERS
 
 /* modified blitters to work on a line basis with genesis plus renderer*/
-void sms_ntsc_blit( sms_ntsc_t const* ntsc, SMS_NTSC_IN_T const* table, unsigned char* input,
+void sms_ntsc_blit( sms_ntsc_t const* ntsc, SMS_NTSC_IN_T const* table, unsigned char* in_pixels,
     int in_width, int vline)
 {
   int const chunk_count = in_width / sms_ntsc_in_chunk;
@@ -98,25 +107,25 @@ void sms_ntsc_blit( sms_ntsc_t const* ntsc, SMS_NTSC_IN_T const* table, unsigned
   SMS_NTSC_IN_T border = table[BACKDROP_COLOR];
   
   SMS_NTSC_BEGIN_ROW( ntsc, border,
-      (SMS_NTSC_ADJ_IN( table[input[0]] )) & extra2,
-      (SMS_NTSC_ADJ_IN( table[input[extra2 & 1]] )) & extra1 );
+      (SMS_NTSC_ADJ_IN( table[in_pixels[0] & PIXEL_MASK] )) & extra2,
+      (SMS_NTSC_ADJ_IN( table[in_pixels[extra2 & 1] & PIXEL_MASK] )) & extra1 );
 
   sms_ntsc_out_t* restrict line_out  = (sms_ntsc_out_t*)(&bitmap.data[(vline * bitmap.pitch)]);
   int n;
-  input += in_extra;
+  in_pixels += in_extra;
     
   for ( n = chunk_count; n; --n )
   {
     /* order of input and output pixels must not be altered */
-    SMS_NTSC_COLOR_IN( 0, ntsc, SMS_NTSC_ADJ_IN( table[*input++ & PIXEL_MASK] ) );
+    SMS_NTSC_COLOR_IN( 0, ntsc, SMS_NTSC_ADJ_IN( table[*in_pixels++ & PIXEL_MASK] ) );
     SMS_NTSC_RGB_OUT( 0, *line_out++, SMS_NTSC_OUT_DEPTH );
     SMS_NTSC_RGB_OUT( 1, *line_out++, SMS_NTSC_OUT_DEPTH );
 
-    SMS_NTSC_COLOR_IN( 1, ntsc, SMS_NTSC_ADJ_IN( table[*input++ & PIXEL_MASK] ) );
+    SMS_NTSC_COLOR_IN( 1, ntsc, SMS_NTSC_ADJ_IN( table[*in_pixels++ & PIXEL_MASK] ) );
     SMS_NTSC_RGB_OUT( 2, *line_out++, SMS_NTSC_OUT_DEPTH );
     SMS_NTSC_RGB_OUT( 3, *line_out++, SMS_NTSC_OUT_DEPTH );
       
-    SMS_NTSC_COLOR_IN( 2, ntsc, SMS_NTSC_ADJ_IN( table[*input++ & PIXEL_MASK] ) );
+    SMS_NTSC_COLOR_IN( 2, ntsc, SMS_NTSC_ADJ_IN( table[*in_pixels++ & PIXEL_MASK] ) );
     SMS_NTSC_RGB_OUT( 4, *line_out++, SMS_NTSC_OUT_DEPTH );
     SMS_NTSC_RGB_OUT( 5, *line_out++, SMS_NTSC_OUT_DEPTH );
     SMS_NTSC_RGB_OUT( 6, *line_out++, SMS_NTSC_OUT_DEPTH );
@@ -136,4 +145,205 @@ void sms_ntsc_blit( sms_ntsc_t const* ntsc, SMS_NTSC_IN_T const* table, unsigned
   SMS_NTSC_RGB_OUT( 5, *line_out++, SMS_NTSC_OUT_DEPTH );
   SMS_NTSC_RGB_OUT( 6, *line_out++, SMS_NTSC_OUT_DEPTH );
 }
+
+/* Kernels of a palette: terms 0-1 come from pixel 0 of current and previous chunks,
+terms 2-4 from pixel 1 of current and two previous chunks, terms 5-7 from pixel 2. Pixel
+1 (resp. 2) kernel only replaces the previous one from output pixel 2 (resp. 4). */
+void sms_ntsc_kernels( sms_ntsc_t const* ntsc, SMS_NTSC_IN_T const* table, sms_ntsc_kernels_t* out )
+{
+  int n, x;
+  for ( n = 0; n < sms_ntsc_kernel_colors; n++ )
+  {
+    unsigned const color = (n < sms_ntsc_kernel_colors - 1) ? table [n] : 0;
+    sms_ntsc_rgb_t const* k = SMS_NTSC_IN_FORMAT( ntsc, color );
+    unsigned int (*v) [8] = out->v [n];
+    
+    memset( v, 0, sizeof out->v [n] );
+    for ( x = 0; x < 7; x++ )
+    {
+      v [0] [x] = k [x];
+      v [1] [x] = k [(x+7)%14];
+      v [(x < 2) ? 3 : 2] [x] = k [(x+12)%7+14];
+      v [(x < 2) ? 4 : 3] [x] = k [(x+ 5)%7+21];
+      v [(x < 4) ? 6 : 5] [x] = k [(x+10)%7+28];
+      v [(x < 4) ? 7 : 6] [x] = k [(x+ 3)%7+35];
+    }
+  }
+}
+
+/* a: current chunk colors, b: previous chunk ones, c: the chunk before */
+#define SMS_NTSC_KERNEL_ROW( name, CHUNK ) \
+static void name( sms_ntsc_kernels_t const* kernels, unsigned char const* in, int in_width,\
+    int border, unsigned short* out )\
+{\
+  int const chunk_count = in_width / sms_ntsc_in_chunk;\
+  int const in_extra = in_width - chunk_count * sms_ntsc_in_chunk;\
+  int const black = sms_ntsc_kernel_colors - 1;\
+  unsigned short last [8];\
+  int a0, a1, a2, b0, b1, b2, c1, c2, n;\
+  \
+  /* same as SMS_NTSC_BEGIN_ROW: extra pixels are placed at beginning of row */\
+  b0 = border;\
+  b1 = (in_extra == 2) ? (in [0] & PIXEL_MASK) : black;\
+  b2 = in_extra ? (in [in_extra - 1] & PIXEL_MASK) : black;\
+  c1 = c2 = border;\
+  in += in_extra;\
+  \
+  for ( n = chunk_count; n; --n )\
+  {\
+    a0 = in [0] & PIXEL_MASK;\
+    a1 = in [1] & PIXEL_MASK;\
+    a2 = in [2] & PIXEL_MASK;\
+    CHUNK( out );\
+    c1 = b1; c2 = b2;\
+    b0 = a0; b1 = a1; b2 = a2;\
+    in  += sms_ntsc_in_chunk;\
+    out += sms_ntsc_out_chunk;\
+  }\
+  \
+  /* finish final pixels (no padding pixel written past row end) */\
+  a0 = a1 = a2 = border;\
+  CHUNK( last );\
+  memcpy( out, last, sms_ntsc_out_chunk * sizeof (unsigned short) );\
+}
+
+#define SMS_NTSC_KERNEL( a, t ) kernels->v [a] [t]
+
+#if !defined (__SSE2__) && !defined (__ARM_NEON) && !defined (__ARM_NEON__)
+#define SMS_NTSC_CHUNK_C( out ) {\
+  int x;\
+  for ( x = 0; x < sms_ntsc_out_chunk; x++ )\
+  {\
+    unsigned int raw_ =\
+      SMS_NTSC_KERNEL( a0, 0 ) [x] + SMS_NTSC_KERNEL( b0, 1 ) [x] +\
+      SMS_NTSC_KERNEL( a1, 2 ) [x] + SMS_NTSC_KERNEL( b1, 3 ) [x] + SMS_NTSC_KERNEL( c1, 4 ) [x] +\
+      SMS_NTSC_KERNEL( a2, 5 ) [x] + SMS_NTSC_KERNEL( b2, 6 ) [x] + SMS_NTSC_KERNEL( c2, 7 ) [x];\
+    SMS_NTSC_CLAMP_( raw_, 0 );\
+    SMS_NTSC_RGB_OUT_( (out) [x], 16, 0 );\
+  }\
+}
+
+SMS_NTSC_KERNEL_ROW( sms_ntsc_row_c, SMS_NTSC_CHUNK_C )
+#endif
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+
+static __inline__ __m128i sms_ntsc_pack_sse2( __m128i raw )
+{
+  __m128i sub = _mm_and_si128( _mm_srli_epi32( raw, 9 ), _mm_set1_epi32( sms_ntsc_clamp_mask ) );
+  __m128i clamp = _mm_sub_epi32( _mm_set1_epi32( sms_ntsc_clamp_add ), sub );
+  raw = _mm_or_si128( raw, clamp );
+  clamp = _mm_sub_epi32( clamp, sub );
+  raw = _mm_and_si128( raw, clamp );
+  raw = _mm_or_si128( _mm_or_si128(
+      _mm_and_si128( _mm_srli_epi32( raw, 13 ), _mm_set1_epi32( 0xF800 ) ),
+      _mm_and_si128( _mm_srli_epi32( raw,  8 ), _mm_set1_epi32( 0x07E0 ) ) ),
+      _mm_and_si128( _mm_srli_epi32( raw,  4 ), _mm_set1_epi32( 0x001F ) ) );
+  
+  /* sign extend for 16-bit packing */
+  return _mm_srai_epi32( _mm_slli_epi32( raw, 16 ), 16 );
+}
+
+#define SMS_NTSC_SUM_SSE2( h ) \
+  _mm_add_epi32( _mm_add_epi32(\
+    _mm_add_epi32( _mm_loadu_si128( (__m128i const*) &SMS_NTSC_KERNEL( a0, 0 ) [h] ),\
+                   _mm_loadu_si128( (__m128i const*) &SMS_NTSC_KERNEL( b0, 1 ) [h] ) ),\
+    _mm_add_epi32( _mm_loadu_si128( (__m128i const*) &SMS_NTSC_KERNEL( a1, 2 ) [h] ),\
+                   _mm_loadu_si128( (__m128i const*) &SMS_NTSC_KERNEL( b1, 3 ) [h] ) ) ), _mm_add_epi32(\
+    _mm_add_epi32( _mm_loadu_si128( (__m128i const*) &SMS_NTSC_KERNEL( c1, 4 ) [h] ),\
+                   _mm_loadu_si128( (__m128i const*) &SMS_NTSC_KERNEL( a2, 5 ) [h] ) ),\
+    _mm_add_epi32( _mm_loadu_si128( (__m128i const*) &SMS_NTSC_KERNEL( b2, 6 ) [h] ),\
+                   _mm_loadu_si128( (__m128i const*) &SMS_NTSC_KERNEL( c2, 7 ) [h] ) ) ) )
+
+#define SMS_NTSC_CHUNK_SSE2( out ) \
+  _mm_storeu_si128( (__m128i*) (out), _mm_packs_epi32(\
+      sms_ntsc_pack_sse2( SMS_NTSC_SUM_SSE2( 0 ) ), sms_ntsc_pack_sse2( SMS_NTSC_SUM_SSE2( 4 ) ) ) )
+
+SMS_NTSC_KERNEL_ROW( sms_ntsc_row_sse2, SMS_NTSC_CHUNK_SSE2 )
+
+#if defined (__GNUC__)
+#include <immintrin.h>
+#define SMS_NTSC_AVX2
+
+__attribute__((target("avx2")))
+static __inline__ __m128i sms_ntsc_pack_avx2( __m256i raw )
+{
+  __m256i sub = _mm256_and_si256( _mm256_srli_epi32( raw, 9 ), _mm256_set1_epi32( sms_ntsc_clamp_mask ) );
+  __m256i clamp = _mm256_sub_epi32( _mm256_set1_epi32( sms_ntsc_clamp_add ), sub );
+  raw = _mm256_or_si256( raw, clamp );
+  clamp = _mm256_sub_epi32( clamp, sub );
+  raw = _mm256_and_si256( raw, clamp );
+  raw = _mm256_or_si256( _mm256_or_si256(
+      _mm256_and_si256( _mm256_srli_epi32( raw, 13 ), _mm256_set1_epi32( 0xF800 ) ),
+      _mm256_and_si256( _mm256_srli_epi32( raw,  8 ), _mm256_set1_epi32( 0x07E0 ) ) ),
+      _mm256_and_si256( _mm256_srli_epi32( raw,  4 ), _mm256_set1_epi32( 0x001F ) ) );
+  return _mm_packus_epi32( _mm256_castsi256_si128( raw ), _mm256_extracti128_si256( raw, 1 ) );
+}
+
+#define SMS_NTSC_LOAD_AVX2( a, t ) _mm256_loadu_si256( (__m256i const*) SMS_NTSC_KERNEL( a, t ) )
+
+#define SMS_NTSC_CHUNK_AVX2( out ) \
+  _mm_storeu_si128( (__m128i*) (out), sms_ntsc_pack_avx2(\
+    _mm256_add_epi32( _mm256_add_epi32(\
+      _mm256_add_epi32( SMS_NTSC_LOAD_AVX2( a0, 0 ), SMS_NTSC_LOAD_AVX2( b0, 1 ) ),\
+      _mm256_add_epi32( SMS_NTSC_LOAD_AVX2( a1, 2 ), SMS_NTSC_LOAD_AVX2( b1, 3 ) ) ), _mm256_add_epi32(\
+      _mm256_add_epi32( SMS_NTSC_LOAD_AVX2( c1, 4 ), SMS_NTSC_LOAD_AVX2( a2, 5 ) ),\
+      _mm256_add_epi32( SMS_NTSC_LOAD_AVX2( b2, 6 ), SMS_NTSC_LOAD_AVX2( c2, 7 ) ) ) ) ) )
+
+__attribute__((target("avx2")))
+SMS_NTSC_KERNEL_ROW( sms_ntsc_row_avx2, SMS_NTSC_CHUNK_AVX2 )
+#endif
+
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+
+static __inline__ uint16x4_t sms_ntsc_pack_neon( uint32x4_t raw )
+{
+  uint32x4_t sub = vandq_u32( vshrq_n_u32( raw, 9 ), vdupq_n_u32( sms_ntsc_clamp_mask ) );
+  uint32x4_t clamp = vsubq_u32( vdupq_n_u32( sms_ntsc_clamp_add ), sub );
+  raw = vorrq_u32( raw, clamp );
+  clamp = vsubq_u32( clamp, sub );
+  raw = vandq_u32( raw, clamp );
+  raw = vorrq_u32( vorrq_u32(
+      vandq_u32( vshrq_n_u32( raw, 13 ), vdupq_n_u32( 0xF800 ) ),
+      vandq_u32( vshrq_n_u32( raw,  8 ), vdupq_n_u32( 0x07E0 ) ) ),
+      vandq_u32( vshrq_n_u32( raw,  4 ), vdupq_n_u32( 0x001F ) ) );
+  return vmovn_u32( raw );
+}
+
+#define SMS_NTSC_SUM_NEON( h ) \
+  vaddq_u32( vaddq_u32(\
+    vaddq_u32( vld1q_u32( &SMS_NTSC_KERNEL( a0, 0 ) [h] ), vld1q_u32( &SMS_NTSC_KERNEL( b0, 1 ) [h] ) ),\
+    vaddq_u32( vld1q_u32( &SMS_NTSC_KERNEL( a1, 2 ) [h] ), vld1q_u32( &SMS_NTSC_KERNEL( b1, 3 ) [h] ) ) ), vaddq_u32(\
+    vaddq_u32( vld1q_u32( &SMS_NTSC_KERNEL( c1, 4 ) [h] ), vld1q_u32( &SMS_NTSC_KERNEL( a2, 5 ) [h] ) ),\
+    vaddq_u32( vld1q_u32( &SMS_NTSC_KERNEL( b2, 6 ) [h] ), vld1q_u32( &SMS_NTSC_KERNEL( c2, 7 ) [h] ) ) ) )
+
+#define SMS_NTSC_CHUNK_NEON( out ) \
+  vst1q_u16( (out), vcombine_u16( sms_ntsc_pack_neon( SMS_NTSC_SUM_NEON( 0 ) ), sms_ntsc_pack_neon( SMS_NTSC_SUM_NEON( 4 ) ) ) )
+
+SMS_NTSC_KERNEL_ROW( sms_ntsc_row_neon, SMS_NTSC_CHUNK_NEON )
+#endif
+
+#if defined (__SSE2__)
+static void (*sms_ntsc_row)( sms_ntsc_kernels_t const*, unsigned char const*, int, int, unsigned short* ) = sms_ntsc_row_sse2;
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+static void (*sms_ntsc_row)( sms_ntsc_kernels_t const*, unsigned char const*, int, int, unsigned short* ) = sms_ntsc_row_neon;
+#else
+static void (*sms_ntsc_row)( sms_ntsc_kernels_t const*, unsigned char const*, int, int, unsigned short* ) = sms_ntsc_row_c;
+#endif
+
+static void sms_ntsc_pick_row( void )
+{
+#ifdef SMS_NTSC_AVX2
+  if ( __builtin_cpu_supports( "avx2" ) )
+    sms_ntsc_row = sms_ntsc_row_avx2;
+#endif
+}
+
+void sms_ntsc_blit_kernels( sms_ntsc_kernels_t const* kernels, unsigned char const* in_pixels,
+    int in_width, int border, unsigned short* out )
+{
+  sms_ntsc_row( kernels, in_pixels, in_width, border, out );
+}
 #endif
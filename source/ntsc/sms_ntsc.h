@@ -49,9 +49,18 @@ void sms_ntsc_init( sms_ntsc_t* ntsc, sms_ntsc_setup_t const* setup );
 and output RGB depth is set by SMS_NTSC_OUT_DEPTH. Both default to 16-bit RGB.
 In_row_width is the number of pixels to get to the next input row. Out_pitch
 is the number of *bytes* to get to the next output row. */
-void sms_ntsc_blit( sms_ntsc_t const* ntsc, SMS_NTSC_IN_T const* table, unsigned char* input,
+void sms_ntsc_blit( sms_ntsc_t const* ntsc, SMS_NTSC_IN_T const* table, unsigned char* in_pixels,
     int in_width, int vline);
 
+/* Same filter using kernels of the 32 colors of a pixel table, prepared once with
+sms_ntsc_kernels(). Border is the palette index of the backdrop color. Output is
+written to out (16-bit RGB) and is identical to sms_ntsc_blit() one. Uses SSE2, AVX2
+or NEON instructions where available. */
+typedef struct sms_ntsc_kernels_t sms_ntsc_kernels_t;
+void sms_ntsc_kernels( sms_ntsc_t const* ntsc, SMS_NTSC_IN_T const* table, sms_ntsc_kernels_t* out );
+void sms_ntsc_blit_kernels( sms_ntsc_kernels_t const* kernels, unsigned char const* in_pixels,
+    int in_width, int border, unsigned short* out );
+
 /* Number of output pixels written by blitter for given input width. */
 #define SMS_NTSC_OUT_WIDTH( in_width ) \
   (((in_width) / sms_ntsc_in_chunk + 1) * sms_ntsc_out_chunk)
@@ -95,6 +104,13 @@ struct sms_ntsc_t {
   sms_ntsc_rgb_t table [sms_ntsc_palette_size] [sms_ntsc_entry_size];
 };
 
+/* Each color contributes to 8 terms of an output chunk, laid out as 8 lanes (7 output
+pixels + padding) so that a chunk is the sum of 8 vectors. Color 32 is black. */
+enum { sms_ntsc_kernel_colors = 33 };
+struct sms_ntsc_kernels_t {
+  unsigned int v [sms_ntsc_kernel_colors] [8] [8];
+};
+
 #define SMS_NTSC_BGR12( ntsc, n ) (ntsc)->table [n & 0xFFF]
 
 #define SMS_NTSC_RGB16( ntsc, n ) \
@@ -0,0 +1,177 @@
+/******************************************************************************
+ *  Sega Master System / GameGear Emulator
+ *  Copyright (C) 1998-2007  Charles MacDonald
+ *
+ *  additionnal code by Eke-Eke (SMS Plus GX)
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *   Pipelined frame output
+ *
+ *   The emulation thread renders into one buffer while completed frames
+ *   wait in the others for the presentation thread. Each counter is only
+ *   written by one side, so the handoff needs no lock: a frame is filled
+ *   before 'head' is released, and a buffer is only reused once 'tail'
+ *   shows it was released.
+ *
+ ******************************************************************************/
+
+#include "shared.h"
+
+#if defined(__GNUC__)
+#define LOAD_ACQUIRE(p)       __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v)   __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#else
+/* volatile accesses have acquire / release semantics with MSVC */
+#define LOAD_ACQUIRE(p)       (*(volatile unsigned int *)(p))
+#define STORE_RELEASE(p, v)   (*(volatile unsigned int *)(p) = (v))
+#endif
+
+/* Enable pipelined output with 2 (double) or 3 (triple) buffers.  */
+/* Bitmap and sound settings must be set up before (system_init). */
+int output_init(int buffers)
+{
+  output_t *o = &machine->output;
+  int i;
+
+  output_shutdown();
+
+  if ((buffers < 2) || (buffers > OUTPUT_MAX))
+    return 0;
+
+  o->count = buffers;
+  o->bitmap_data = bitmap.data;
+  o->head = o->tail = 0;
+  o->write = o->read = 0;
+
+  for(i = 0; i < buffers; i++)
+  {
+    output_frame_t *f = &o->frame[i];
+
+    f->data = calloc(bitmap.height, bitmap.pitch);
+    if (!f->data) break;
+
+    if (snd.enabled)
+    {
+      f->audio[0] = calloc(1, snd.buffer_size);
+      f->audio[1] = calloc(1, snd.buffer_size);
+      if (!f->audio[0] || !f->audio[1]) break;
+    }
+  }
+
+  if (i < buffers)
+  {
+    output_shutdown();
+    return 0;
+  }
+
+  return 1;
+}
+
+/* Disable pipelined output: bitmap.data points again to the frontend buffer */
+void output_shutdown(void)
+{
+  output_t *o = &machine->output;
+  int i;
+
+  if (!o->count)
+    return;
+
+  bitmap.data = o->bitmap_data;
+
+  for(i = 0; i < OUTPUT_MAX; i++)
+  {
+    free(o->frame[i].data);
+    free(o->frame[i].audio[0]);
+    free(o->frame[i].audio[1]);
+  }
+
+  memset(o, 0, sizeof(output_t));
+}
+
+/* Emulation thread, before system_frame(): select the buffer to render into. */
+/* Returns 0 while all buffers are still waiting for presentation.            */
+int output_begin(void)
+{
+  output_t *o = &machine->output;
+
+  if (!o->count)
+    return 1;
+
+  if ((o->head - LOAD_ACQUIRE(&o->tail)) >= (unsigned int)o->count)
+    return 0;
+
+  bitmap.data = o->frame[o->write].data;
+  return 1;
+}
+
+/* Emulation thread, after system_frame(): publish the completed frame */
+void output_end(void)
+{
+  output_t *o = &machine->output;
+  output_frame_t *f;
+
+  if (!o->count)
+    return;
+
+  f = &o->frame[o->write];
+
+  f->skip = machine->render.skip ? SKIP_VIDEO : 0;
+  f->viewport.x = bitmap.viewport.x;
+  f->viewport.y = bitmap.viewport.y;
+  f->viewport.w = bitmap.viewport.w;
+  f->viewport.h = bitmap.viewport.h;
+  memcpy(f->pal, bitmap.pal.color, sizeof(f->pal));
+
+  if (snd.enabled && !snd.skip)
+  {
+    memcpy(f->audio[0], snd.output[0], snd.sample_count * 2);
+    memcpy(f->audio[1], snd.output[1], snd.sample_count * 2);
+    f->sample_count = snd.sample_count;
+  }
+  else
+  {
+    f->skip |= SKIP_AUDIO;
+    f->sample_count = 0;
+  }
+
+  if (++o->write == o->count)
+    o->write = 0;
+
+  STORE_RELEASE(&o->head, o->head + 1);
+}
+
+/* Presentation thread: oldest completed frame, NULL if none is waiting. */
+/* Skipped pictures (SKIP_VIDEO) hold stale data and should be ignored.  */
+output_frame_t *output_acquire(void)
+{
+  output_t *o = &machine->output;
+
+  if (!o->count || (LOAD_ACQUIRE(&o->head) == o->tail))
+    return NULL;
+
+  return &o->frame[o->read];
+}
+
+/* Presentation thread: done with the frame returned by output_acquire() */
+void output_release(void)
+{
+  output_t *o = &machine->output;
+
+  if (++o->read == o->count)
+    o->read = 0;
+
+  STORE_RELEASE(&o->tail, o->tail + 1);
+}
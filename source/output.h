@@ -0,0 +1,64 @@
+/******************************************************************************
+ *  Sega Master System / GameGear Emulator
+ *  Copyright (C) 1998-2007  Charles MacDonald
+ *
+ *  additionnal code by Eke-Eke (SMS Plus GX)
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *   Pipelined frame output (emulation / presentation overlap)
+ *
+ ******************************************************************************/
+
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+/* Maximal number of output buffers (triple buffering) */
+#define OUTPUT_MAX 3
+
+/* Completed frame */
+typedef struct
+{
+  uint8 *data;                    /* Bitmap buffer (same layout as bitmap.data) */
+  int skip;                       /* SKIP_VIDEO / SKIP_AUDIO: no new picture / sound */
+  struct {
+    int x, y, w, h;
+  } viewport;                     /* Display area of the picture */
+  uint8 pal[0x20][3];             /* Palette colors (8-bit bitmaps) */
+  int16 *audio[2];                /* Left and right channels */
+  int sample_count;               /* Length of audio in samples */
+} output_frame_t;
+
+/* Single producer (emulation) / single consumer (presentation) frame queue */
+typedef struct
+{
+  int count;                      /* 0= disabled, else number of buffers */
+  output_frame_t frame[OUTPUT_MAX];
+  uint8 *bitmap_data;             /* Frontend bitmap buffer (restored on shutdown) */
+  unsigned int head;              /* # of frames published (emulation thread) */
+  unsigned int tail;              /* # of frames released (presentation thread) */
+  int write;                      /* Buffer being emulated into */
+  int read;                       /* Oldest published buffer */
+} output_t;
+
+/* Function prototypes */
+extern int output_init(int buffers);
+extern void output_shutdown(void);
+extern int output_begin(void);
+extern void output_end(void);
+extern output_frame_t *output_acquire(void);
+extern void output_release(void);
+
+#endif /* _OUTPUT_H_ */
@@ -23,17 +23,16 @@
  ******************************************************************************/
 
 #include "shared.h"
+#include "context.h"
 #include <math.h>
 
-typedef struct {
-  uint8 tr_level[2];  /* TR pin output level */
-  uint8 th_level[2];  /* TH pin output level */
-  uint8 tr_dir[2];    /* TR pin direction */
-  uint8 th_dir[2];    /* TH pin direction */
-} io_state;
-
 static io_state io_lut[2][256];
-static io_state *io_current;
+static worker_once_t io_lut_once = WORKER_ONCE_INIT;
+
+/* I/O context (current machine) */
+#define io_current      (machine->pio.io_current)
+#define paddle_toggle   (machine->pio.paddle_toggle)
+#define lightgun_latch  (machine->pio.lightgun_latch)
 
 
 /*
@@ -61,11 +60,11 @@ static io_state *io_current;
   It also means that for compatibility, it defaults to an input-only state (ie. with all the low bits set) on startup.
 */
 
-void pio_init(void)
+/* Make pin state LUT */
+static void make_io_lut(void)
 {
   int i, j;
 
-  /* Make pin state LUT */
   for(j = 0; j < 2; j++)
   {
     for(i = 0; i < 0x100; i++)
@@ -96,6 +95,12 @@ void pio_init(void)
   }
 }
 
+void pio_init(void)
+{
+  /* Pin state LUT is shared by all machine contexts */
+  worker_once(&io_lut_once, make_io_lut);
+}
+
 void pio_reset(void)
 {
   /* GG SIO power-on defaults */
@@ -156,8 +161,6 @@ void pio_ctrl_w(uint8 data)
   0   Up pin input
 */
 
-static uint8 paddle_toggle[2] = {0,0};
-static uint8 lightgun_latch =0;
 
 static uint8 device_r(int port)
 {
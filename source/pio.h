@@ -57,6 +57,20 @@ enum {
   DEVICE_SPORTSPAD  = 4,  /* Sports Pad controller; analog stick with 2 buttons */
 };
 
+typedef struct {
+  uint8 tr_level[2];  /* TR pin output level */
+  uint8 th_level[2];  /* TH pin output level */
+  uint8 tr_dir[2];    /* TR pin direction */
+  uint8 th_dir[2];    /* TH pin direction */
+} io_state;
+
+/* I/O context */
+typedef struct {
+  io_state *io_current;
+  uint8 paddle_toggle[2];
+  uint8 lightgun_latch;
+} pio_t;
+
 /* Function prototypes */
 extern void pio_init(void);
 extern void pio_reset(void);
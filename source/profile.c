@@ -0,0 +1,70 @@
+/******************************************************************************
+ *  Sega Master System / GameGear Emulator
+ *  Copyright (C) 1998-2007  Charles MacDonald
+ *
+ *  additionnal code by Eke-Eke (SMS Plus GX)
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *   Per-subsystem timing
+ *
+ ******************************************************************************/
+
+#include "shared.h"
+
+#ifdef PROFILE
+#include <time.h>
+
+static unsigned long long profile_time(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+void profile_reset(void)
+{
+  memset(&machine->profile, 0, sizeof(profile_t));
+}
+
+void profile_begin(int id)
+{
+#ifdef PROFILE
+  profile_t *p = &machine->profile;
+  unsigned long long now = profile_time();
+
+  /* charge elapsed time to the enclosing section */
+  if (p->depth)
+    p->time[p->stack[p->depth - 1]] += now - p->last;
+
+  if (p->depth < PROF_DEPTH)
+    p->stack[p->depth++] = id;
+  p->calls[id]++;
+  p->last = now;
+#endif
+}
+
+void profile_end(void)
+{
+#ifdef PROFILE
+  profile_t *p = &machine->profile;
+  unsigned long long now = profile_time();
+
+  if (p->depth)
+    p->time[p->stack[--p->depth]] += now - p->last;
+  p->last = now;
+#endif
+}
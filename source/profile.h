@@ -0,0 +1,68 @@
+/******************************************************************************
+ *  Sega Master System / GameGear Emulator
+ *  Copyright (C) 1998-2007  Charles MacDonald
+ *
+ *  additionnal code by Eke-Eke (SMS Plus GX)
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *   Per-subsystem timing (only compiled in with PROFILE defined)
+ *
+ ******************************************************************************/
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+/* Profiled sections */
+enum
+{
+  PROF_FRAME = 0,   /* system_frame (not counted elsewhere) */
+  PROF_Z80,         /* z80_execute */
+  PROF_RENDER,      /* render_line (not counted elsewhere) */
+  PROF_BG_CACHE,    /* update_bg_pattern_cache */
+  PROF_BLIT,        /* remap_line / sms_ntsc_blit */
+  PROF_SOUND,       /* sound_end (not counted elsewhere) */
+  PROF_PSG,         /* SN76489_Update */
+  PROF_FM,          /* FM_Update */
+  PROF_MIXER,       /* mixer callback */
+  PROF_MAX
+};
+
+#define PROF_DEPTH 8
+
+/* Section time is exclusive: nested sections are only charged once */
+typedef struct
+{
+  unsigned long long time[PROF_MAX];  /* accumulated time (ns) */
+  unsigned int calls[PROF_MAX];
+  unsigned long long last;            /* last timestamp (ns) */
+  int stack[PROF_DEPTH];
+  int depth;
+} profile_t;
+
+#ifdef PROFILE
+#define PROFILE_BEGIN(id) profile_begin(id)
+#define PROFILE_END()     profile_end()
+#else
+#define PROFILE_BEGIN(id)
+#define PROFILE_END()
+#endif
+
+/* Function prototypes */
+extern void profile_reset(void);
+extern void profile_begin(int id);
+extern void profile_end(void);
+
+#endif /* _PROFILE_H_ */
@@ -23,49 +23,64 @@
  ******************************************************************************/
 
 #include "shared.h"
+#include "context.h"
 #include "sms_ntsc.h"
 
+/* use SSE2 or NEON vector instructions where available */
+#ifndef RENDER_SIMD
+#define RENDER_SIMD 1
+#endif
+
+#if RENDER_SIMD && defined(__SSE2__)
+#include <emmintrin.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+#define RENDER_SSE2
+#elif RENDER_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define RENDER_NEON
+#endif
+
 /*** NTSC Filters ***/
 extern sms_ntsc_t sms_ntsc;
 
 /*** Vertical Counter Tables ***/
 extern uint8 *vc_table[2][3];
 
-struct
-{
-  uint16 yrange;
-  uint16 xpos;
-  uint16 attr;
-} object_info[64];
-
-/* Background drawing function */
-void (*render_bg)(int line) = NULL;
-void (*render_obj)(int line) = NULL;
-
-/* Pointer to output buffer */
-uint8 *linebuf;
+/* Rendering context (current machine) */
+#define internal_buffer     (machine->render.internal_buffer)
+#define pixel               (machine->render.pixel)
+#define pixel_15            (machine->render.pixel_15)
+#define pixel_32            (machine->render.pixel_32)
+#define bg_pattern_cache    (machine->render.bg_pattern_cache)
+#define object_info         (machine->render.object_info)
+#define object_index_count  (machine->render.object_index_count)
+#define prev_line           (machine->render.prev_line)
+#define next_line           (machine->render.next_line)
+#define frame_skip          (machine->render.skip)
+#define bg_line_cache       (machine->render.bg_line_cache)
+#define bg_line_key         (machine->render.bg_line_key)
+#define bg_name_lines       (machine->render.bg_name_lines)
+#define ntsc_line           (machine->render.ntsc_line)
+#define ntsc_count          (machine->render.ntsc_count)
+#define ntsc_kept           (machine->render.ntsc_kept)
+#define ntsc_threads        (machine->render.ntsc_threads)
 
 /* Pixel 8-bit color tables */
-uint8 sms_cram_expand_table[4];
-uint8 gg_cram_expand_table[16];
-
-/* Dirty pattern info */
-uint8 bg_name_dirty[0x200];     /* 1= This pattern is dirty */
-uint16 bg_name_list[0x200];     /* List of modified pattern indices */
-uint16 bg_list_index;           /* # of modified patterns in list */
-
-/* Internal buffer for drawing non 8-bit displays */
-static uint8 internal_buffer[0x200];
-
-/* Precalculated pixel table */
-static uint16 pixel[PALETTE_SIZE];
-
-static uint8 bg_pattern_cache[0x20000];/* Cached and flipped patterns */
+uint8 sms_cram_expand_table[4] =
+{
+  0, (5 << 3) + (1 << 2), (15 << 3) + (1 << 2), (27 << 3) + (1 << 2)
+};
 
-/* Pixel look-up table */
-static uint8 lut[0x10000];
+uint8 gg_cram_expand_table[16] =
+{
+  0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+  0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+};
 
-static uint8 object_index_count;
+/* Look-up tables are shared by all machine contexts */
+static worker_once_t tables_once = WORKER_ONCE_INIT;
 
 /* Top Border area height */
 static uint8 active_border[2][3] =
@@ -148,6 +163,55 @@ static uint8 tms_palette[16*3][3] =
   {255,255,255}
 };
 
+#if defined(RENDER_SSE2) || defined(RENDER_NEON)
+/* Attribute expansion of two adjacent columns */
+static const uint8 atex2[16][16] =
+{
+#define ATEX2(a,b) {a,a,a,a,a,a,a,a,b,b,b,b,b,b,b,b}
+  ATEX2(0x00,0x00), ATEX2(0x00,0x10), ATEX2(0x00,0x20), ATEX2(0x00,0x30),
+  ATEX2(0x10,0x00), ATEX2(0x10,0x10), ATEX2(0x10,0x20), ATEX2(0x10,0x30),
+  ATEX2(0x20,0x00), ATEX2(0x20,0x10), ATEX2(0x20,0x20), ATEX2(0x20,0x30),
+  ATEX2(0x30,0x00), ATEX2(0x30,0x10), ATEX2(0x30,0x20), ATEX2(0x30,0x30)
+#undef ATEX2
+};
+
+#if RENDER_COMPACT_CACHE
+/* Horizontal flip of two adjacent columns (byte shuffle or flipped lanes mask) */
+static const uint8 hflip2[4][16] =
+{
+#if defined(RENDER_SSE2) && defined(__SSSE3__)
+  {0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15},
+  {0,1,2,3,4,5,6,7,15,14,13,12,11,10,9,8},
+  {7,6,5,4,3,2,1,0,8,9,10,11,12,13,14,15},
+  {7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8}
+#else
+  {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00},
+  {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF},
+  {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00},
+  {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}
+#endif
+};
+
+#ifdef RENDER_SSE2
+static __inline__ __m128i bg_hflip(__m128i p, int flip)
+{
+#ifdef __SSSE3__
+  return _mm_shuffle_epi8(p, _mm_loadu_si128((__m128i *)hflip2[flip]));
+#else
+  __m128i m = _mm_loadu_si128((__m128i *)hflip2[flip]);
+  __m128i r = _mm_or_si128(_mm_slli_epi16(p, 8), _mm_srli_epi16(p, 8));
+  r = _mm_shufflehi_epi16(_mm_shufflelo_epi16(r, 0x1B), 0x1B);
+  return _mm_or_si128(_mm_and_si128(m, r), _mm_andnot_si128(m, p));
+#endif
+}
+#else
+static __inline__ uint8x16_t bg_hflip(uint8x16_t p, int flip)
+{
+  return vbslq_u8(vld1q_u8(hflip2[flip]), vrev64q_u8(p), p);
+}
+#endif
+#endif
+#else
 /* Attribute expansion table */
 static const uint32 atex[4] =
 {
@@ -156,13 +220,87 @@ static const uint32 atex[4] =
   0x20202020,
   0x30303030,
 };
+#endif
+
+/* Line of pattern data in cache, and horizontal flip to be done at draw time */
+#if RENDER_COMPACT_CACHE
+#define BG_PATTERN_LINE(attr, row)  ((((attr) & 0x1FF) << 6) | (((attr) & 0x400) ? ((row) ^ 0x38) : (row)))
+#define BG_PATTERN_HFLIP(attr)      (((attr) >> 9) & 1)
+#else
+#define BG_PATTERN_LINE(attr, row)  ((((attr) & 0x7FF) << 6) | (row))
+#define BG_PATTERN_HFLIP(attr)      0
+#endif
+
+/* Background line cache: line data is valid */
+#define BG_LINE_CACHED  0x80000000
+
+/* Sprite pixel (non-zero) over line buffer pixel: sprite marker, priority & transparency */
+static __inline__ uint8 obj_pixel(uint8 bg, uint8 sp)
+{
+  /* Overwriting a sprite pixel, or underlying pixel is high priority and opaque */
+  if ((bg & 0x40) || ((bg & 0x20) && (bg & 0x0F)))
+    return (bg & 0x7F) | 0x40;
+
+  /* Sprite pixel, w/ palette and marker bits added */
+  return sp | 0x10 | 0x40;
+}
+
+#if defined(RENDER_SSE2) || defined(RENDER_NEON)
+/* First lane set in a collision mask (bits per lane) */
+static __inline__ int obj_lane(unsigned long long mask, int bits)
+{
+  int lane = 0;
+  while (!(mask & 1))
+  {
+    mask >>= bits;
+    lane++;
+  }
+  return lane;
+}
+#endif
+
+#ifdef RENDER_SSE2
+/* Sprite pixels (s) over line buffer pixels (o), with priority checked against b pixels */
+/* (see obj_pixel). Returns the first lane where sprites collide, or -1                  */
+static __inline__ int obj_blend(__m128i s, __m128i b, __m128i *o)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i clear = _mm_cmpeq_epi8(s, zero);
+  __m128i marker = _mm_cmpeq_epi8(_mm_and_si128(b, _mm_set1_epi8(0x40)), _mm_set1_epi8(0x40));
+  __m128i prio = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_and_si128(b, _mm_set1_epi8(0x0F)), zero),
+                                  _mm_cmpeq_epi8(_mm_and_si128(b, _mm_set1_epi8(0x20)), _mm_set1_epi8(0x20)));
+  __m128i keep = _mm_or_si128(marker, prio);
+  __m128i c = _mm_or_si128(_mm_and_si128(keep, b), _mm_andnot_si128(keep, _mm_or_si128(s, _mm_set1_epi8(0x10))));
+  int mask = _mm_movemask_epi8(_mm_andnot_si128(clear, marker));
+
+  c = _mm_and_si128(_mm_or_si128(c, _mm_set1_epi8(0x40)), _mm_set1_epi8(0x7F));
+  *o = _mm_or_si128(_mm_andnot_si128(clear, c), _mm_and_si128(clear, *o));
+
+  return mask ? obj_lane(mask, 1) : -1;
+}
+#endif
 
-/* Bitplane to packed pixel LUT */
-static uint32 bp_lut[0x10000];
+#ifdef RENDER_NEON
+/* Sprite pixels (s) over line buffer pixels (o), with priority checked against b pixels */
+/* (see obj_pixel). Returns the first lane where sprites collide, or -1                  */
+static __inline__ int obj_blend(uint8x16_t s, uint8x16_t b, uint8x16_t *o)
+{
+  uint8x16_t opaque = vtstq_u8(s, s);
+  uint8x16_t marker = vtstq_u8(b, vdupq_n_u8(0x40));
+  uint8x16_t prio = vandq_u8(vtstq_u8(b, vdupq_n_u8(0x20)), vtstq_u8(b, vdupq_n_u8(0x0F)));
+  uint8x16_t c = vbslq_u8(vorrq_u8(marker, prio), vandq_u8(b, vdupq_n_u8(0x7F)), vorrq_u8(s, vdupq_n_u8(0x10)));
+  uint8x8_t m = vshrn_n_u16(vreinterpretq_u16_u8(vandq_u8(opaque, marker)), 4);
+  unsigned long long mask = vget_lane_u64(vreinterpret_u64_u8(m), 0);
+
+  *o = vbslq_u8(opaque, vorrq_u8(c, vdupq_n_u8(0x40)), *o);
+
+  return mask ? obj_lane(mask, 4) : -1;
+}
+#endif
 
 static void parse_satb(int line);
 static void update_bg_pattern_cache(void);
-static void remap_8_to_16(int line);
+static void remap_line(int line);
 
 /* Macros to access memory 32-bits at a time (from MAME's drawgfx.c) */
 
@@ -214,117 +352,301 @@ static __inline__ void write_dword(void *address, uint32 data)
 #define write_dword(address,data) *(uint32 *)address=data
 #endif
 
+/****************************************************************************/
+/* Bitplanes to packed pixels conversion of a pattern line:                 */
+/* bit 7-x of bitplane n is bit n of pixel x                                */
+/****************************************************************************/
+
+/* Spread the bits of a bitplane to bytes, most significant bit first */
+#define BP_SPREAD(b) \
+  (((((b) * 0x0101010101010101ULL) & 0x0102040810204080ULL) + 0x7F7F7F7F7F7F7F7FULL) >> 7 & 0x0101010101010101ULL)
+
+#if !defined(RENDER_SSE2) && !defined(RENDER_NEON)
+static void bp_decode_c(uint8 *dst, const uint8 *src)
+{
+  unsigned long long out = BP_SPREAD(src[0]) | (BP_SPREAD(src[1]) << 1) |
+                           (BP_SPREAD(src[2]) << 2) | (BP_SPREAD(src[3]) << 3);
+  int x;
+
+  for(x = 0; x < 8; x++)
+    dst[x] = out >> (x << 3);
+}
+#endif
+
+#ifdef RENDER_SSE2
+static void bp_decode_sse2(uint8 *dst, const uint8 *src)
+{
+  const __m128i bits = _mm_set_epi8(1,2,4,8,16,32,64,-128,1,2,4,8,16,32,64,-128);
+  __m128i v = _mm_cvtsi32_si128(src[0] | (src[1] << 8) | (src[2] << 16) | (src[3] << 24));
+  __m128i lo, hi;
+
+  /* Broadcast each bitplane to 8 bytes */
+  v = _mm_unpacklo_epi8(v, v);
+  v = _mm_unpacklo_epi16(v, v);
+  lo = _mm_unpacklo_epi32(v, v);
+  hi = _mm_unpackhi_epi32(v, v);
+
+  /* Bitplanes 0 & 1 (low vector), 2 & 3 (high vector) to pixel bits */
+  lo = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(lo, bits), bits), _mm_set_epi32(0x02020202,0x02020202,0x01010101,0x01010101));
+  hi = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(hi, bits), bits), _mm_set_epi32(0x08080808,0x08080808,0x04040404,0x04040404));
+  v = _mm_or_si128(lo, hi);
+  _mm_storel_epi64((__m128i *)dst, _mm_or_si128(v, _mm_srli_si128(v, 8)));
+}
+#endif
 
+#ifdef RENDER_NEON
+static void bp_decode_neon(uint8 *dst, const uint8 *src)
+{
+  static const uint8 bits[8] = {0x80,0x40,0x20,0x10,0x08,0x04,0x02,0x01};
+  uint8x8_t m = vld1_u8(bits);
+  uint8x8_t p = vand_u8(vtst_u8(vdup_n_u8(src[0]), m), vdup_n_u8(1));
+  p = vorr_u8(p, vand_u8(vtst_u8(vdup_n_u8(src[1]), m), vdup_n_u8(2)));
+  p = vorr_u8(p, vand_u8(vtst_u8(vdup_n_u8(src[2]), m), vdup_n_u8(4)));
+  p = vorr_u8(p, vand_u8(vtst_u8(vdup_n_u8(src[3]), m), vdup_n_u8(8)));
+  vst1_u8(dst, p);
+}
+#endif
+
+/* BMI2 bit deposit (picked at runtime) */
+#if RENDER_SIMD && defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define RENDER_BMI2
+
+__attribute__((target("bmi2")))
+static void bp_decode_bmi2(uint8 *dst, const uint8 *src)
+{
+  unsigned long long out = _pdep_u64(src[0], 0x0101010101010101ULL) |
+                           _pdep_u64(src[1], 0x0202020202020202ULL) |
+                           _pdep_u64(src[2], 0x0404040404040404ULL) |
+                           _pdep_u64(src[3], 0x0808080808080808ULL);
+
+  /* bit 0 was deposited to byte 0: reverse pixel order */
+  out = __builtin_bswap64(out);
+  memcpy(dst, &out, 8);
+}
+#endif
+
+#if defined(RENDER_SSE2)
+static void (*bp_decode)(uint8 *dst, const uint8 *src) = bp_decode_sse2;
+#elif defined(RENDER_NEON)
+static void (*bp_decode)(uint8 *dst, const uint8 *src) = bp_decode_neon;
+#else
+static void (*bp_decode)(uint8 *dst, const uint8 *src) = bp_decode_c;
+#endif
+
+/****************************************************************************/
+/* Line buffer to output bitmap pixel format conversion                     */
 /****************************************************************************/
 
+/* Palette indexes: unused pixel data is masked out */
+static void remap_8(uint8 *dst, const uint8 *src, int width)
+{
+  int i = 0;
 
-void render_shutdown(void)
+#if defined(RENDER_SSE2)
+  for(; i + 16 <= width; i += 16)
+    _mm_storeu_si128((__m128i *)&dst[i], _mm_and_si128(_mm_loadu_si128((const __m128i *)&src[i]), _mm_set1_epi8(PIXEL_MASK)));
+#elif defined(RENDER_NEON)
+  for(; i + 16 <= width; i += 16)
+    vst1q_u8(&dst[i], vandq_u8(vld1q_u8(&src[i]), vdupq_n_u8(PIXEL_MASK)));
+#endif
+
+  for(; i < width; i++)
+    dst[i] = src[i] & PIXEL_MASK;
+}
+
+static void remap_16_c(uint16 *dst, const uint8 *src, const uint16 *table, int width)
 {
+  int i;
+
+  for(i = 0; i < width; i++)
+    dst[i] = table[src[i] & PIXEL_MASK];
 }
 
-/* Initialize the rendering data */
-void render_init(void)
+static void remap_32_c(uint32 *dst, const uint8 *src, const uint32 *table, int width)
 {
-  int i, j;
-  int bx, sx, b, s, bp, bf, sf, c;
+  int i;
 
-  make_tms_tables();
+  for(i = 0; i < width; i++)
+    dst[i] = table[src[i] & PIXEL_MASK];
+}
+
+/* 32-entry byte table lookups (picked at runtime): pixel table bytes are  */
+/* split into byte planes once per line, then looked up 16 pixels at once */
+#if defined(RENDER_SSE2) && defined(__GNUC__)
+#include <tmmintrin.h>
+#define RENDER_SSSE3
 
-  /* Generate 64k of data for the look up table */
-  for(bx = 0; bx < 0x100; bx++)
+/* i = index + 0x70: indexes 16-31 have bit 7 set (zero) in the lookup of */
+/* entries 0-15, indexes 0-15 have it set once flipped for entries 16-31  */
+__attribute__((target("ssse3")))
+static __inline__ __m128i lut32_ssse3(__m128i lo, __m128i hi, __m128i i)
+{
+  return _mm_or_si128(_mm_shuffle_epi8(lo, i), _mm_shuffle_epi8(hi, _mm_xor_si128(i, _mm_set1_epi8(-128))));
+}
+
+/* Byte n of sixteen 32-bit table entries */
+static __inline__ __m128i byte_plane_32(const uint32 *table, int n)
+{
+  const __m128i m = _mm_set1_epi32(0xFF);
+  __m128i a = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128((const __m128i *)&table[0]), n << 3), m);
+  __m128i b = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128((const __m128i *)&table[4]), n << 3), m);
+  __m128i c = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128((const __m128i *)&table[8]), n << 3), m);
+  __m128i d = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128((const __m128i *)&table[12]), n << 3), m);
+  return _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+}
+
+/* Byte n of sixteen 16-bit table entries */
+static __inline__ __m128i byte_plane_16(const uint16 *table, int n)
+{
+  const __m128i m = _mm_set1_epi16(0xFF);
+  __m128i a = _mm_and_si128(_mm_srli_epi16(_mm_loadu_si128((const __m128i *)&table[0]), n << 3), m);
+  __m128i b = _mm_and_si128(_mm_srli_epi16(_mm_loadu_si128((const __m128i *)&table[8]), n << 3), m);
+  return _mm_packus_epi16(a, b);
+}
+
+__attribute__((target("ssse3")))
+static void remap_16_ssse3(uint16 *dst, const uint8 *src, const uint16 *table, int width)
+{
+  __m128i l0 = byte_plane_16(table, 0), l1 = byte_plane_16(&table[16], 0);
+  __m128i h0 = byte_plane_16(table, 1), h1 = byte_plane_16(&table[16], 1);
+  int i;
+
+  for(i = 0; i + 16 <= width; i += 16)
   {
-    for(sx = 0; sx < 0x100; sx++)
-    {
-      /* Background pixel */
-      b  = (bx & 0x0F);
+    __m128i c = _mm_add_epi8(_mm_and_si128(_mm_loadu_si128((const __m128i *)&src[i]), _mm_set1_epi8(PIXEL_MASK)), _mm_set1_epi8(0x70));
+    __m128i l = lut32_ssse3(l0, l1, c);
+    __m128i h = lut32_ssse3(h0, h1, c);
+    _mm_storeu_si128((__m128i *)&dst[i], _mm_unpacklo_epi8(l, h));
+    _mm_storeu_si128((__m128i *)&dst[i + 8], _mm_unpackhi_epi8(l, h));
+  }
 
-      /* Background priority */
-      bp = (bx & 0x20) ? 1 : 0;
+  remap_16_c(&dst[i], &src[i], table, width - i);
+}
 
-      /* Full background pixel + priority + sprite marker */
-      bf = (bx & 0x7F);
+__attribute__((target("ssse3")))
+static void remap_32_ssse3(uint32 *dst, const uint8 *src, const uint32 *table, int width)
+{
+  __m128i b0 = byte_plane_32(table, 0), b1 = byte_plane_32(&table[16], 0);
+  __m128i g0 = byte_plane_32(table, 1), g1 = byte_plane_32(&table[16], 1);
+  __m128i r0 = byte_plane_32(table, 2), r1 = byte_plane_32(&table[16], 2);
+  int i;
 
-      /* Sprite pixel */
-      s  = (sx & 0x0F);
+  for(i = 0; i + 16 <= width; i += 16)
+  {
+    __m128i c = _mm_add_epi8(_mm_and_si128(_mm_loadu_si128((const __m128i *)&src[i]), _mm_set1_epi8(PIXEL_MASK)), _mm_set1_epi8(0x70));
+    __m128i b = lut32_ssse3(b0, b1, c);
+    __m128i g = lut32_ssse3(g0, g1, c);
+    __m128i r = lut32_ssse3(r0, r1, c);
+    __m128i bg = _mm_unpacklo_epi8(b, g);
+    __m128i rx = _mm_unpacklo_epi8(r, _mm_setzero_si128());
+    _mm_storeu_si128((__m128i *)&dst[i], _mm_unpacklo_epi16(bg, rx));
+    _mm_storeu_si128((__m128i *)&dst[i + 4], _mm_unpackhi_epi16(bg, rx));
+    bg = _mm_unpackhi_epi8(b, g);
+    rx = _mm_unpackhi_epi8(r, _mm_setzero_si128());
+    _mm_storeu_si128((__m128i *)&dst[i + 8], _mm_unpacklo_epi16(bg, rx));
+    _mm_storeu_si128((__m128i *)&dst[i + 12], _mm_unpackhi_epi16(bg, rx));
+  }
 
-      /* Full sprite pixel, w/ palette and marker bits added */
-      sf = (sx & 0x0F) | 0x10 | 0x40;
+  remap_32_c(&dst[i], &src[i], table, width - i);
+}
+#endif
 
-      /* Overwriting a sprite pixel ? */
-      if(bx & 0x40)
-      {
-        /* Return the input */
-        c = bf;
-      }
-      else
-      {
-        /* Work out priority and transparency for both pixels */
-        if(bp)
-        {
-          /* Underlying pixel is high priority */
-          if(b)
-          {
-            c = bf | 0x40;
-          }
-          else
-          {
-            if(s)
-            {
-              c = sf;
-            }
-            else
-            {
-              c = bf;
-            }
-          }
-        }
-        else
-        {
-          /* Underlying pixel is low priority */
-          if(s)
-          {
-            c = sf;
-          }
-          else
-          {
-            c = bf;
-          }
-        }
-      }
+#if defined(RENDER_NEON) && defined(__aarch64__)
+#define RENDER_NEON_TBL
 
-      /* Store result */
-      lut[(bx << 8) | (sx)] = c;
-    }
+static void remap_16_neon(uint16 *dst, const uint8 *src, const uint16 *table, int width)
+{
+  uint8x16x2_t a = vld2q_u8((const uint8 *)&table[0]);
+  uint8x16x2_t b = vld2q_u8((const uint8 *)&table[16]);
+  uint8x16x2_t l = {{ a.val[0], b.val[0] }};
+  uint8x16x2_t h = {{ a.val[1], b.val[1] }};
+  int i;
+
+  for(i = 0; i + 16 <= width; i += 16)
+  {
+    uint8x16_t c = vandq_u8(vld1q_u8(&src[i]), vdupq_n_u8(PIXEL_MASK));
+    uint8x16x2_t o;
+    o.val[0] = vqtbl2q_u8(l, c);
+    o.val[1] = vqtbl2q_u8(h, c);
+    vst2q_u8((uint8 *)&dst[i], o);
   }
 
-  /* Make bitplane to pixel lookup table */
-  for(i = 0; i < 0x100; i++)
-  for(j = 0; j < 0x100; j++)
+  remap_16_c(&dst[i], &src[i], table, width - i);
+}
+
+static void remap_32_neon(uint32 *dst, const uint8 *src, const uint32 *table, int width)
+{
+  uint8x16x4_t a = vld4q_u8((const uint8 *)&table[0]);
+  uint8x16x4_t b = vld4q_u8((const uint8 *)&table[16]);
+  uint8x16x2_t p[4];
+  int i, n;
+
+  for(n = 0; n < 4; n++)
   {
-    int x;
-    uint32 out = 0;
-    for(x = 0; x < 8; x++)
-    {
-      out |= (j & (0x80 >> x)) ? (uint32)(8 << (x << 2)) : 0;
-      out |= (i & (0x80 >> x)) ? (uint32)(4 << (x << 2)) : 0;
-    }
-#if LSB_FIRST
-    bp_lut[(j << 8) | (i)] = out;
+    p[n].val[0] = a.val[n];
+    p[n].val[1] = b.val[n];
+  }
+
+  for(i = 0; i + 16 <= width; i += 16)
+  {
+    uint8x16_t c = vandq_u8(vld1q_u8(&src[i]), vdupq_n_u8(PIXEL_MASK));
+    uint8x16x4_t o;
+    o.val[0] = vqtbl2q_u8(p[0], c);
+    o.val[1] = vqtbl2q_u8(p[1], c);
+    o.val[2] = vqtbl2q_u8(p[2], c);
+    o.val[3] = vqtbl2q_u8(p[3], c);
+    vst4q_u8((uint8 *)&dst[i], o);
+  }
+
+  remap_32_c(&dst[i], &src[i], table, width - i);
+}
+#endif
+
+#if defined(RENDER_NEON_TBL)
+static void (*remap_16)(uint16 *dst, const uint8 *src, const uint16 *table, int width) = remap_16_neon;
+static void (*remap_32)(uint32 *dst, const uint8 *src, const uint32 *table, int width) = remap_32_neon;
 #else
-    bp_lut[(i << 8) | (j)] = out;
+static void (*remap_16)(uint16 *dst, const uint8 *src, const uint16 *table, int width) = remap_16_c;
+static void (*remap_32)(uint32 *dst, const uint8 *src, const uint32 *table, int width) = remap_32_c;
 #endif
-  }
 
-  sms_cram_expand_table[0] =  0;
-  sms_cram_expand_table[1] = (5 << 3)  + (1 << 2);
-  sms_cram_expand_table[2] = (15 << 3) + (1 << 2);
-  sms_cram_expand_table[3] = (27 << 3) + (1 << 2);
 
-  for(i = 0; i < 16; i++)
+/****************************************************************************/
+
+
+void render_shutdown(void)
+{
+}
+
+/* Build look-up tables and pick conversion routines */
+static void make_render_tables(void)
+{
+  make_tms_tables();
+
+  /* Pick bitplanes conversion routine */
+#ifdef RENDER_BMI2
+  if (__builtin_cpu_supports("bmi2"))
+    bp_decode = bp_decode_bmi2;
+#endif
+
+  /* Pick pixel format conversion routines */
+#ifdef RENDER_SSSE3
+  if (__builtin_cpu_supports("ssse3"))
   {
-    uint8 c = i << 4 | i;
-    gg_cram_expand_table[i] = c;    
+    remap_16 = remap_16_ssse3;
+    remap_32 = remap_32_ssse3;
   }
+#endif
+}
+
+/* Initialize the rendering data */
+void render_init(void)
+{
+  /* No line rendered yet */
+  prev_line = -1;
+
+  worker_once(&tables_once, make_render_tables);
 }
 
 
@@ -340,7 +662,9 @@ void render_reset(void)
   for(i = 0; i < PALETTE_SIZE; i++)
   {
     palette_sync(i);
+    bitmap.pal.dirty[i] = 1;
   }
+  bitmap.pal.update = 1;
 
   /* Invalidate pattern cache */
   memset(bg_name_dirty, 0, sizeof(bg_name_dirty));
@@ -348,6 +672,22 @@ void render_reset(void)
   bg_list_index = 0;
   memset(bg_pattern_cache, 0, sizeof(bg_pattern_cache));
 
+#if RENDER_LINE_CACHE
+  /* Invalidate background line cache */
+  memset(bg_line_key, 0, sizeof(bg_line_key));
+  memset(bg_name_lines, 0, sizeof(bg_name_lines));
+#endif
+
+  /* Invalidate sprite line index */
+  spr_dirty = 1;
+
+  /* No line waiting for the NTSC filter */
+  ntsc_count = 0;
+  memset(ntsc_kept, 0, sizeof(ntsc_kept));
+
+  /* Render thread context has to be copied again */
+  vdplog_resync();
+
   /* Pick default render routine */
   if (vdp.reg[0] & 4)
   {
@@ -361,133 +701,279 @@ void render_reset(void)
   }
 }
 
-static int prev_line = -1;
-
-/* Draw a line of the display */
-void render_line(int line)
+/* Draw a run of lines (VDP state is the same for all of them) */
+static void render_lines(int start, int end)
 {
-  int view = 1;
-  int overscan = option.overscan;
-
-  /* ensure we have not already rendered this line */
-  if (prev_line == line) return;
-  prev_line = line;
+  int line, vline, view;
+  int overscan = machine->option.overscan;
+  int current = vdp.line;
 
-  /* Ensure we're within the VDP active area (incl. overscan) */
+  /* VDP active area (incl. overscan) */
   int top_border = active_border[sms.display][vdp.extended];
-  int vline = (line + top_border) % vdp.lpf;
-  if (vline >= active_range[sms.display]) return;
+  int range = active_range[sms.display];
 
   /* adjust for Game Gear screen */
-  top_border = top_border + (vdp.height - bitmap.viewport.h) / 2;
+  int top = top_border + (vdp.height - bitmap.viewport.h) / 2;
+  int bottom = top + bitmap.viewport.h;
+  int width = bitmap.viewport.w + 2*bitmap.viewport.x;
 
-  /* Point to current line in output buffer */
-  linebuf = &internal_buffer[0];
+  int display = vdp.reg[1] & 0x40;
+  int blank = (vdp.reg[0] & 0x20) && (IS_SMS || IS_MD);
+  int skip = frame_skip || machine->vdplog;
+  int cached = 0;
 
-  /* Sprite limit flag is set at the beginning of the line */
-  if (vdp.spr_ovr)
-  {
-    vdp.spr_ovr = 0;
-    vdp.status |= 0x40;
-  }
+  /* Mode 4 drawing functions are called directly */
+  int mode4 = (render_bg == render_bg_sms) && (render_obj == render_obj_sms);
 
-  /* Vertical borders */
-  if ((vline < top_border) || (vline >= (bitmap.viewport.h + top_border)))
+  /* ensure we have not already rendered first line */
+  if (prev_line == (start % vdp.lpf)) start++;
+
+  for (line = start; line <= end; line++)
   {
-    /* Sprites are still processed offscreen */
-    if ((vdp.mode > 7) && (vdp.reg[1] & 0x40)) 
-      render_obj(line);
+    int l = line % vdp.lpf;
+
+    /* Line counter as if the line was drawn on its own (light gun mark, TMS text rows) */
+    vdp.line = (line < current) ? line : current;
+    prev_line = l;
+
+    /* Ensure we're within the VDP active area (incl. overscan) */
+    vline = (l + top_border) % vdp.lpf;
+    if (vline >= range) continue;
 
-    /* Line is only displayed where overscan is emulated */
-    view = 0;
-    if (overscan && (vline < (bitmap.viewport.h + 2*bitmap.viewport.y)))
+    /* Point to current line in output buffer */
+    linebuf = &internal_buffer[0];
+
+    /* Sprite limit flag is set at the beginning of the line */
+    if (vdp.spr_ovr)
     {
-      /* Background color */
-      memset(linebuf, BACKDROP_COLOR, bitmap.viewport.w + 2*bitmap.viewport.x);
-      view = 1;
+      vdp.spr_ovr = 0;
+      vdp.status |= 0x40;
     }
-  }
-  /* Active display */
-  else
-  {
-    /* Display enabled ? */
-    if (vdp.reg[1] & 0x40)
+
+    /* Vertical borders */
+    if ((vline < top) || (vline >= bottom))
     {
-      /* adjust line horizontal offset */
-      if (overscan)
-        linebuf += 14;
+      /* Sprites are still processed offscreen */
+      if ((vdp.mode > 7) && display)
+        render_obj(l);
 
-      /* Update pattern cache */
-      update_bg_pattern_cache();
+      /* Line is only displayed where overscan is emulated */
+      view = 0;
+      if (overscan && (vline < (bitmap.viewport.h + 2*bitmap.viewport.y)))
+      {
+        /* Background color */
+        memset(linebuf, BACKDROP_COLOR, width);
+        view = 1;
+      }
+    }
+    /* Active display */
+    else
+    {
+      view = 1;
 
-      /* Draw background */
-      render_bg(line);
+      /* Display enabled ? */
+      if (display)
+      {
+        /* adjust line horizontal offset */
+        if (overscan)
+          linebuf += 14;
 
-      /* Draw sprites */
-      render_obj(line);
+        /* Update pattern cache (VRAM is not modified during the run) */
+        if (!cached)
+        {
+          PROFILE_BEGIN(PROF_BG_CACHE);
+          update_bg_pattern_cache();
+          PROFILE_END();
+          cached = 1;
+        }
+
+        /* Draw background & sprites (mode 4 background never sets bit 6) */
+        if (mode4)
+        {
+          if (skip)
+            memset(linebuf, 0, 256);
+          else
+            render_bg_sms(l);
+          render_obj_sms(l);
+        }
+        else
+        {
+          if (skip)
+            skip_bg_tms(l);
+          else
+            render_bg(l);
+          render_obj(l);
+        }
 
-      /* Blank leftmost column of display */
-      if((vdp.reg[0] & 0x20) && (IS_SMS || IS_MD))
-        memset(linebuf, BACKDROP_COLOR, 8);
+        /* Blank leftmost column of display */
+        if (blank)
+          memset(linebuf, BACKDROP_COLOR, 8);
 
-      /* Horizontal borders */
-      if (overscan)
+        /* Horizontal borders */
+        if (overscan)
+        {
+          /* Display background color */
+          memset(linebuf - 14, BACKDROP_COLOR, bitmap.viewport.x);
+          memset(linebuf - 14 + bitmap.viewport.w + bitmap.viewport.x, BACKDROP_COLOR, bitmap.viewport.x);
+        }
+      }
+      else
       {
-        /* Display background color */
-        memset(linebuf - 14, BACKDROP_COLOR, bitmap.viewport.x);
-        memset(linebuf - 14 + bitmap.viewport.w + bitmap.viewport.x, BACKDROP_COLOR, bitmap.viewport.x);
+        /* Background color */
+        memset(linebuf, BACKDROP_COLOR, width);
       }
     }
+
+    /* Parse Sprites for next line */
+    if (vdp.mode > 7)
+      parse_satb(l);
     else
+      parse_line(l);
+
+    /* LightGun mark */
+    if (sms.device[0] == DEVICE_LIGHTGUN)
     {
-      /* Background color */
-      memset(linebuf, BACKDROP_COLOR, bitmap.viewport.w + 2*bitmap.viewport.x);
+      int dy = vdp.line - input.analog[0][1];
+
+      if (abs(dy) < 6)
+      {
+        int i;
+        int x_start = input.analog[0][0] - 4;
+        int x_end = input.analog[0][0] + 4;
+        if (x_start < 0) x_start = 0;
+        if (x_end > 255) x_end = 255;
+        for (i=x_start; i<x_end+1; i++)
+        {
+          linebuf[i] = 0xFF;
+        }
+      }
+    }
+
+    /* Only draw lines within the video output range ! */
+    if (view && !skip)
+    {
+      /* adjust output line */
+      if (!overscan)
+        vline -= top;
+
+      PROFILE_BEGIN(PROF_BLIT);
+      if (machine->option.ntsc && (bitmap.depth == SMS_NTSC_OUT_DEPTH))
+      {
+        if (ntsc_threads && (vline < NTSC_LINES) && (width <= 0x120))
+        {
+          /* keep line for the frame pass (a line drawn again replaces the first one) */
+          ntsc_line_t *l = &ntsc_line[ntsc_count];
+          if (ntsc_kept[vline >> 5] & (1 << (vline & 31)))
+          {
+            for (l = &ntsc_line[0]; l->vline != vline; l++);
+          }
+          else
+          {
+            ntsc_kept[vline >> 5] |= 1 << (vline & 31);
+            ntsc_count++;
+          }
+          l->vline = vline;
+          l->width = width;
+          l->border = BACKDROP_COLOR;
+          memcpy(l->table, pixel, sizeof(l->table));
+          memcpy(l->index, internal_buffer, width);
+        }
+        else
+          sms_ntsc_blit(&sms_ntsc, ( SMS_NTSC_IN_T const * )pixel, internal_buffer, width, vline);
+      }
+      else
+        remap_line(vline);
+      PROFILE_END();
     }
   }
 
-  /* Parse Sprites for next line */
-  if (vdp.mode > 7)
-    parse_satb(line);
-  else
-    parse_line(line);
+  vdp.line = current;
+}
 
-  /* LightGun mark */
-  if (sms.device[0] == DEVICE_LIGHTGUN)
+/* Draw a line of the display */
+void render_line(int line)
+{
+  render_lines(line, line);
+}
+
+/* Start of frame: lines are drawn on demand, see render_sync().               */
+/* Skipped frames are processed the same way but only what can affect sprite  */
+/* overflow & collision flags is done (sprites need bit 6 of line buffer data) */
+void render_start(int skip)
+{
+  next_line = 0;
+  frame_skip = skip;
+
+  /* lines are drawn by the render thread (sprite status flags are still processed here) */
+  if (machine->vdplog)
+    vdplog_start(skip);
+}
+
+/* Catch-up rendering: draw all lines not yet drawn up to the given one (included). */
+/* This is called before VDP state is modified, when status flags are read and at  */
+/* the end of the frame, so that runs of unchanged lines are drawn at once.         */
+void render_sync(int line)
+{
+  int start = next_line;
+
+  if (line >= start)
+  {
+    next_line = line + 1;
+    VDPLOG_WRITE(VDPLOG_RUN | (vdp.line << 12) | line);
+    PROFILE_BEGIN(PROF_RENDER);
+    render_lines(start, line);
+    PROFILE_END();
+  }
+}
+
+/* NTSC filter frame pass: filter a band of the kept lines */
+static void ntsc_band(void *arg, int index)
+{
+  sms_ntsc_kernels_t kernels;
+  const uint16 *table = NULL;
+  int i, first, last;
+
+  machine_select((machine_t *)arg);
+
+  first = ntsc_count * index / ntsc_threads;
+  last = ntsc_count * (index + 1) / ntsc_threads;
+
+  for(i = first; i < last; i++)
   {
-    int dy = vdp.line - input.analog[0][1];
+    ntsc_line_t *l = &ntsc_line[i];
 
-    if (abs(dy) < 6)
+    /* kernels only change with the palette */
+    if (!table || memcmp(table, l->table, sizeof(l->table)))
     {
-      int i;
-      int start = input.analog[0][0] - 4;
-      int end = input.analog[0][0] + 4;
-      if (start < 0) start = 0;
-      if (end > 255) end = 255;
-      for (i=start; i<end+1; i++)
-      {
-        linebuf[i] = 0xFF;
-      }
+      table = l->table;
+      sms_ntsc_kernels(&sms_ntsc, table, &kernels);
     }
+
+    sms_ntsc_blit_kernels(&kernels, l->index, l->width, l->border, (uint16 *)&bitmap.data[l->vline * bitmap.pitch]);
   }
+}
 
-  /* Only draw lines within the video output range ! */
-  if (view)
-  {
-    /* adjust output line */
-    if (!overscan)
-      vline -= top_border;
+/* End of frame: lines drawn by the render thread are waited for, then lines */
+/* kept for the NTSC filter are filtered in parallel bands                    */
+void render_end(void)
+{
+  /* wait for the render thread */
+  if (machine->vdplog)
+    vdplog_end();
 
-    if (option.ntsc)
-      sms_ntsc_blit(&sms_ntsc, ( SMS_NTSC_IN_T const * )pixel, internal_buffer, bitmap.viewport.w + 2*bitmap.viewport.x, vline);
-    else
-      remap_8_to_16(vline);
+  if (ntsc_count)
+  {
+    PROFILE_BEGIN(PROF_BLIT);
+    worker_run(ntsc_threads, ntsc_threads, ntsc_band, machine);
+    ntsc_count = 0;
+    memset(ntsc_kept, 0, sizeof(ntsc_kept));
+    PROFILE_END();
   }
 }
 
 /* Draw the Master System background */
-void render_bg_sms(int line)
+static void draw_bg_sms(int line)
 {
-  int locked = 0;
   int yscroll_mask = (vdp.extended) ? 256 : 224;
   int v_line = (line + vdp.vscroll) % yscroll_mask;
   int v_row  = (v_line & 7) << 3;
@@ -498,9 +984,6 @@ void render_bg_sms(int line)
   uint16 *nt = (uint16 *)&vdp.vram[nt_addr];
   int nt_scroll = (hscroll >> 3);
   int shift = (hscroll & 7);
-  uint32 atex_mask;
-  uint32 *cache_ptr;
-  uint32 *linebuf_ptr = (uint32 *)&linebuf[0 - shift];
 
   /* Draw first column (clipped) */
   if(shift)
@@ -513,6 +996,91 @@ void render_bg_sms(int line)
     column++;
   }
 
+#if defined(RENDER_SSE2) || defined(RENDER_NEON)
+  {
+    uint32 name[33];
+    uint8 pal[33];
+    uint8 flip[33];
+    uint8 *dst = &linebuf[(column << 3) - shift];
+    int x;
+
+    /* Gather name table attributes (clipped last column included) */
+    for(x = column; x < 33; x++)
+    {
+      /* Stop vertical scrolling for leftmost eight columns */
+      if((vdp.reg[0] & 0x80) && (x == 24))
+      {
+        v_row = (line & 7) << 3;
+        nt = (uint16 *)&vdp.vram[nt_addr];
+      }
+
+      attr = nt[(x + nt_scroll) & 0x1F];
+
+#ifndef LSB_FIRST
+      attr = (((attr & 0xFF) << 8) | ((attr & 0xFF00) >> 8));
+#endif
+      /* Line of pattern data in cache, priority and palette bits */
+      name[x] = BG_PATTERN_LINE(attr, v_row);
+      flip[x] = BG_PATTERN_HFLIP(attr);
+      pal[x] = (attr >> 11) & 3;
+    }
+
+    /* Draw a line of the background, two columns at a time */
+    for(; column < 31; column += 2, dst += 16)
+    {
+#ifdef RENDER_SSE2
+      __m128i p = _mm_unpacklo_epi64(_mm_loadl_epi64((__m128i *)&bg_pattern_cache[name[column]]),
+                                     _mm_loadl_epi64((__m128i *)&bg_pattern_cache[name[column + 1]]));
+#if RENDER_COMPACT_CACHE
+      if(flip[column] | flip[column + 1])
+        p = bg_hflip(p, (flip[column] << 1) | flip[column + 1]);
+#endif
+      p = _mm_or_si128(p, _mm_loadu_si128((__m128i *)atex2[(pal[column] << 2) | pal[column + 1]]));
+      _mm_storeu_si128((__m128i *)dst, p);
+#else
+      uint8x16_t p = vcombine_u8(vld1_u8(&bg_pattern_cache[name[column]]),
+                                 vld1_u8(&bg_pattern_cache[name[column + 1]]));
+#if RENDER_COMPACT_CACHE
+      if(flip[column] | flip[column + 1])
+        p = bg_hflip(p, (flip[column] << 1) | flip[column + 1]);
+#endif
+      vst1q_u8(dst, vorrq_u8(p, vld1q_u8(atex2[(pal[column] << 2) | pal[column + 1]])));
+#endif
+    }
+
+    /* Odd number of columns (first one clipped) */
+    if(column < 32)
+    {
+#ifdef RENDER_SSE2
+      __m128i p = _mm_loadl_epi64((__m128i *)&bg_pattern_cache[name[column]]);
+#if RENDER_COMPACT_CACHE
+      if(flip[column])
+        p = bg_hflip(p, 2);
+#endif
+      p = _mm_or_si128(p, _mm_loadu_si128((__m128i *)atex2[pal[column] << 2]));
+      _mm_storel_epi64((__m128i *)dst, p);
+#else
+      uint8x16_t p = vcombine_u8(vld1_u8(&bg_pattern_cache[name[column]]), vdup_n_u8(0));
+#if RENDER_COMPACT_CACHE
+      if(flip[column])
+        p = bg_hflip(p, 2);
+#endif
+      vst1_u8(dst, vget_low_u8(vorrq_u8(p, vld1q_u8(atex2[pal[column] << 2]))));
+#endif
+      column++;
+      dst += 8;
+    }
+
+    /* Draw last column (clipped) */
+    for(x = 0; x < shift; x++)
+      dst[x] = bg_pattern_cache[name[32] | (flip[32] ? (x ^ 7) : x)] | (pal[32] << 4);
+  }
+#else
+  int locked = 0;
+  uint32 atex_mask;
+  uint32 *cache_ptr;
+  uint32 *linebuf_ptr = (uint32 *)&linebuf[0 - shift];
+
   /* Draw a line of the background */
   for(; column < 32; column++)
   {
@@ -534,8 +1102,20 @@ void render_bg_sms(int line)
     atex_mask = atex[(attr >> 11) & 3];
 
     /* Point to a line of pattern data in cache */
-    cache_ptr = (uint32 *)&bg_pattern_cache[((attr & 0x7FF) << 6) | (v_row)];
-    
+    cache_ptr = (uint32 *)&bg_pattern_cache[BG_PATTERN_LINE(attr, v_row)];
+
+    if(BG_PATTERN_HFLIP(attr))
+    {
+      /* Copy both halves byte-reversed and swapped, adding the attribute bits in */
+      uint32 l = read_dword( &cache_ptr[1] );
+      uint32 r = read_dword( &cache_ptr[0] );
+      l = (l >> 24) | ((l >> 8) & 0xFF00) | ((l << 8) & 0xFF0000) | (l << 24);
+      r = (r >> 24) | ((r >> 8) & 0xFF00) | ((r << 8) & 0xFF0000) | (r << 24);
+      write_dword( &linebuf_ptr[(column << 1)] , l | (atex_mask));
+      write_dword( &linebuf_ptr[(column << 1) | (1)], r | (atex_mask));
+      continue;
+    }
+
     /* Copy the left half, adding the attribute bits in */
     write_dword( &linebuf_ptr[(column << 1)] , read_dword( &cache_ptr[0] ) | (atex_mask));
 
@@ -559,10 +1139,60 @@ void render_bg_sms(int line)
 
     for(x = 0; x < shift; x++)
     {
-      c = bg_pattern_cache[((attr & 0x7FF) << 6) | (v_row) | (x)];
+      c = bg_pattern_cache[BG_PATTERN_LINE(attr, v_row) | (BG_PATTERN_HFLIP(attr) ? (x ^ 7) : x)];
       p[x] = ((c) | (a));
     }
   }
+#endif
+}
+
+/* Draw the Master System background, or copy it from the line cache */
+void render_bg_sms(int line)
+{
+#if RENDER_LINE_CACHE
+  if((unsigned)line < 256)
+  {
+    int yscroll_mask = (vdp.extended) ? 256 : 224;
+    int v_line = (line + vdp.vscroll) % yscroll_mask;
+    int hscroll = ((vdp.reg[0] & 0x40) && (line < 0x10) && (sms.console != CONSOLE_GG)) ? 0 : (0x100 - vdp.reg[8]);
+    uint16 nt_addr = (vdp.ntab + ((v_line >> 3) << 6)) & (((sms.console == CONSOLE_SMS) && !(vdp.reg[2] & 1)) ? ~0x400 :0xFFFF);
+    uint8 *nt = &vdp.vram[nt_addr];
+    uint32 key, bit;
+    int i;
+
+    /* Name table row, pattern line, horizontal scroll and vertical scroll lock */
+    key = ((vdp.reg[0] & 0x80) << 17) | ((hscroll & 0xFF) << 16) | nt_addr | (v_line & 7);
+
+    /* Nothing changed since the line was cached ? */
+    if(bg_line_key[line] == (key | BG_LINE_CACHED))
+    {
+      memcpy(linebuf, bg_line_cache[line], 256);
+      return;
+    }
+
+    draw_bg_sms(line);
+
+    /* Only cache lines drawn twice the same way (scrolling screens are not cached) */
+    if(bg_line_key[line] != key)
+    {
+      bg_line_key[line] = key;
+      return;
+    }
+
+    memcpy(bg_line_cache[line], linebuf, 256);
+    bg_line_key[line] = key | BG_LINE_CACHED;
+
+    /* Line is dropped when its patterns or name table row are modified */
+    bit = 1U << (line & 31);
+    for(i = 0; i < 64; i += 2)
+      bg_name_lines[nt[i] | ((nt[i + 1] & 1) << 8)][line >> 5] |= bit;
+    bg_name_lines[nt_addr >> 5][line >> 5] |= bit;
+    bg_name_lines[(nt_addr >> 5) + 1][line >> 5] |= bit;
+    return;
+  }
+#endif
+
+  draw_bg_sms(line);
 }
 
 /* Draw sprites */
@@ -615,6 +1245,56 @@ void render_obj_sms(int line)
     if((xp + width) > 256)
       end = (256 - xp);
 
+#if defined(RENDER_SSE2) || defined(RENDER_NEON)
+    /* Draw whole sprite line at once (clipped sprites are drawn pixel by pixel) */
+    if((start == 0) && (end == width))
+    {
+      int lane;
+
+      if(vdp.reg[1] & 0x01)
+      {
+        /* Double size sprite: pixels are doubled, priority is checked on even pixels */
+        cache_ptr = (uint8 *)&bg_pattern_cache[(n << 6) | ((yp >> 1) << 3)];
+#ifdef RENDER_SSE2
+        __m128i s = _mm_loadl_epi64((__m128i *)cache_ptr);
+        __m128i o = _mm_loadu_si128((__m128i *)linebuf_ptr);
+        __m128i b = _mm_and_si128(o, _mm_set1_epi16(0x00FF));
+        lane = obj_blend(_mm_unpacklo_epi8(s, s), _mm_or_si128(b, _mm_slli_epi16(b, 8)), &o);
+        _mm_storeu_si128((__m128i *)linebuf_ptr, o);
+#else
+        uint8x8_t s = vld1_u8(cache_ptr);
+        uint8x16_t o = vld1q_u8(linebuf_ptr);
+        lane = obj_blend(vcombine_u8(vzip_u8(s, s).val[0], vzip_u8(s, s).val[1]), vtrnq_u8(o, o).val[0], &o);
+        vst1q_u8(linebuf_ptr, o);
+#endif
+      }
+      else
+      {
+        /* Regular size sprite (8x8 / 8x16) */
+        cache_ptr = (uint8 *)&bg_pattern_cache[(n << 6) | (yp << 3)];
+#ifdef RENDER_SSE2
+        __m128i s = _mm_loadl_epi64((__m128i *)cache_ptr);
+        __m128i o = _mm_loadl_epi64((__m128i *)linebuf_ptr);
+        lane = obj_blend(s, o, &o);
+        _mm_storel_epi64((__m128i *)linebuf_ptr, o);
+#else
+        uint8x16_t s = vcombine_u8(vld1_u8(cache_ptr), vdup_n_u8(0));
+        uint8x16_t o = vcombine_u8(vld1_u8(linebuf_ptr), vdup_n_u8(0));
+        lane = obj_blend(s, o, &o);
+        vst1_u8(linebuf_ptr, vget_low_u8(o));
+#endif
+      }
+
+      /* pixel-accurate SPR_COL flag */
+      if ((lane >= 0) && !(vdp.status & 0x20))
+      {
+        vdp.status |= 0x20;
+        vdp.spr_col = (line << 8) | ((xp + lane + 13) >> 1);
+      }
+      continue;
+    }
+#endif
+
     /* Draw double size sprite */
     if(vdp.reg[1] & 0x01)
     {
@@ -633,8 +1313,8 @@ void render_obj_sms(int line)
           /* Background pixel from line buffer */
           bg = linebuf_ptr[x];
 
-          /* Look up result */
-          linebuf_ptr[x] = linebuf_ptr[x+1] = lut[(bg << 8) | (sp)];
+          /* Draw sprite pixel */
+          linebuf_ptr[x] = linebuf_ptr[x+1] = obj_pixel(bg, sp);
 
           /* Check sprite collision */
           if ((bg & 0x40) && !(vdp.status & 0x20))
@@ -663,8 +1343,8 @@ void render_obj_sms(int line)
           /* Background pixel from line buffer */
           bg = linebuf_ptr[x];
 
-          /* Look up result */
-          linebuf_ptr[x] = lut[(bg << 8) | (sp)];
+          /* Draw sprite pixel */
+          linebuf_ptr[x] = obj_pixel(bg, sp);
 
           /* Check sprite collision */
           if ((bg & 0x40) && !(vdp.status & 0x20))
@@ -721,7 +1401,7 @@ void palette_sync(int index)
     if (sms.console < CONSOLE_SMS)
     {
       /* pick one of the original TMS9918 palettes */
-      color += option.tms_pal * 16;
+      color += machine->option.tms_pal * 16;
 
       r = tms_palette[color][0];
       g = tms_palette[color][1];
@@ -741,9 +1421,48 @@ void palette_sync(int index)
   }
 
   pixel[index] = MAKE_PIXEL(r, g, b);
+  pixel_15[index] = MAKE_PIXEL_15(r, g, b);
+  pixel_32[index] = MAKE_PIXEL_32(r, g, b);
+
+  /* Notify palette change (indexed output) */
+  if ((bitmap.pal.color[index][0] != r) || (bitmap.pal.color[index][1] != g) || (bitmap.pal.color[index][2] != b))
+  {
+    bitmap.pal.color[index][0] = r;
+    bitmap.pal.color[index][1] = g;
+    bitmap.pal.color[index][2] = b;
+    bitmap.pal.dirty[index] = 1;
+    bitmap.pal.update = 1;
+  }
 }
 
 
+/* Rebuild the sprite line index: SAT entries covering each line counter value */
+static void update_spr_index(uint8 *st, int height)
+{
+  int i, v, yp, end;
+
+  memset(spr_mask, 0, sizeof(spr_mask));
+
+  for(i = 0; i < 64; i++)
+  {
+    /* Sprite Y position */
+    yp = st[i];
+
+    /* Found end of sprite list marker for non-extended modes? */
+    if(vdp.extended == 0 && yp == 208)
+      break;
+
+    /* Wrap Y coordinate for sprites > 240 */
+    if(yp > 240) yp -= 256;
+
+    /* Line counter values within vertical range */
+    end = yp + height;
+    if(end > 256) end = 256;
+    for(v = (yp < 0) ? 0 : yp; v < end; v++)
+      spr_mask[v][i >> 5] |= (1U << (i & 31));
+  }
+}
+
 static void parse_satb(int line)
 {
   /* Pointer to sprite attribute table */
@@ -751,6 +1470,8 @@ static void parse_satb(int line)
 
   /* Sprite counter (64 max.) */
   int i = 0;
+  int n;
+  uint32 bits, key;
 
   /* Line counter value */
   int vc = vc_table[sms.display][vdp.extended][line];
@@ -767,27 +1488,25 @@ static void parse_satb(int line)
   if(vdp.reg[1] & 0x01)
     height <<= 1;
 
+  /* Update sprite line index if SAT or sprite settings were modified */
+  key = 0x80000000 | (vdp.extended << 18) | ((vdp.reg[1] & 3) << 16) | vdp.satb;
+  if(spr_dirty || (spr_key != key))
+  {
+    update_spr_index(st, height);
+    spr_key = key;
+    spr_dirty = 0;
+  }
+
   /* Sprite count for current line (8 max.) */
   object_index_count = 0;
 
-  for(i = 0; i < 64; i++)
+  /* Sprites within vertical range, in SAT order */
+  for(n = 0; n < 2; n++)
   {
-    /* Sprite Y position */
-    yp = st[i];
-
-    /* Found end of sprite list marker for non-extended modes? */
-    if(vdp.extended == 0 && yp == 208)
-      return;
-
-    /* Wrap Y coordinate for sprites > 240 */
-    if(yp > 240) yp -= 256;
-
-    /* Compare sprite position with current line counter */
-    yp = vc - yp;
-
-    /* Sprite is within vertical range? */
-    if((yp >= 0) && (yp < height))
+    for(bits = spr_mask[vc][n]; bits; bits &= (bits - 1))
     {
+      i = (n << 5) | lowest_bit(bits);
+
       /* Sprite limit reached? */
       if (object_index_count == 8)
       {
@@ -796,12 +1515,16 @@ static void parse_satb(int line)
           vdp.spr_ovr = 1;
 
         /* End of sprite parsing */
-        if (option.spritelimit)
+        if (machine->option.spritelimit)
           return;
       }
 
+      /* Wrap Y coordinate for sprites > 240 */
+      yp = st[i];
+      if(yp > 240) yp -= 256;
+
       /* Store sprite attributes for later processing */
-      object_info[object_index_count].yrange = yp;
+      object_info[object_index_count].yrange = vc - yp;
       object_info[object_index_count].xpos = st[0x80 + (i << 1)];
       object_info[object_index_count].attr = st[0x81 + (i << 1)];
 
@@ -814,7 +1537,7 @@ static void parse_satb(int line)
 static void update_bg_pattern_cache(void)
 {
   int i;
-  uint8 x, y;
+  uint8 y;
   uint16 name;
 
   if(!bg_list_index) return;
@@ -830,33 +1553,62 @@ static void update_bg_pattern_cache(void)
       {
         uint8 *dst = &bg_pattern_cache[name << 6];
 
-        uint16 bp01 = *(uint16 *)&vdp.vram[(name << 5) | (y << 2) | (0)];
-        uint16 bp23 = *(uint16 *)&vdp.vram[(name << 5) | (y << 2) | (2)];
-        uint32 temp = (bp_lut[bp01] >> 2) | (bp_lut[bp23]);
+        /* Convert bitplanes to packed pixels */
+        bp_decode(&dst[y << 3], &vdp.vram[(name << 5) | (y << 2)]);
 
-        for(x = 0; x < 8; x++)
+#if !RENDER_COMPACT_CACHE
+        /* Flipped patterns */
         {
-          uint8 c = (temp >> (x << 2)) & 0x0F;
-          dst[0x00000 | (y << 3) | (x)] = (c);
-          dst[0x08000 | (y << 3) | (x ^ 7)] = (c);
-          dst[0x10000 | ((y ^ 7) << 3) | (x)] = (c);
-          dst[0x18000 | ((y ^ 7) << 3) | (x ^ 7)] = (c);
+          int x;
+          for(x = 0; x < 8; x++)
+          {
+            uint8 c = dst[(y << 3) | (x)];
+            dst[0x08000 | (y << 3) | (x ^ 7)] = (c);
+            dst[0x10000 | ((y ^ 7) << 3) | (x)] = (c);
+            dst[0x18000 | ((y ^ 7) << 3) | (x ^ 7)] = (c);
+          }
         }
+#endif
       }
     }
     bg_name_dirty[name] = 0;
+
+#if RENDER_LINE_CACHE
+    /* Drop cached background lines depending on this pattern */
+    for(y = 0; y < 8; y++)
+    {
+      uint32 lines = bg_name_lines[name][y];
+      for(; lines; lines &= (lines - 1))
+        bg_line_key[(y << 5) | lowest_bit(lines)] &= ~BG_LINE_CACHED;
+      bg_name_lines[name][y] = 0;
+    }
+#endif
   }
   bg_list_index = 0;
 }
 
-static void remap_8_to_16(int line)
+/* Convert a rendered line to the output bitmap pixel format */
+static void remap_line(int line)
 {
-  int i;
-  uint16 *p = (uint16 *)&bitmap.data[(line * bitmap.pitch)];
+  uint8 *p = &bitmap.data[(line * bitmap.pitch)];
   int width = bitmap.viewport.w + 2*bitmap.viewport.x;
 
-  for(i = 0; i < width; i++)
+  switch(bitmap.depth)
   {
-    p[i] = pixel[ internal_buffer[i] & PIXEL_MASK ];
+    case 8:
+      remap_8(p, internal_buffer, width);
+      break;
+
+    case 15:
+      remap_16((uint16 *)p, internal_buffer, pixel_15, width);
+      break;
+
+    case 32:
+      remap_32((uint32 *)p, internal_buffer, pixel_32, width);
+      break;
+
+    default:
+      remap_16((uint16 *)p, internal_buffer, pixel, width);
+      break;
   }
 }
@@ -28,22 +28,116 @@
 /* Pack RGB data into a 16-bit RGB 5:6:5 format */
 #define MAKE_PIXEL(r,g,b)   (((r << 8) & 0xF800) | ((g << 3) & 0x07E0) | ((b >> 3) & 0x001F))
 
+/* Pack RGB data into a 16-bit RGB 5:5:5 format */
+#define MAKE_PIXEL_15(r,g,b) (((r << 7) & 0x7C00) | ((g << 2) & 0x03E0) | ((b >> 3) & 0x001F))
+
+/* Pack RGB data into a 32-bit XRGB 8:8:8:8 format */
+#define MAKE_PIXEL_32(r,g,b) ((r << 16) | (g << 8) | b)
+
+/* Cache unflipped patterns only (32KB instead of 128KB per machine): */
+/* flipped patterns are then derived at draw time                      */
+#ifndef RENDER_COMPACT_CACHE
+#define RENDER_COMPACT_CACHE 0
+#endif
+
+#if RENDER_COMPACT_CACHE
+#define BG_PATTERN_CACHE_SIZE 0x08000
+#else
+#define BG_PATTERN_CACHE_SIZE 0x20000
+#endif
+
+/* Keep the last background line drawn for each display line (80KB per machine): */
+/* lines are copied back as long as their name table row, scroll settings and    */
+/* patterns are unchanged (mode 4 only)                                          */
+#ifndef RENDER_LINE_CACHE
+#define RENDER_LINE_CACHE 1
+#endif
+
+/* Lines kept for the NTSC filter frame pass (output lines incl. overscan) */
+#define NTSC_LINES          288
+
 /* Used for blanking a line in whole or in part */
 #define BACKDROP_COLOR      (0x10 | (vdp.reg[7] & 0x0F))
 
-extern void (*render_bg)(int line);
-extern void (*render_obj)(int line);
-extern uint8 *linebuf;
+/* Sprite attributes for current line */
+typedef struct
+{
+  uint16 yrange;
+  uint16 xpos;
+  uint16 attr;
+} object_info_t;
+
+/* Line waiting for the NTSC filter frame pass */
+typedef struct
+{
+  uint16 vline;                       /* Output bitmap line */
+  uint16 width;                       /* Line width (pixels) */
+  uint8 border;                       /* Backdrop color index */
+  uint16 table[0x20];                 /* Pixel table the line was drawn with */
+  uint8 index[0x120];                 /* Palette indexes */
+} ntsc_line_t;
+
+/* Rendering context */
+typedef struct
+{
+  void (*render_bg)(int line);        /* Background drawing function */
+  void (*render_obj)(int line);       /* Sprites drawing function */
+  uint8 *linebuf;                     /* Pointer to output buffer */
+  uint8 bg_name_dirty[0x200];         /* 1= This pattern is dirty */
+  uint16 bg_name_list[0x200];         /* List of modified pattern indices */
+  uint16 bg_list_index;               /* # of modified patterns in list */
+  uint8 internal_buffer[0x200];       /* Internal buffer for drawing non 8-bit displays */
+  uint16 pixel[0x20];                 /* Precalculated pixel table (RGB 5:6:5, NTSC filter input) */
+  uint16 pixel_15[0x20];              /* Precalculated pixel table (RGB 5:5:5) */
+  uint32 pixel_32[0x20];              /* Precalculated pixel table (XRGB 8:8:8:8) */
+  uint8 bg_pattern_cache[BG_PATTERN_CACHE_SIZE]; /* Cached (and flipped) patterns */
+#if RENDER_LINE_CACHE
+  uint8 bg_line_cache[256][256];      /* Cached background lines */
+  uint32 bg_line_key[256];            /* Name table row & scroll settings each line was last drawn with */
+  uint32 bg_name_lines[0x200][8];     /* Cached lines (bit n = line n) depending on each pattern */
+#endif
+  object_info_t object_info[64];
+  uint8 object_index_count;
+  uint32 spr_mask[256][2];            /* SAT entries (bit n = entry n) covering each line */
+  uint32 spr_key;                     /* SAT address, sprite size & mode the index was built for */
+  uint8 spr_end;                      /* SAT entries before end marker (TMS modes) */
+  uint8 spr_dirty;                    /* 1= sprite Y coordinates were modified */
+  int prev_line;
+  int next_line;                      /* Next line to be drawn (catch-up rendering) */
+  uint8 skip;                         /* 1= no video output (sprite status flags only) */
+  ntsc_line_t ntsc_line[NTSC_LINES];  /* Lines to filter at the end of the frame */
+  int ntsc_count;                     /* # of lines to filter */
+  uint32 ntsc_kept[NTSC_LINES / 32];  /* Output lines already kept (bit n = line n) */
+  int ntsc_threads;                   /* NTSC filter: 0= lines are filtered as they are drawn, */
+                                      /* n= whole frames are filtered on n threads            */
+} render_t;
+
+/* Index of the lowest bit set in a (non-zero) mask */
+#ifdef __GNUC__
+#define lowest_bit(bits) __builtin_ctz(bits)
+#else
+static __inline__ int lowest_bit(uint32 bits)
+{
+  int n = 0;
+  while (!(bits & 1))
+  {
+    bits >>= 1;
+    n++;
+  }
+  return n;
+}
+#endif
+
 extern uint8 sms_cram_expand_table[4];
 extern uint8 gg_cram_expand_table[16];
-extern uint8 bg_name_dirty[0x200];
-extern uint16 bg_name_list[0x200];
-extern uint16 bg_list_index;
 
 extern void render_shutdown(void);
 extern void render_init(void);
 extern void render_reset(void);
 extern void render_line(int line);
+extern void render_start(int skip);
+extern void render_sync(int line);
+extern void render_end(void);
 extern void render_bg_sms(int line);
 extern void render_obj_sms(int line);
 extern void palette_sync(int index);
@@ -3,16 +3,30 @@
 
 typedef unsigned char uint8;
 typedef unsigned short int uint16;
-typedef unsigned long int uint32;
+typedef unsigned int uint32;
 
 typedef signed char int8;
 typedef signed short int int16;
-typedef signed long int int32;
+typedef signed int int32;
 
 #ifdef NGC
 #include "osd.h"
 #endif
 
+/* Thread-local storage class (current machine context). Position independent */
+/* code would otherwise call __tls_get_addr on each access: the initial-exec   */
+/* model reads the variable at a fixed offset from the thread pointer instead */
+/* (a few bytes of static TLS, available to libraries loaded with dlopen)     */
+#ifndef THREAD_LOCAL
+#if defined(NGC)
+#define THREAD_LOCAL
+#elif defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread __attribute__((tls_model("initial-exec")))
+#endif
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -40,15 +54,20 @@ typedef signed long int int32;
 #include "vdp.h"
 #include "render.h"
 #include "tms.h"
+#include "blip.h"
 #include "sn76489.h"
 #include "emu2413.h"
 #include "ym2413.h"
 #include "fmintf.h"
 #include "sound.h"
+#include "profile.h"
+#include "worker.h"
+#include "output.h"
+#include "vdplog.h"
+#include "config.h"
 #include "system.h"
 #include "error.h"
 #include "loadrom.h"
-#include "config.h"
 #include "state.h"
 
 #ifndef NGC
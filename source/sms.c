@@ -23,19 +23,7 @@
  ******************************************************************************/
 
 #include "shared.h"
-
-/* SMS context */
-sms_t sms;
-
-/* BIOS/CART ROM */
-bios_t bios;
-slot_t slot;
-
-/* Colecovision support */
-t_coleco coleco;
-
-uint8 dummy_write[0x400];
-uint8 dummy_read[0x400];
+#include "context.h"
 
 static void writemem_mapper_none(int offset, int data)
 {
@@ -140,14 +140,6 @@ typedef struct {
   uint8 keypad[2];    /* Keypad inputs */
 } t_coleco;
 
-/* Global data */
-extern sms_t sms;
-extern bios_t bios;
-extern slot_t slot;
-extern t_coleco coleco;
-extern uint8 dummy_write[0x400];
-extern uint8 dummy_read[0x400];
-
 /* Function prototypes */
 extern void sms_init(void);
 extern void sms_reset(void);
@@ -0,0 +1,49 @@
+/******************************************************************************
+ *  Sega Master System / GameGear Emulator
+ *  Copyright (C) 1998-2007  Charles MacDonald
+ *
+ *  additionnal code by Eke-Eke (SMS Plus GX)
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *   Band-limited step buffer
+ *
+ ******************************************************************************/
+
+#ifndef _BLIP_H_
+#define _BLIP_H_
+
+#define BLIP_FRAC         16    /* time fraction bits (time is in samples) */
+#define BLIP_PHASE_BITS   5     /* step kernel phases (2^n per sample) */
+#define BLIP_WIDTH        16    /* step kernel width (samples) */
+#define BLIP_UNIT         15    /* step kernel scale (2^n = unit step) */
+
+/* Amplitude changes are added as band-limited steps, then integrated into */
+/* samples once per frame. Output is delayed by about half the kernel width. */
+typedef struct
+{
+  int size;         /* samples read per frame */
+  int integrator;   /* running sum (BLIP_UNIT scale) */
+  int amplitude;    /* sum of all deltas added so far */
+  int *buffer;      /* size + BLIP_WIDTH samples */
+} blip_t;
+
+/* Function prototypes */
+extern blip_t *blip_new(int size);
+extern void blip_delete(blip_t *b);
+extern void blip_add_delta(blip_t *b, unsigned int time, int delta);
+extern void blip_read(blip_t *b, int16 *out, int count);
+
+#endif /* _BLIP_H_ */
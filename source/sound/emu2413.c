@@ -56,6 +56,11 @@
 #define INLINE
 #endif
 
+/* use AVX2 table gathers for melody channels where available */
+#ifndef EMU2413_SIMD
+#define EMU2413_SIMD 1
+#endif
+
 #define OPLL_TONE_NUM 2
 static unsigned char default_inst[OPLL_TONE_NUM][(16+3)*16]=
 {
@@ -149,20 +154,16 @@ static unsigned char default_inst[OPLL_TONE_NUM][(16+3)*16]=
 #define EXPAND_BITS_X(x,s,d) (((x)<<((d)-(s)))|((1<<((d)-(s)))-1))
 
 /* Adjust envelope speed which depends on sampling rate. */
-#define rate_adjust(x) (uint32)((double)(x)*clk/72/rate + 0.5) /* +0.5 to round */
+#define rate_adjust(r,x) (uint32)((double)(x)*(r)->clk/72/(r)->rate + 0.5) /* +0.5 to round */
 
 #define MOD(x) ch[x]->mod
 #define CAR(x) ch[x]->car
 
-/* Sampling rate */
-static uint32 rate ;
-/* Input clock */
-static uint32 clk ;
-
 /* WaveTable for each envelope amp */
-static uint32 fullsintable[PG_WIDTH] ;
-static uint32 halfsintable[PG_WIDTH] ;
-static uint32 snaretable[PG_WIDTH] ;
+static uint32 sintable[3*PG_WIDTH] ;
+#define fullsintable (sintable)
+#define halfsintable (sintable + PG_WIDTH)
+#define snaretable (sintable + 2*PG_WIDTH)
 
 static int32 noiseAtable[64] = {
   -1,1,0,-1,1,0,0,-1,1,0,0,-1,1,0,0,-1,1,0,0,-1,1,0,0,-1,1,0,0,-1,1,0,0,
@@ -175,14 +176,12 @@ static int32 noiseBtable[8] = {
 
 static uint32 *waveform[5] = {fullsintable,halfsintable,snaretable} ;
 
+static void makeBlockRoutine(void) ;
+
 /* LFO Table */
 static int32 pmtable[PM_PG_WIDTH] ;
 static int32 amtable[AM_PG_WIDTH] ;
 
-/* Noise and LFO */
-static uint32 pm_dphase ;
-static uint32 am_dphase ;
-
 /* dB to Liner table */
 static int32 DB2LIN_TABLE[(DB_MUTE + DB_MUTE)*2] ;
 
@@ -199,17 +198,13 @@ static OPLL_PATCH default_patch[OPLL_TONE_NUM][(16+3)*2] ;
 /* Definition of envelope mode */
 enum { SETTLE,ATTACK,DECAY,SUSHOLD,SUSTINE,RELEASE,FINISH } ;
 
-/* Phase incr table for Attack */
-static uint32 dphaseARTable[16][16] ;
-/* Phase incr table for Decay and Release */
-static uint32 dphaseDRTable[16][16] ;
 
 /* KSL + TL Table */
 static uint32 tllTable[16][8][1<<TL_BITS][4] ;
 static int32 rksTable[2][8][2] ;
 
-/* Phase incr table for PG */
-static uint32 dphaseTable[512][8][16] ; 
+/* Constant tables are shared by all OPLL objects */
+static worker_once_t tables_once = WORKER_ONCE_INIT;
 
 /***************************************************
  
@@ -312,7 +307,7 @@ static void makeAmTable(void)
 }
 
 /* Phase increment counter table */ 
-static void makeDphaseTable(void)
+static void makeDphaseTable(OPLL_RATE *r)
 {
   uint32 fnum, block , ML ;
   uint32 mltable[16]={ 1,1*2,2*2,3*2,4*2,5*2,6*2,7*2,8*2,9*2,10*2,10*2,12*2,12*2,15*2,15*2 } ;
@@ -320,7 +315,7 @@ static void makeDphaseTable(void)
   for(fnum=0; fnum<512; fnum++)
     for(block=0; block<8; block++)
       for(ML=0; ML<16; ML++)
-        dphaseTable[fnum][block][ML] = rate_adjust(((fnum * mltable[ML])<<block)>>(20-DP_BITS)) ;
+        r->dphaseTable[fnum][block][ML] = rate_adjust(r, ((fnum * mltable[ML])<<block)>>(20-DP_BITS)) ;
 }
 
 static void makeTllTable(void)
@@ -356,7 +351,7 @@ static void makeTllTable(void)
 }
 
 /* Rate Table for Attack */
-static void makeDphaseARTable(void)
+static void makeDphaseARTable(OPLL_RATE *r)
 {
   int AR,Rks,RM,RL ;
 
@@ -369,20 +364,20 @@ static void makeDphaseARTable(void)
       switch(AR)
       { 
         case 0:
-          dphaseARTable[AR][Rks] = 0 ;
+          r->dphaseARTable[AR][Rks] = 0 ;
           break ;
         case 15:
-          dphaseARTable[AR][Rks] = EG_DP_WIDTH ;
+          r->dphaseARTable[AR][Rks] = EG_DP_WIDTH ;
           break ;
         default:
-          dphaseARTable[AR][Rks] = rate_adjust(( 3 * (RL + 4) << (RM + 1))) ;
+          r->dphaseARTable[AR][Rks] = rate_adjust(r, ( 3 * (RL + 4) << (RM + 1))) ;
           break ;
       }
     }
 }
 
 /* Rate Table for Decay */
-static void makeDphaseDRTable(void)
+static void makeDphaseDRTable(OPLL_RATE *r)
 {
   int DR,Rks,RM,RL ;
 
@@ -395,10 +390,10 @@ static void makeDphaseDRTable(void)
       switch(DR)
       { 
         case 0:
-          dphaseDRTable[DR][Rks] = 0 ;
+          r->dphaseDRTable[DR][Rks] = 0 ;
           break ;
         default:
-          dphaseDRTable[DR][Rks] = rate_adjust((RL + 4) << (RM - 1));
+          r->dphaseDRTable[DR][Rks] = rate_adjust(r, (RL + 4) << (RM - 1));
           break ;
       }
     }
@@ -466,28 +461,29 @@ static void makeDefaultPatch()
 
 INLINE static uint32 calc_eg_dphase(OPLL_SLOT *slot)
 {
+  OPLL_RATE *r = slot->prate ;
 
   switch(slot->eg_mode)
   {
     case ATTACK:
-      return dphaseARTable[slot->patch->AR][slot->rks] ;
+      return r->dphaseARTable[slot->patch->AR][slot->rks] ;
   
     case DECAY:
-      return dphaseDRTable[slot->patch->DR][slot->rks] ;
+      return r->dphaseDRTable[slot->patch->DR][slot->rks] ;
   
     case SUSHOLD:
       return 0 ;
 
     case SUSTINE:
-      return dphaseDRTable[slot->patch->RR][slot->rks] ;
+      return r->dphaseDRTable[slot->patch->RR][slot->rks] ;
   
     case RELEASE:
       if(slot->sustine)
-        return dphaseDRTable[5][slot->rks] ;
+        return r->dphaseDRTable[5][slot->rks] ;
       else if(slot->patch->EG)
-        return dphaseDRTable[slot->patch->RR][slot->rks] ;
+        return r->dphaseDRTable[slot->patch->RR][slot->rks] ;
       else 
-        return dphaseDRTable[7][slot->rks] ;
+        return r->dphaseDRTable[7][slot->rks] ;
 
     case FINISH:
       return 0 ;
@@ -509,7 +505,7 @@ INLINE static uint32 calc_eg_dphase(OPLL_SLOT *slot)
 #define SLOT_TOM 16
 #define SLOT_CYM 17
 
-#define UPDATE_PG(S)  (S)->dphase = dphaseTable[(S)->fnum][(S)->block][(S)->patch->ML]
+#define UPDATE_PG(S)  (S)->dphase = (S)->prate->dphaseTable[(S)->fnum][(S)->block][(S)->patch->ML]
 #define UPDATE_TLL(S)\
 (((S)->type==0)?\
 ((S)->tll = tllTable[((S)->fnum)>>5][(S)->block][(S)->patch->TL][(S)->patch->KL]):\
@@ -768,7 +764,7 @@ static void OPLL_CH_delete(OPLL_CH *ch)
   free(ch) ;
 }
 
-OPLL *OPLL_new(void)
+OPLL *OPLL_new(uint32 c, uint32 r)
 {
   OPLL *opll ;
   OPLL_CH *ch[9] ;
@@ -816,10 +812,13 @@ OPLL *OPLL_new(void)
   {
     opll->slot[i]->plfo_am = &opll->lfo_am ;
     opll->slot[i]->plfo_pm = &opll->lfo_pm ;
+    opll->slot[i]->prate = &opll->rate ;
   }
 
   opll->mask = 0 ;
 
+  OPLL_setClock(opll,c,r) ;
+
   OPLL_reset(opll) ;
   OPLL_reset_patch(opll,0) ;
 
@@ -886,18 +885,20 @@ void OPLL_reset(OPLL *opll)
 
 }
 
-void OPLL_setClock(uint32 c, uint32 r)
+void OPLL_setClock(OPLL *opll, uint32 c, uint32 r)
 {
-  clk = c ;
-  rate = r ;
-  makeDphaseTable() ;
-  makeDphaseARTable() ;
-  makeDphaseDRTable() ;
-  pm_dphase = (uint32)rate_adjust(PM_SPEED * PM_DP_WIDTH / (clk/72) ) ;
-  am_dphase = (uint32)rate_adjust(AM_SPEED * AM_DP_WIDTH / (clk/72) ) ;
+  OPLL_RATE *rt = &opll->rate ;
+
+  rt->clk = c ;
+  rt->rate = r ;
+  makeDphaseTable(rt) ;
+  makeDphaseARTable(rt) ;
+  makeDphaseDRTable(rt) ;
+  rt->pm_dphase = (uint32)rate_adjust(rt, PM_SPEED * PM_DP_WIDTH / (c/72) ) ;
+  rt->am_dphase = (uint32)rate_adjust(rt, AM_SPEED * AM_DP_WIDTH / (c/72) ) ;
 }
 
-void OPLL_init(uint32 c, uint32 r)
+static void makeTables(void)
 {
   makePmTable() ;
   makeAmTable() ;
@@ -907,7 +908,12 @@ void OPLL_init(uint32 c, uint32 r)
   makeRksTable() ;
   makeSinTable() ;
   makeDefaultPatch() ;
-  OPLL_setClock(c,r) ;
+  makeBlockRoutine() ;
+}
+
+void OPLL_init(void)
+{
+  worker_once(&tables_once, makeTables) ;
 }
 
 void OPLL_close(void)
@@ -998,8 +1004,8 @@ INLINE static void update_noise(OPLL *opll)
 /* Update AM, PM unit */
 INLINE static void update_ampm(OPLL *opll)
 {
-  opll->pm_phase = (opll->pm_phase + pm_dphase)&(PM_DP_WIDTH - 1) ;
-  opll->am_phase = (opll->am_phase + am_dphase)&(AM_DP_WIDTH - 1) ;
+  opll->pm_phase = (opll->pm_phase + opll->rate.pm_dphase)&(PM_DP_WIDTH - 1) ;
+  opll->am_phase = (opll->am_phase + opll->rate.am_dphase)&(AM_DP_WIDTH - 1) ;
   opll->lfo_am = amtable[HIGHBITS(opll->am_phase, AM_DP_BITS - AM_PG_BITS)] ;
   opll->lfo_pm = pmtable[HIGHBITS(opll->pm_phase, PM_DP_BITS - PM_PG_BITS)] ;
 }
@@ -1017,8 +1023,8 @@ INLINE static uint32 calc_phase(OPLL_SLOT *slot)
   return HIGHBITS(slot->phase, DP_BASE_BITS) ;
 }
 
-/* EG */
-INLINE static uint32 calc_envelope(OPLL_SLOT *slot)
+/* EG, before total level and AM */
+INLINE static uint32 calc_eg(OPLL_SLOT *slot)
 {
   #define S2E(x) (SL2EG((int)(x/SL_STEP))<<(EG_DP_BITS-EG_BITS)) 
   static uint32 SL[16] = {
@@ -1033,7 +1039,7 @@ INLINE static uint32 calc_envelope(OPLL_SLOT *slot)
 
     case ATTACK:
       slot->eg_phase += slot->eg_dphase ;
-      if(EG_DP_WIDTH & slot->eg_phase)
+      if(slot->eg_phase >= EG_DP_WIDTH)
       {
         egout = 0 ;
         slot->eg_phase= 0 ;
@@ -1096,6 +1102,14 @@ INLINE static uint32 calc_envelope(OPLL_SLOT *slot)
       break;
   }
 
+  return egout ;
+}
+
+/* EG */
+INLINE static uint32 calc_envelope(OPLL_SLOT *slot)
+{
+  uint32 egout = calc_eg(slot) ;
+
   if(slot->patch->AM) egout = EG2DB(egout+slot->tll) + *(slot->plfo_am) ;
   else egout = EG2DB(egout+slot->tll)  ;
 
@@ -1553,18 +1567,455 @@ void OPLL_writeIO(OPLL *opll, uint32 adr, uint32 val)
 
 void OPLL_write(OPLL *opll, int offset, int data)
 {
-    static uint8 latch = 0;
-
     if(offset & 1)
-        OPLL_writeReg(opll, latch, data);
+        OPLL_writeReg(opll, opll->adr, data);
     else
-        latch = data;
+        opll->adr = data;
+}
+
+/* Slot envelope is at rest: its output is muted until next key on */
+#define SLOT_SILENT(slot) (((slot)->eg_mode == SETTLE) || ((slot)->eg_mode == FINISH))
+
+/* Slots calculated by OPLL_update for the current channel mode and mask */
+static int OPLL_activeSlots(OPLL *opll, OPLL_SLOT **slot, int *shift)
+{
+  int i, n = 0 ;
+
+  for(i = 0 ; i < (opll->rythm_mode ? 7 : 9) ; i++)
+  {
+    if(opll->mask&((i == 6 && opll->rythm_mode) ? OPLL_MASK_BD : OPLL_MASK_CH(i))) continue ;
+    if(opll->CAR(i)->eg_mode == FINISH) continue ;
+    shift[n] = 1 ; slot[n++] = opll->MOD(i) ;
+    shift[n] = 0 ; slot[n++] = opll->CAR(i) ;
+  }
+
+  if(opll->rythm_mode)
+  {
+    shift[n] = 0 ; slot[n++] = opll->MOD(7) ;
+    shift[n] = 0 ; slot[n++] = opll->CAR(8) ;
+    if(!(opll->mask&OPLL_MASK_SD)&&(opll->CAR(7)->eg_mode!=FINISH))
+    {
+      shift[n] = 0 ; slot[n++] = opll->CAR(7) ;
+    }
+    if(!(opll->mask&OPLL_MASK_TOM)&&(opll->MOD(8)->eg_mode!=FINISH))
+    {
+      shift[n] = 0 ; slot[n++] = opll->MOD(8) ;
+    }
+  }
+
+  return n ;
+}
+
+/* Every calculated slot is silent: the chip outputs nothing until next key on */
+static int OPLL_idle(OPLL *opll)
+{
+  int i ;
+
+  for(i = 0 ; i < (opll->rythm_mode ? 7 : 9) ; i++)
+  {
+    if(opll->mask&((i == 6 && opll->rythm_mode) ? OPLL_MASK_BD : OPLL_MASK_CH(i))) continue ;
+    if(opll->CAR(i)->eg_mode == FINISH) continue ;
+    if(!SLOT_SILENT(opll->CAR(i)) || !SLOT_SILENT(opll->MOD(i))) return 0 ;
+  }
+
+  if(opll->rythm_mode)
+  {
+    if(!(opll->mask&OPLL_MASK_HH)&&!SLOT_SILENT(opll->MOD(7))) return 0 ;
+    if(!(opll->mask&OPLL_MASK_SD)&&!SLOT_SILENT(opll->CAR(7))) return 0 ;
+    if(!(opll->mask&OPLL_MASK_TOM)&&!SLOT_SILENT(opll->MOD(8))) return 0 ;
+    if(!(opll->mask&OPLL_MASK_CYM)&&!SLOT_SILENT(opll->CAR(8))) return 0 ;
+  }
+
+  return 1 ;
+}
+
+/* Advance an idle chip by length samples, leaving it in the same state as OPLL_update */
+static void OPLL_skip(OPLL *opll, int length)
+{
+  OPLL_SLOT *slot[18] ;
+  int shift[18] ;
+  uint32 run, left ;
+  int i, j, n ;
+
+  /* Noise */
+  for(j = 0 ; j < length ; j++)
+    update_noise(opll) ;
+
+  /* AM */
+  opll->am_phase = (opll->am_phase + opll->rate.am_dphase * (uint32)length)&(AM_DP_WIDTH - 1) ;
+  opll->lfo_am = amtable[HIGHBITS(opll->am_phase, AM_DP_BITS - AM_PG_BITS)] ;
+
+  /* Silent modulators shift zeroes into their output */
+  n = OPLL_activeSlots(opll, slot, shift) ;
+  for(i = 0 ; i < n ; i++)
+  {
+    if(shift[i])
+    {
+      slot[i]->output[1] = (length > 1) ? 0 : slot[i]->output[0] ;
+      slot[i]->output[0] = 0 ;
+      slot[i]->feedback = slot[i]->output[1] >> 1 ;
+    }
+  }
+
+  /* PG, by runs of samples with the same PM value */
+  while(length > 0)
+  {
+    opll->pm_phase = (opll->pm_phase + opll->rate.pm_dphase)&(PM_DP_WIDTH - 1) ;
+    opll->lfo_pm = pmtable[HIGHBITS(opll->pm_phase, PM_DP_BITS - PM_PG_BITS)] ;
+
+    run = length ;
+    if(opll->rate.pm_dphase)
+    {
+      left = ((~opll->pm_phase)&((1<<(PM_DP_BITS - PM_PG_BITS)) - 1)) / opll->rate.pm_dphase + 1 ;
+      if(left < run) run = left ;
+    }
+    opll->pm_phase = (opll->pm_phase + opll->rate.pm_dphase * (run - 1))&(PM_DP_WIDTH - 1) ;
+
+    for(i = 0 ; i < n ; i++)
+    {
+      if(slot[i]->patch->PM)
+        slot[i]->phase += ((slot[i]->dphase * opll->lfo_pm) >> PM_AMP_BITS) * run ;
+      else
+        slot[i]->phase += slot[i]->dphase * run ;
+      slot[i]->phase &= (DP_WIDTH - 1) ;
+      slot[i]->pgout = HIGHBITS(slot[i]->phase, DP_BASE_BITS) ;
+    }
+
+    length -= run ;
+  }
+}
+
+/* Melody channels are calculated in blocks, one lane per channel */
+#define OPLL_BLOCK_LEN 32
+
+typedef struct
+{
+  uint32 eg[2][OPLL_BLOCK_LEN][9] ;  /* slot EG output at each sample */
+  int32 am[OPLL_BLOCK_LEN] ;          /* LFO output at each sample */
+  int32 pm[OPLL_BLOCK_LEN] ;
+  uint32 tll[2][9] ;                  /* slot total level */
+  int32 am_mask[2][9] ;               /* slot AM and PM enable */
+  int32 pm_mask[2][9] ;
+  uint32 dphase[2][9] ;               /* slot phase */
+  uint32 phase[2][9] ;
+  int32 wave[2][9] ;                  /* slot waveform (offset in sintable) */
+  int32 fb[9] ;                       /* modulator feedback */
+  int32 output[2][9] ;                /* modulator output history */
+  int32 feedback[9] ;
+  int32 active[9] ;                   /* number of calculated samples */
+  int32 out[OPLL_BLOCK_LEN] ;         /* mixed channels output */
+} OPLL_BLOCK ;
+
+/* Same as calc_envelope() for one slot and sample of a block */
+INLINE static uint32 calc_block_envelope(OPLL_BLOCK *b, int k, int i, int j)
+{
+  uint32 egout = EG2DB(b->eg[k][j][i]+b->tll[k][i]) + (b->am[j] & b->am_mask[k][i]) ;
+
+  if(egout >= DB_MUTE) egout = DB_MUTE-1;
+  return egout ;
+}
+
+/* Same as calc_phase() for one slot and sample of a block */
+INLINE static uint32 calc_block_phase(OPLL_BLOCK *b, int k, int i, int j)
+{
+  if(b->pm_mask[k][i])
+    b->phase[k][i] += (b->dphase[k][i] * b->pm[j]) >> PM_AMP_BITS ;
+  else
+    b->phase[k][i] += b->dphase[k][i] ;
+
+  b->phase[k][i] &= (DP_WIDTH - 1) ;
+
+  return HIGHBITS(b->phase[k][i], DP_BASE_BITS) ;
+}
+
+/* Same as calc_slot_car(calc_slot_mod()) for one channel and sample of a block */
+INLINE static int32 calc_block_slot(OPLL_BLOCK *b, int i, int j)
+{
+  uint32 egout, pgout ;
+  int32 fm ;
+
+  /* modulator */
+  b->output[1][i] = b->output[0][i] ;
+  egout = calc_block_envelope(b, 0, i, j) ;
+  pgout = calc_block_phase(b, 0, i, j) ;
+
+  if(egout>=(DB_MUTE-1))
+  {
+    b->output[0][i] = 0 ;
+  }
+  else if(b->fb[i]!=0)
+  {
+    fm = wave2_4pi(b->feedback[i]) >> (7 - b->fb[i]) ;
+    b->output[0][i] = DB2LIN_TABLE[sintable[b->wave[0][i] + ((pgout+fm)&(PG_WIDTH-1))] + egout] ;
+  }
+  else
+  {
+    b->output[0][i] = DB2LIN_TABLE[sintable[b->wave[0][i] + pgout] + egout] ;
+  }
+
+  b->feedback[i] = (b->output[1][i] + b->output[0][i])>>1 ;
+
+  /* carrier */
+  egout = calc_block_envelope(b, 1, i, j) ;
+  pgout = calc_block_phase(b, 1, i, j) ;
+
+  if(egout>=(DB_MUTE-1)) return 0 ;
+
+  return DB2LIN_TABLE[sintable[b->wave[1][i] + ((pgout+wave2_8pi(b->feedback[i]))&(PG_WIDTH-1))] + egout] ;
+}
+
+static void calc_block_c(OPLL_BLOCK *b, int length)
+{
+  int i, j ;
+
+  for(j = 0 ; j < length ; j++)
+  {
+    for(i = 0 ; i < 9 ; i++)
+    {
+      if(j < b->active[i])
+        b->out[j] += calc_block_slot(b, i, j) ;
+    }
+  }
+}
+
+/* AVX2 table gathers for channels 0-7 (picked at runtime) */
+#if EMU2413_SIMD && defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define EMU2413_AVX2
+
+#define LOAD(x) _mm256_loadu_si256((const __m256i *)(x))
+
+__attribute__((target("avx2")))
+static void calc_block_avx2(OPLL_BLOCK *b, int length)
+{
+  const __m256i dp_mask = _mm256_set1_epi32(DP_WIDTH-1) ;
+  const __m256i pg_mask = _mm256_set1_epi32(PG_WIDTH-1) ;
+  const __m256i db_mute = _mm256_set1_epi32(DB_MUTE-1) ;
+  const __m256i zero = _mm256_setzero_si256() ;
+  const __m256i fb = LOAD(b->fb) ;
+  const __m256i fb_on = _mm256_xor_si256(_mm256_cmpeq_epi32(fb, zero), _mm256_set1_epi32(-1)) ;
+  const __m256i fb_shift = _mm256_and_si256(_mm256_sub_epi32(_mm256_set1_epi32(7), fb), fb_on) ;
+  const __m256i active = LOAD(b->active) ;
+  __m256i phase[2], out0, out1, feedback ;
+  __m256i act, am, pm, egout, idx, out, fm ;
+  __m128i sum ;
+  int j, k ;
+
+  phase[0] = LOAD(b->phase[0]) ;
+  phase[1] = LOAD(b->phase[1]) ;
+  out0 = LOAD(b->output[0]) ;
+  out1 = LOAD(b->output[1]) ;
+  feedback = LOAD(b->feedback) ;
+
+  for(j = 0 ; j < length ; j++)
+  {
+    /* channel 8 */
+    if(j < b->active[8])
+      b->out[j] += calc_block_slot(b, 8, j) ;
+
+    act = _mm256_cmpgt_epi32(active, _mm256_set1_epi32(j)) ;
+    am = _mm256_set1_epi32(b->am[j]) ;
+    pm = _mm256_set1_epi32(b->pm[j]) ;
+
+    for(k = 0 ; k < 2 ; k++)
+    {
+      /* EG with total level and AM (EG2DB is 1:1) */
+      egout = _mm256_add_epi32(_mm256_add_epi32(LOAD(b->eg[k][j]), LOAD(b->tll[k])),
+                               _mm256_and_si256(am, LOAD(b->am_mask[k]))) ;
+      egout = _mm256_min_epu32(egout, db_mute) ;
+
+      /* PG with PM */
+      idx = _mm256_blendv_epi8(LOAD(b->dphase[k]),
+                               _mm256_srli_epi32(_mm256_mullo_epi32(LOAD(b->dphase[k]), pm), PM_AMP_BITS),
+                               LOAD(b->pm_mask[k])) ;
+      phase[k] = _mm256_blendv_epi8(phase[k], _mm256_and_si256(_mm256_add_epi32(phase[k], idx), dp_mask), act) ;
+      idx = _mm256_srli_epi32(phase[k], DP_BASE_BITS) ;
+
+      if(k == 0)
+      {
+        /* modulator */
+        fm = _mm256_and_si256(_mm256_srav_epi32(feedback, fb_shift), fb_on) ;
+        idx = _mm256_add_epi32(_mm256_and_si256(_mm256_add_epi32(idx, fm), pg_mask), LOAD(b->wave[0])) ;
+        idx = _mm256_add_epi32(_mm256_i32gather_epi32((const int *)sintable, idx, 4), egout) ;
+        out = _mm256_mask_i32gather_epi32(zero, DB2LIN_TABLE, idx,
+                                          _mm256_and_si256(act, _mm256_cmpgt_epi32(db_mute, egout)), 4) ;
+
+        out1 = _mm256_blendv_epi8(out1, out0, act) ;
+        out0 = _mm256_blendv_epi8(out0, out, act) ;
+        feedback = _mm256_blendv_epi8(feedback, _mm256_srai_epi32(_mm256_add_epi32(out1, out0), 1), act) ;
+      }
+      else
+      {
+        /* carrier */
+        fm = _mm256_slli_epi32(feedback, 1) ;
+        idx = _mm256_add_epi32(_mm256_and_si256(_mm256_add_epi32(idx, fm), pg_mask), LOAD(b->wave[1])) ;
+        idx = _mm256_add_epi32(_mm256_i32gather_epi32((const int *)sintable, idx, 4), egout) ;
+        out = _mm256_mask_i32gather_epi32(zero, DB2LIN_TABLE, idx,
+                                          _mm256_and_si256(act, _mm256_cmpgt_epi32(db_mute, egout)), 4) ;
+      }
+    }
+
+    /* mix channels */
+    sum = _mm_add_epi32(_mm256_castsi256_si128(out), _mm256_extracti128_si256(out, 1)) ;
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e)) ;
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1)) ;
+    b->out[j] += _mm_cvtsi128_si32(sum) ;
+  }
+
+  /* lane 8 is kept by calc_block_slot() */
+  _mm256_storeu_si256((__m256i *)b->phase[0], phase[0]) ;
+  _mm256_storeu_si256((__m256i *)b->phase[1], phase[1]) ;
+  _mm256_storeu_si256((__m256i *)b->output[0], out0) ;
+  _mm256_storeu_si256((__m256i *)b->output[1], out1) ;
+  _mm256_storeu_si256((__m256i *)b->feedback, feedback) ;
+}
+
+#undef LOAD
+#endif
+
+static void (*calc_block)(OPLL_BLOCK *b, int length) = calc_block_c ;
+
+/* Pick melody channels block routine */
+static void makeBlockRoutine(void)
+{
+#ifdef EMU2413_AVX2
+  if(__builtin_cpu_supports("avx2"))
+    calc_block = calc_block_avx2 ;
+#endif
+}
+
+/* Generate melody mode samples by blocks: envelope generators run ahead for
+   each channel, then all channels are calculated at once */
+static void OPLL_updateMelody(OPLL *opll, int16 **buffer, int length)
+{
+  OPLL_BLOCK b ;
+  OPLL_SLOT *slot[2] ;
+  int32 inst ;
+  int i, j, k, n, pos = 0 ;
+
+  for(i = 0 ; i < 9 ; i++)
+  {
+    slot[0] = opll->MOD(i) ;
+    slot[1] = opll->CAR(i) ;
+
+    for(k = 0 ; k < 2 ; k++)
+    {
+      b.tll[k][i] = slot[k]->tll ;
+      b.am_mask[k][i] = slot[k]->patch->AM ? -1 : 0 ;
+      b.pm_mask[k][i] = slot[k]->patch->PM ? -1 : 0 ;
+      b.dphase[k][i] = slot[k]->dphase ;
+      b.phase[k][i] = slot[k]->phase ;
+      b.wave[k][i] = slot[k]->sintbl - sintable ;
+    }
+
+    b.fb[i] = slot[0]->patch->FB ;
+    b.output[0][i] = slot[0]->output[0] ;
+    b.output[1][i] = slot[0]->output[1] ;
+    b.feedback[i] = slot[0]->feedback ;
+  }
+
+  while(length > 0)
+  {
+    n = (length < OPLL_BLOCK_LEN) ? length : OPLL_BLOCK_LEN ;
+
+    /* AM, PM and noise */
+    for(j = 0 ; j < n ; j++)
+    {
+      update_ampm(opll) ;
+      update_noise(opll) ;
+      b.am[j] = opll->lfo_am ;
+      b.pm[j] = opll->lfo_pm ;
+    }
+
+    /* EG of each channel until its carrier finishes */
+    for(i = 0 ; i < 9 ; i++)
+    {
+      slot[0] = opll->MOD(i) ;
+      slot[1] = opll->CAR(i) ;
+
+      j = 0 ;
+      if(!(opll->mask&OPLL_MASK_CH(i)))
+      {
+        for(; (j < n) && (slot[1]->eg_mode != FINISH) ; j++)
+        {
+          b.eg[0][j][i] = calc_eg(slot[0]) ;
+          b.eg[1][j][i] = calc_eg(slot[1]) ;
+        }
+      }
+      b.active[i] = j ;
+
+      /* samples after the end are muted */
+      for(; j < n ; j++)
+        b.eg[0][j][i] = b.eg[1][j][i] = (1<<EG_BITS) - 1 ;
+    }
+
+    /* Output */
+    memset(b.out, 0, n * sizeof(int32)) ;
+    calc_block(&b, n) ;
+
+    for(j = 0 ; j < n ; j++, pos++)
+    {
+#if SLOT_AMP_BITS > 8
+      inst = (b.out[j] >> (SLOT_AMP_BITS - 8)) ;
+#else
+      inst = (b.out[j] << (8 - SLOT_AMP_BITS)) ;
+#endif
+      inst = (inst * opll->masterVolume) >> 1 ;
+
+      if(inst>32767) inst = 32767 ;
+      if(inst<-32768) inst = -32768 ;
+
+      buffer[0][pos] = (int16)inst ;
+      buffer[1][pos] = 0 ;
+    }
+
+    /* last calculated slot outputs */
+    for(i = 0 ; i < 9 ; i++)
+    {
+      if(b.active[i])
+      {
+        for(k = 0 ; k < 2 ; k++)
+        {
+          slot[k] = k ? opll->CAR(i) : opll->MOD(i) ;
+          slot[k]->egout = calc_block_envelope(&b, k, i, b.active[i] - 1) ;
+          slot[k]->pgout = HIGHBITS(b.phase[k][i], DP_BASE_BITS) ;
+        }
+      }
+    }
+
+    length -= n ;
+  }
+
+  for(i = 0 ; i < 9 ; i++)
+  {
+    opll->MOD(i)->phase = b.phase[0][i] ;
+    opll->CAR(i)->phase = b.phase[1][i] ;
+    opll->MOD(i)->output[0] = b.output[0][i] ;
+    opll->MOD(i)->output[1] = b.output[1][i] ;
+    opll->MOD(i)->feedback = b.feedback[i] ;
+  }
 }
 
 void OPLL_update(OPLL *opll, int16 **buffer, int length)
 {
     int j;
 
+    /* Silent chip: skip sound generation */
+    if(OPLL_idle(opll))
+    {
+      memset(buffer[0], 0, length * sizeof(int16)) ;
+      memset(buffer[1], 0, length * sizeof(int16)) ;
+      OPLL_skip(opll, length) ;
+      return ;
+    }
+
+    /* Melody mode: block processing */
+    if(!opll->rythm_mode)
+    {
+      OPLL_updateMelody(opll, buffer, length) ;
+      return ;
+    }
+
     for(j = 0; j < length; j++)
     {
       int32 instout = 0, percout = 0 ;
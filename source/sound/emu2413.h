@@ -31,6 +31,21 @@ typedef struct {
   unsigned int TL,FB,EG,ML,AR,DR,SL,RR,KR,KL,AM,PM,WF ;
 } OPLL_PATCH ;
 
+/* tables depending on input clock and sampling rate */
+typedef struct {
+
+  uint32 clk ;
+  uint32 rate ;
+
+  uint32 dphaseARTable[16][16] ;  /* Phase incr table for Attack */
+  uint32 dphaseDRTable[16][16] ;  /* Phase incr table for Decay and Release */
+  uint32 dphaseTable[512][8][16] ;  /* Phase incr table for PG */
+
+  uint32 pm_dphase ;  /* Pitch and Amp modulator */
+  uint32 am_dphase ;
+
+} OPLL_RATE ;
+
 /* slot */
 typedef struct {
 
@@ -64,6 +79,7 @@ typedef struct {
   /* refer to opll-> */
   int32 *plfo_pm ;
   int32 *plfo_am ;
+  OPLL_RATE *prate ;
 
 
 } OPLL_SLOT ;
@@ -132,21 +148,23 @@ typedef struct {
   uint32 mask ;
 
   int masterVolume ; /* 0min -- 64 -- 127 max (Liner) */
+
+  OPLL_RATE rate ;
   
 } OPLL ;
 
 /* Initialize */
-EMU2413_API void OPLL_init(uint32 clk, uint32 rate) ;
+EMU2413_API void OPLL_init(void) ;
 EMU2413_API void OPLL_close(void) ;
 
 /* Create Object */
-EMU2413_API OPLL *OPLL_new(void) ;
+EMU2413_API OPLL *OPLL_new(uint32 clk, uint32 rate) ;
 EMU2413_API void OPLL_delete(OPLL *) ;
 
 /* Setup */
 EMU2413_API void OPLL_reset(OPLL *) ;
 EMU2413_API void OPLL_reset_patch(OPLL *, int) ;
-EMU2413_API void OPLL_setClock(uint32 c, uint32 r) ;
+EMU2413_API void OPLL_setClock(OPLL *, uint32 c, uint32 r) ;
 
 /* Port/Register access */
 EMU2413_API void OPLL_writeIO(OPLL *, uint32 reg, uint32 val) ;
@@ -4,16 +4,19 @@
 */
 #include "shared.h"
 
-static OPLL *opll;
-FM_Context fm_context;
+/* FM sound unit (current machine) */
+#define opll        (machine->fm.opll)
+#define fm_context  (machine->fm.context)
 
 void FM_Init(void)
 {
   switch(snd.fm_which)
   {
     case SND_EMU2413:
-      OPLL_init(snd.fm_clock, snd.sample_rate);
-      opll = OPLL_new();
+      /* EMU2413 constant tables are shared by all machine contexts, */
+      /* clock and rate dependent ones belong to each OPLL object     */
+      OPLL_init();
+      opll = OPLL_new(snd.fm_clock, snd.sample_rate);
       OPLL_reset(opll);
       OPLL_reset_patch(opll, 0);
       break;
@@ -13,6 +13,14 @@ typedef struct {
   uint8 reg[0x40];
 } FM_Context;
 
+/* FM sound unit */
+typedef struct {
+  FM_Context context;               /* YM2413 registers */
+  OPLL *opll;                       /* EMU2413 instance */
+  void *ym2413[MAX_OPLL_CHIPS];     /* YM2413 instances */
+  int ym2413_num;
+} fm_t;
+
 /* Function prototypes */
 void FM_Init(void);
 void FM_Shutdown(void);
@@ -18,6 +18,9 @@
   - Added context management routines.
   - Removed SN76489_GetValues().
   - Removed some unused variables.
+
+  Fixed-point rendering by runs of samples, channel by channel.
+  Band-limited step synthesis at the PSG clock rate (SN76489_BlipRun).
 */
 
 #include "shared.h"
@@ -25,6 +28,26 @@
 #define NoiseInitialState   0x8000  /* Initial state of shift register */
 #define PSG_CUTOFF          0x6     /* Value below which PSG does not output */
 
+/* Clock fractional bits (same resolution as a float clock from 8 to 48kHz) */
+#define CLOCK_FRAC          21
+#define CLOCK_MASK          ((1 << CLOCK_FRAC) - 1)
+
+/* Number of samples rendered at once */
+#define PSG_BLOCK           256
+
+/* use SSE2 or NEON vector instructions where available */
+#ifndef PSG_SIMD
+#define PSG_SIMD 1
+#endif
+
+#if PSG_SIMD && defined(__SSE2__)
+#include <emmintrin.h>
+#define PSG_SSE2
+#elif PSG_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define PSG_NEON
+#endif
+
 static const int PSGVolumeValues[2][16] = {
 /* These values are taken from a real SMS2's output */
   {892,892,892,760,623,497,404,323,257,198,159,123,96,75,60,0}, 
@@ -32,15 +55,22 @@ static const int PSGVolumeValues[2][16] = {
   {1516,1205,957,760,603,479,381,303,240,191,152,120,96,76,60,0}
 };
 
-static SN76489_Context SN76489[MAX_SN76489];
+/* PSG contexts (current machine) */
+#define SN76489 (machine->psg)
 
 void SN76489_Init(int which, int PSGClockValue, int SamplingRate)
 {
-  SN76489_Context *p = &SN76489[which];
-  p->dClock=(float)PSGClockValue/16/SamplingRate;
+  SN76489_SetClock(which, PSGClockValue, SamplingRate);
   SN76489_Reset(which);
 }
 
+void SN76489_SetClock(int which, int PSGClockValue, int SamplingRate)
+{
+  SN76489_Context *p = &SN76489[which];
+  /* PSG clocks (input clock / 16) per sample, rounded to CLOCK_FRAC bits */
+  p->dClock=(UINT32)((((UINT64)PSGClockValue << (CLOCK_FRAC - 3)) / SamplingRate + 1) >> 1);
+}
+
 void SN76489_Reset(int which)
 {
   SN76489_Context *p = &SN76489[which];
@@ -62,7 +92,7 @@ void SN76489_Reset(int which)
     p->ToneFreqPos[i] = 1;
 
     /* Set intermediate positions to do-not-use value */
-    p->IntermediatePos[i] = LONG_MIN;
+    p->IntermediatePos[i] = INT_MIN;
   }
 
   p->LatchedRegister=0;
@@ -72,6 +102,8 @@ void SN76489_Reset(int which)
 
   /* Zero clock */
   p->Clock=0;
+  p->ClockTicks=0;
+  p->Position=0;
 
 }
 
@@ -109,6 +141,53 @@ int SN76489_GetContextSize(void)
   return sizeof(SN76489_Context);
 }
 
+/* Save state fields, in the order of the version 1.4 context. Clocks per sample */
+/* depend on the sample rate: call SN76489_SetClock() once a state is loaded     */
+#define PSG_STATE_FIELDS \
+  FIELD(Mute) FIELD(BoostNoise) FIELD(VolumeArray) FIELD(Clock) FIELD(dClock) \
+  FIELD(PSGStereo) FIELD(NumClocksForSample) FIELD(WhiteNoiseFeedback) \
+  FIELD(Registers) FIELD(LatchedRegister) FIELD(NoiseShiftRegister) FIELD(NoiseFreq) \
+  FIELD(ToneFreqVals) FIELD(ToneFreqPos) FIELD(Channels) FIELD(IntermediatePos)
+
+int SN76489_SaveState(int which, uint8 *data)
+{
+  SN76489_Context *p = &SN76489[which];
+  int size = 0;
+
+#define FIELD(x) memcpy(&data[size], &p->x, sizeof(p->x)); size += sizeof(p->x);
+  PSG_STATE_FIELDS
+#undef FIELD
+
+  return size;
+}
+
+int SN76489_LoadState(int which, uint8 *data, int version)
+{
+  SN76489_Context *p = &SN76489[which];
+  int size = 0;
+
+#define FIELD(x) memcpy(&p->x, &data[size], sizeof(p->x)); size += sizeof(p->x);
+  PSG_STATE_FIELDS
+#undef FIELD
+
+  /* version 1.4 states hold the clock fraction as a float */
+  if (version < 0x0105)
+  {
+    float clock;
+    memcpy(&clock, &p->Clock, sizeof(clock));
+    p->Clock = ((clock > 0.0f) && (clock < 1.0f)) ? (UINT32)(clock * (1 << CLOCK_FRAC)) : 0;
+  }
+
+  /* restored fraction is always below one clock */
+  p->Clock &= CLOCK_MASK;
+
+  /* band-limited synthesis counters are not saved: restart at frame start */
+  p->ClockTicks = 0;
+  p->Position = 0;
+
+  return size;
+}
+
 void SN76489_Write(int which, int data)
 {
   SN76489_Context *p = &SN76489[which];
@@ -149,101 +228,399 @@ void SN76489_GGStereoWrite(int which, int data)
   p->PSGStereo=data;
 }
 
+/* Render one tone channel for a run of samples */
+static void SN76489_RunTone(SN76489_Context *p, int i, const int *clocks, const UINT32 *phase, INT16 *out, INT16 *sync, int length)
+{
+  int freq = p->Registers[2*i];
+  int vol = (p->Mute >> i & 0x1) * PSGVolumeValues[p->VolumeArray][p->Registers[2*i+1]];
+  int count = p->ToneFreqVals[i];
+  int pos = p->ToneFreqPos[i];
+  int edge = p->IntermediatePos[i];
+  int value = (edge != INT_MIN) ? vol * edge / 65536 : vol * pos;
+  int j;
+
+  for (j = 0; j < length; j++)
+  {
+    out[j] = value;
+
+    /* Decrement counter (noise channel may follow tone2 counter) */
+    count -= clocks[j];
+    if (sync) sync[j] = count;
+
+    if (count <= 0) {
+      if (freq > PSG_CUTOFF) {
+        /* Calculate how much of the sample is + and how much is -, including the clock fraction */
+        INT32 num = (clocks[j] + 2 * count) * (1 << CLOCK_FRAC) - (INT32)phase[j];
+        INT32 den = (clocks[j] << CLOCK_FRAC) + (INT32)phase[j];
+        edge = (int)((INT64)num * pos * 65536 / den);
+        pos = -pos; /* Flip the flip-flop */
+        value = vol * edge / 65536;
+      } else {
+        pos = 1;  /* stuck value */
+        edge = INT_MIN;
+        value = vol;
+      }
+      count += freq * (clocks[j] / freq + 1);
+    } else {
+      edge = INT_MIN;
+      value = vol * pos;
+    }
+  }
+
+  p->ToneFreqVals[i] = count;
+  p->ToneFreqPos[i] = pos;
+  p->IntermediatePos[i] = edge;
+  p->Channels[i] = out[length - 1];
+}
+
+/* Clock noise shift register once */
+static int SN76489_Shift(SN76489_Context *p, int shift)
+{
+  int Feedback;
+
+  if (p->Registers[6]&0x4) { /* White noise */
+    /* Calculate parity of fed-back bits for feedback */
+    switch (p->WhiteNoiseFeedback) {
+      /* Do some optimised calculations for common (known) feedback values */
+    case 0x0006:  /* SC-3000    %00000110 */
+    case 0x0009:  /* SMS, GG, MD  %00001001 */
+      /* If two bits fed back, I can do Feedback=(nsr & fb) && (nsr & fb ^ fb) */
+      /* since that's (one or more bits set) && (not all bits set) */
+      Feedback=((shift&p->WhiteNoiseFeedback) && ((shift&p->WhiteNoiseFeedback)^p->WhiteNoiseFeedback));
+      break;
+    case 0x8005:  /* BBC Micro */
+      /* fall through :P can't be bothered to think too much */
+    default:    /* Default handler for all other feedback values */
+      Feedback=shift&p->WhiteNoiseFeedback;
+      Feedback^=Feedback>>8;
+      Feedback^=Feedback>>4;
+      Feedback^=Feedback>>2;
+      Feedback^=Feedback>>1;
+      Feedback&=1;
+      break;
+    }
+  } else    /* Periodic noise */
+    Feedback=shift&1;
+
+  return (shift>>1) | (Feedback<<15);
+}
+
+/* Render noise channel for a run of samples */
+static void SN76489_RunNoise(SN76489_Context *p, const int *clocks, const INT16 *sync, INT16 *out, int length)
+{
+  int freq = p->NoiseFreq;
+  int vol = (p->Mute >> 3 & 0x1) * PSGVolumeValues[p->VolumeArray][p->Registers[7]];
+  int count = p->ToneFreqVals[3];
+  int pos = p->ToneFreqPos[3];
+  int shift = p->NoiseShiftRegister;
+  int j;
+
+  if (p->BoostNoise) vol <<= 1; /* Double noise volume to make some people happy */
+
+  for (j = 0; j < length; j++)
+  {
+    out[j] = vol & -(shift & 0x1);
+
+    /* Match to tone2 or decrement its counter */
+    if (sync) count = sync[j];
+    else count -= clocks[j];
+
+    if (count <= 0) {
+      pos = -pos; /* Flip the flip-flop */
+      if (!sync)
+        count += freq * (clocks[j] / freq + 1);
+      if (pos == 1) /* Only once per cycle... */
+        shift = SN76489_Shift(p, shift);
+    }
+  }
+
+  p->ToneFreqVals[3] = count;
+  p->ToneFreqPos[3] = pos;
+  p->NoiseShiftRegister = shift;
+  p->Channels[3] = out[length - 1];
+}
+
+/* Sum the four channels into left and right outputs */
+static void SN76489_Mix(INT16 **buffer, INT16 channel[4][PSG_BLOCK], int stereo, int length)
+{
+  INT16 left[4], right[4];
+  int i, j = 0;
+
+  /* stereo switches as channel masks */
+  for (i = 0; i < 4; i++)
+  {
+    left[i] = -(stereo >> (i+4) & 0x1);
+    right[i] = -(stereo >> i & 0x1);
+  }
+
+#if defined(PSG_SSE2)
+  for (; j + 8 <= length; j += 8)
+  {
+    __m128i c0 = _mm_loadu_si128((__m128i *)&channel[0][j]);
+    __m128i c1 = _mm_loadu_si128((__m128i *)&channel[1][j]);
+    __m128i c2 = _mm_loadu_si128((__m128i *)&channel[2][j]);
+    __m128i c3 = _mm_loadu_si128((__m128i *)&channel[3][j]);
+    __m128i l = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(c0, _mm_set1_epi16(left[0])), _mm_and_si128(c1, _mm_set1_epi16(left[1]))),
+                              _mm_add_epi16(_mm_and_si128(c2, _mm_set1_epi16(left[2])), _mm_and_si128(c3, _mm_set1_epi16(left[3]))));
+    __m128i r = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(c0, _mm_set1_epi16(right[0])), _mm_and_si128(c1, _mm_set1_epi16(right[1]))),
+                              _mm_add_epi16(_mm_and_si128(c2, _mm_set1_epi16(right[2])), _mm_and_si128(c3, _mm_set1_epi16(right[3]))));
+    _mm_storeu_si128((__m128i *)&buffer[0][j], l);
+    _mm_storeu_si128((__m128i *)&buffer[1][j], r);
+  }
+#elif defined(PSG_NEON)
+  for (; j + 8 <= length; j += 8)
+  {
+    int16x8_t c0 = vld1q_s16(&channel[0][j]);
+    int16x8_t c1 = vld1q_s16(&channel[1][j]);
+    int16x8_t c2 = vld1q_s16(&channel[2][j]);
+    int16x8_t c3 = vld1q_s16(&channel[3][j]);
+    int16x8_t l = vaddq_s16(vaddq_s16(vandq_s16(c0, vdupq_n_s16(left[0])), vandq_s16(c1, vdupq_n_s16(left[1]))),
+                            vaddq_s16(vandq_s16(c2, vdupq_n_s16(left[2])), vandq_s16(c3, vdupq_n_s16(left[3]))));
+    int16x8_t r = vaddq_s16(vaddq_s16(vandq_s16(c0, vdupq_n_s16(right[0])), vandq_s16(c1, vdupq_n_s16(right[1]))),
+                            vaddq_s16(vandq_s16(c2, vdupq_n_s16(right[2])), vandq_s16(c3, vdupq_n_s16(right[3]))));
+    vst1q_s16(&buffer[0][j], l);
+    vst1q_s16(&buffer[1][j], r);
+  }
+#endif
+
+  for (; j < length; j++)
+  {
+    buffer[0][j] = (channel[0][j] & left[0]) + (channel[1][j] & left[1]) + (channel[2][j] & left[2]) + (channel[3][j] & left[3]);
+    buffer[1][j] = (channel[0][j] & right[0]) + (channel[1][j] & right[1]) + (channel[2][j] & right[2]) + (channel[3][j] & right[3]);
+  }
+}
+
+/* All channels at zero volume (or muted): output is silent whatever the counters do */
+static int SN76489_Idle(SN76489_Context *p)
+{
+  int i;
+
+  for (i = 0; i <= 3; i++)
+    if ((p->Mute >> i & 0x1) && PSGVolumeValues[p->VolumeArray][p->Registers[2*i+1]])
+      return 0;
+
+  return 1;
+}
+
+/* Advance counters of a silent PSG by a run of samples without rendering them.    */
+/* A counter then wraps at most once per sample, so wraps can be counted directly. */
+/* Returns 0 (nothing done) when a period is shorter than the clocks of a sample.  */
+static int SN76489_Skip(SN76489_Context *p, int length)
+{
+  UINT64 total = p->Clock + (UINT64)p->dClock * length;
+  int clocks = (int)(total >> CLOCK_FRAC);
+  int most = (int)((p->dClock + CLOCK_MASK) >> CLOCK_FRAC);
+  int wraps[4];
+  int i, freq, count, shifts;
+
+  for (i = 0; i <= 2; i++)
+    if (p->Registers[2*i] <= most) return 0;
+  if ((p->NoiseFreq != 0x80) && (p->NoiseFreq <= most)) return 0;
+
+  /* Tone channels */
+  for (i = 0; i <= 2; i++)
+  {
+    freq = p->Registers[2*i];
+    count = p->ToneFreqVals[i];
+    wraps[i] = (clocks >= count) ? (clocks - count) / freq + 1 : 0;
+    p->ToneFreqVals[i] = count - clocks + wraps[i] * freq;
+
+    if (freq > PSG_CUTOFF) {
+      if (wraps[i] & 1) p->ToneFreqPos[i] = -p->ToneFreqPos[i];
+    } else if (wraps[i]) {
+      p->ToneFreqPos[i] = 1;
+    }
+    p->IntermediatePos[i] = INT_MIN;
+  }
+
+  /* Noise channel (follows tone2 counter, its own one is then unused) */
+  if (p->NoiseFreq == 0x80) {
+    wraps[3] = wraps[2];
+  } else {
+    count = p->ToneFreqVals[3];
+    wraps[3] = (clocks >= count) ? (clocks - count) / p->NoiseFreq + 1 : 0;
+    p->ToneFreqVals[3] = count - clocks + wraps[3] * p->NoiseFreq;
+  }
+
+  /* Shift register is clocked when the flip-flop goes back to 1 */
+  shifts = (p->ToneFreqPos[3] == 1) ? wraps[3] / 2 : (wraps[3] + 1) / 2;
+  if (wraps[3] & 1) p->ToneFreqPos[3] = -p->ToneFreqPos[3];
+  while (shifts--)
+    p->NoiseShiftRegister = SN76489_Shift(p, p->NoiseShiftRegister);
+
+  p->Clock = (UINT32)(total & CLOCK_MASK);
+  return 1;
+}
+
 void SN76489_Update(int which, INT16 **buffer, int length)
 {
   SN76489_Context *p = &SN76489[which];
-  int i, j;
+  INT16 channel[4][PSG_BLOCK];
+  INT16 sync[PSG_BLOCK];
+  UINT32 phase[PSG_BLOCK];
+  int clocks[PSG_BLOCK];
+  INT16 *out[2];
+  UINT32 clock;
+  int i, j, count;
+
+  out[0] = buffer[0];
+  out[1] = buffer[1];
 
-  for(j = 0; j < length; j++)
+  /* Silent PSG: only run counters, up to the last sample which is rendered as usual */
+  if ((length > 1) && SN76489_Idle(p) && SN76489_Skip(p, length - 1))
   {
-    for (i=0;i<=2;++i)
-      if (p->IntermediatePos[i]!=LONG_MIN)
-        p->Channels[i]=(p->Mute >> i & 0x1)*PSGVolumeValues[p->VolumeArray][p->Registers[2*i+1]]*p->IntermediatePos[i]/65536;
-      else
-        p->Channels[i]=(p->Mute >> i & 0x1)*PSGVolumeValues[p->VolumeArray][p->Registers[2*i+1]]*p->ToneFreqPos[i];
-  
-    p->Channels[3]=(short)((p->Mute >> 3 & 0x1)*PSGVolumeValues[p->VolumeArray][p->Registers[7]]*(p->NoiseShiftRegister & 0x1));
-  
-    if (p->BoostNoise) p->Channels[3]<<=1; /* Double noise volume to make some people happy */
-  
-    buffer[0][j] =0;
-    buffer[1][j] =0;
-    for (i=0;i<=3;++i) {
-      buffer[0][j] +=(p->PSGStereo >> (i+4) & 0x1)*p->Channels[i]; /* left */
-      buffer[1][j] +=(p->PSGStereo >>  i  & 0x1)*p->Channels[i]; /* right */
-    }
-  
-    p->Clock+=p->dClock;
-    p->NumClocksForSample=(int)p->Clock;  /* truncates */
-    p->Clock-=p->NumClocksForSample;  /* remove integer part */
-    /* Looks nicer in Delphi... */
-    /*  Clock:=Clock+p->dClock; */
-    /*  NumClocksForSample:=Trunc(Clock); */
-    /*  Clock:=Frac(Clock); */
-  
-    /* Decrement tone channel counters */
-    for (i=0;i<=2;++i)
-      p->ToneFreqVals[i]-=p->NumClocksForSample;
-   
-    /* Noise channel: match to tone2 or decrement its counter */
-    if (p->NoiseFreq==0x80) p->ToneFreqVals[3]=p->ToneFreqVals[2];
-    else p->ToneFreqVals[3]-=p->NumClocksForSample;
-  
-    /* Tone channels: */
-    for (i=0;i<=2;++i) {
-      if (p->ToneFreqVals[i]<=0) {   /* If it gets below 0... */
-        if (p->Registers[i*2]>PSG_CUTOFF) {
-          /* Calculate how much of the sample is + and how much is - */
-          /* Go to floating point and include the clock fraction for extreme accuracy :D */
-          /* Store as long int, maybe it's faster? I'm not very good at this */
-          p->IntermediatePos[i]=(long)((p->NumClocksForSample-p->Clock+2*p->ToneFreqVals[i])*p->ToneFreqPos[i]/(p->NumClocksForSample+p->Clock)*65536);
-          p->ToneFreqPos[i]=-p->ToneFreqPos[i]; /* Flip the flip-flop */
-        } else {
-          p->ToneFreqPos[i]=1;   /* stuck value */
-          p->IntermediatePos[i]=LONG_MIN;
-        }
-        p->ToneFreqVals[i]+=p->Registers[i*2]*(p->NumClocksForSample/p->Registers[i*2]+1);
-      } else p->IntermediatePos[i]=LONG_MIN;
+    memset(out[0], 0, (length - 1) * sizeof(INT16));
+    memset(out[1], 0, (length - 1) * sizeof(INT16));
+    out[0] += length - 1;
+    out[1] += length - 1;
+    length = 1;
+  }
+
+  clock = p->Clock;
+
+  /* Registers don't change during an update: render whole runs channel by channel */
+  while (length > 0)
+  {
+    count = (length < PSG_BLOCK) ? length : PSG_BLOCK;
+
+    /* Number of clocks elapsed at each sample and remaining clock fraction */
+    for (j = 0; j < count; j++)
+    {
+      clock += p->dClock;
+      clocks[j] = clock >> CLOCK_FRAC;
+      clock &= CLOCK_MASK;
+      phase[j] = clock;
     }
-  
+    p->NumClocksForSample = clocks[count - 1];
+
+    /* Tone channels (tone2 counter is recorded when noise follows it) */
+    for (i = 0; i <= 2; i++)
+      SN76489_RunTone(p, i, clocks, phase, channel[i], ((i == 2) && (p->NoiseFreq == 0x80)) ? sync : NULL, count);
+
     /* Noise channel */
-    if (p->ToneFreqVals[3]<=0) {   /* If it gets below 0... */
-      p->ToneFreqPos[3]=-p->ToneFreqPos[3]; /* Flip the flip-flop */
-      if (p->NoiseFreq!=0x80)      /* If not matching tone2, decrement counter */
-        p->ToneFreqVals[3]+=p->NoiseFreq*(p->NumClocksForSample/p->NoiseFreq+1);
-      if (p->ToneFreqPos[3]==1) {  /* Only once per cycle... */
-        int Feedback;
-        if (p->Registers[6]&0x4) { /* White noise */
-          /* Calculate parity of fed-back bits for feedback */
-          switch (p->WhiteNoiseFeedback) {
-            /* Do some optimised calculations for common (known) feedback values */
-          case 0x0006:  /* SC-3000    %00000110 */
-          case 0x0009:  /* SMS, GG, MD  %00001001 */
-            /* If two bits fed back, I can do Feedback=(nsr & fb) && (nsr & fb ^ fb) */
-            /* since that's (one or more bits set) && (not all bits set) */
-  /* which one?     Feedback=((p->NoiseShiftRegister&p->WhiteNoiseFeedback) && (p->NoiseShiftRegister&p->WhiteNoiseFeedback^p->WhiteNoiseFeedback)); */
-            Feedback=((p->NoiseShiftRegister&p->WhiteNoiseFeedback) && ((p->NoiseShiftRegister&p->WhiteNoiseFeedback)^p->WhiteNoiseFeedback));
-            break;
-          case 0x8005:  /* BBC Micro */
-            /* fall through :P can't be bothered to think too much */
-          default:    /* Default handler for all other feedback values */
-            Feedback=p->NoiseShiftRegister&p->WhiteNoiseFeedback;
-            Feedback^=Feedback>>8;
-            Feedback^=Feedback>>4;
-            Feedback^=Feedback>>2;
-            Feedback^=Feedback>>1;
-            Feedback&=1;
-            break;
-          }
-        } else    /* Periodic noise */
-          Feedback=p->NoiseShiftRegister&1;
-  
-        p->NoiseShiftRegister=(p->NoiseShiftRegister>>1) | (Feedback<<15);
-  
-  /* Original code: */
-  /*      p->NoiseShiftRegister=(p->NoiseShiftRegister>>1) | ((p->Registers[6]&0x4?((p->NoiseShiftRegister&0x9) && (p->NoiseShiftRegister&0x9^0x9)):p->NoiseShiftRegister&1)<<15); */
+    SN76489_RunNoise(p, clocks, (p->NoiseFreq == 0x80) ? sync : NULL, channel[3], count);
+
+    /* Apply stereo and sum channels */
+    SN76489_Mix(out, channel, p->PSGStereo, count);
+
+    out[0] += count;
+    out[1] += count;
+    length -= count;
+  }
+
+  p->Clock = clock;
+}
+
+/* Band-limited step synthesis: counters are run at the PSG clock rate (input clock / 16)  */
+/* from one transition to the next, and each change of output level is added as a delta. */
+/* Cost depends on the number of transitions, not on the output sample rate.               */
+
+/* Output level change of one channel at given time */
+static void SN76489_BlipDelta(SN76489_Context *p, blip_t **blip, int i, int amp, unsigned int time)
+{
+  int delta = amp - p->Channels[i];
+
+  if (delta)
+  {
+    if (p->PSGStereo >> (i+4) & 0x1) blip_add_delta(blip[0], time, delta);
+    if (p->PSGStereo >> i & 0x1) blip_add_delta(blip[1], time, delta);
+    p->Channels[i] = amp;
+  }
+}
+
+/* Time of k-th clock from current position (BLIP_FRAC fixed-point samples) */
+static unsigned int SN76489_BlipTime(SN76489_Context *p, UINT64 rate, int k)
+{
+  return (unsigned int)(((((UINT64)(p->ClockTicks + k) << CLOCK_FRAC) - p->Clock) * rate) >> (CLOCK_FRAC + 24 - BLIP_FRAC));
+}
+
+/* Run all channels until given sample position of current frame */
+void SN76489_BlipRun(int which, blip_t **blip, int position)
+{
+  SN76489_Context *p = &SN76489[which];
+  UINT64 rate = ((UINT64)1 << (CLOCK_FRAC + 24)) / p->dClock;  /* samples per clock (24-bit fraction) */
+  int ticks = (int)(((UINT64)p->Clock + (UINT64)position * p->dClock) >> CLOCK_FRAC) - p->ClockTicks;
+  int vol[4], level[2];
+  int i, k, n, period, pos, shift;
+
+  for (i = 0; i <= 3; i++)
+    vol[i] = (p->Mute >> i & 0x1) * PSGVolumeValues[p->VolumeArray][p->Registers[2*i+1]];
+  if (p->BoostNoise) vol[3] <<= 1; /* Double noise volume to make some people happy */
+
+  /* Apply register writes made since last run */
+  level[0] = level[1] = 0;
+  for (i = 0; i <= 2; i++)
+    p->Channels[i] = vol[i] * p->ToneFreqPos[i];
+  p->Channels[3] = vol[3] * (p->NoiseShiftRegister & 0x1);
+  for (i = 0; i <= 3; i++)
+  {
+    level[0] += (p->PSGStereo >> (i+4) & 0x1) * p->Channels[i];
+    level[1] += (p->PSGStereo >> i & 0x1) * p->Channels[i];
+  }
+  for (i = 0; i < 2; i++)
+    if (level[i] != blip[i]->amplitude)
+      blip_add_delta(blip[i], p->Position << BLIP_FRAC, level[i] - blip[i]->amplitude);
+
+  /* Noise channel first, as it may follow tone2 counter */
+  if (p->NoiseFreq == 0x80) {
+    k = p->ToneFreqVals[2];
+    period = p->Registers[4];
+  } else {
+    k = p->ToneFreqVals[3];
+    period = p->NoiseFreq;
+  }
+  pos = p->ToneFreqPos[3];
+  shift = p->NoiseShiftRegister;
+  for (k = (k < 1) ? 1 : k; k <= ticks; k += period) {
+    pos = -pos; /* Flip the flip-flop */
+    if (pos == 1) { /* Only once per cycle... */
+      shift = SN76489_Shift(p, shift);
+      SN76489_BlipDelta(p, blip, 3, vol[3] & -(shift & 0x1), SN76489_BlipTime(p, rate, k));
+    }
+  }
+  p->ToneFreqVals[3] = k - ticks;
+  p->ToneFreqPos[3] = pos;
+  p->NoiseShiftRegister = shift;
+
+  /* Tone channels */
+  for (i = 0; i <= 2; i++)
+  {
+    period = p->Registers[2*i];
+    pos = p->ToneFreqPos[i];
+    k = p->ToneFreqVals[i];
+    if (k < 1) k = 1;
+
+    if (k <= ticks) {
+      if ((period > PSG_CUTOFF) && vol[i]) {
+        for (; k <= ticks; k += period) {
+          pos = -pos; /* Flip the flip-flop */
+          SN76489_BlipDelta(p, blip, i, vol[i] * pos, SN76489_BlipTime(p, rate, k));
+        }
+      } else {
+        /* Inaudible or stuck channel: only keep counter and flip-flop in step */
+        n = (ticks - k) / period + 1;
+        if (period <= PSG_CUTOFF) pos = 1; /* stuck value */
+        else if (n & 1) pos = -pos;
+        SN76489_BlipDelta(p, blip, i, vol[i] * pos, SN76489_BlipTime(p, rate, k));
+        k += n * period;
       }
     }
+
+    p->ToneFreqVals[i] = k - ticks;
+    p->ToneFreqPos[i] = pos;
   }
+
+  p->ClockTicks += ticks;
+  p->Position = position;
 }
 
+/* Start a new frame after length samples */
+void SN76489_BlipEndFrame(int which, int length)
+{
+  SN76489_Context *p = &SN76489[which];
+  UINT64 clock = (UINT64)p->Clock + (UINT64)length * p->dClock;
+
+  p->Clock = (UINT32)(clock - ((UINT64)p->ClockTicks << CLOCK_FRAC));
+  p->ClockTicks = 0;
+  p->Position = 0;
+}
@@ -41,8 +41,8 @@ typedef struct
     int VolumeArray;
     
     /* Variables */
-    float Clock;
-    float dClock;
+    UINT32 Clock;               /* Clock fraction (CLOCK_FRAC bits) */
+    UINT32 dClock;              /* Clocks per sample (fixed-point) */
     int PSGStereo;
     int NumClocksForSample;
     int WhiteNoiseFeedback;
@@ -59,10 +59,15 @@ typedef struct
     INT16 Channels[4];          /* Value of each channel, before stereo is applied */
     INT32 IntermediatePos[4];   /* intermediate values used at boundaries between + and - */
 
+    /* Band-limited synthesis */
+    int ClockTicks;             /* Clocks run in current frame */
+    int Position;               /* Samples run in current frame */
+
 } SN76489_Context;
 
 /* Function prototypes */
 void SN76489_Init(int which, int PSGClockValue, int SamplingRate);
+void SN76489_SetClock(int which, int PSGClockValue, int SamplingRate);
 void SN76489_Reset(int which);
 void SN76489_Shutdown(void);
 void SN76489_Config(int which, int mute, int boost, int volume, int feedback);
@@ -70,9 +75,13 @@ void SN76489_SetContext(int which, uint8 *data);
 void SN76489_GetContext(int which, uint8 *data);
 uint8 *SN76489_GetContextPtr(int which);
 int SN76489_GetContextSize(void);
+int SN76489_SaveState(int which, uint8 *data);
+int SN76489_LoadState(int which, uint8 *data, int version);
 void SN76489_Write(int which, int data);
 void SN76489_GGStereoWrite(int which, int data);
 void SN76489_Update(int which, INT16 **buffer, int length);
+void SN76489_BlipRun(int which, blip_t **blip, int position);
+void SN76489_BlipEndFrame(int which, int length);
 
 #endif /* _SN76489_H_ */
 
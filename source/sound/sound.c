@@ -25,16 +25,70 @@
 #include "shared.h"
 #include "config.h"
 
-snd_t snd;
-static int16 **fm_buffer;
-static int16 **psg_buffer;
-int *smptab;
-int smptab_len;
+/* Sound streams and timing (current machine) */
+#define fm_buffer   ((int16 **)&snd.stream[STREAM_FM_MO])
+#define psg_buffer  ((int16 **)&snd.stream[STREAM_PSG_L])
 
 #ifdef NGC
 void sound_mixer_ngc (int length);
 #endif
 
+/* Sample position of current Z80 cycle in the frame */
+static int sound_position(void)
+{
+  int position = z80_get_elapsed_cycles() * snd.sample_count / snd.frame_cycles;
+
+  /* the last instruction of a frame may end past it */
+  return (position < snd.sample_count) ? position : snd.sample_count;
+}
+
+/* Render PSG samples up to position: the PSG only runs between register writes */
+static void psg_sync(int position)
+{
+  int16 *psg[2];
+
+  if(!snd.skip && (position > snd.psg_done))
+  {
+    psg[0] = psg_buffer[0] + snd.psg_done;
+    psg[1] = psg_buffer[1] + snd.psg_done;
+
+    /* Generate SN76489 sample data */
+    PROFILE_BEGIN(PROF_PSG);
+    if(snd.psg_blep)
+      SN76489_BlipRun(0, snd.blip, position);
+    else
+      SN76489_Update(0, psg, position - snd.psg_done);
+    PROFILE_END();
+
+    snd.psg_done = position;
+  }
+}
+
+/* Render YM2413 samples up to position: the FM only runs between register writes */
+static void fm_sync(int position)
+{
+  int16 *fm[2];
+
+  if(!snd.skip && (position > snd.fm_done))
+  {
+    fm[0] = fm_buffer[0] + snd.fm_done;
+    fm[1] = fm_buffer[1] + snd.fm_done;
+
+    /* Generate YM2413 sample data (FM unit disabled: writes never reach it) */
+    PROFILE_BEGIN(PROF_FM);
+    if(sms.use_fm)
+      FM_Update(fm, position - snd.fm_done);
+    else
+    {
+      memset(fm[0], 0, (position - snd.fm_done) * sizeof(int16));
+      memset(fm[1], 0, (position - snd.fm_done) * sizeof(int16));
+    }
+    PROFILE_END();
+
+    snd.fm_done = position;
+  }
+}
+
 int sound_init(void)
 {
   uint8 *fmbuf = NULL;
@@ -42,11 +96,11 @@ int sound_init(void)
   int restore_sound = 0;
   int i;
 
-  snd.fm_which = option.fm;
+  snd.fm_which = machine->option.fm;
   snd.fps = (sms.display == DISPLAY_NTSC) ? FPS_NTSC : FPS_PAL;
   snd.fm_clock = (sms.display == DISPLAY_NTSC) ? CLOCK_NTSC : CLOCK_PAL;
   snd.psg_clock = (sms.display == DISPLAY_NTSC) ? CLOCK_NTSC : CLOCK_PAL;
-  snd.sample_rate = option.sndrate;
+  snd.sample_rate = machine->option.sndrate;
   snd.mixer_callback = NULL;
 
   /* Save register settings */
@@ -54,7 +108,7 @@ int sound_init(void)
   {
     restore_sound = 1;
     psgbuf = malloc(SN76489_GetContextSize ());
-    memcpy (psgbuf, SN76489_GetContextPtr (0),SN76489_GetContextSize ());
+    SN76489_SaveState (0, psgbuf);
     fmbuf = malloc(FM_GetContextSize());
     FM_GetContext(fmbuf);
   }
@@ -69,7 +123,7 @@ int sound_init(void)
   snd.enabled = 0;
 
   /* Check if sample rate is invalid */
-  if(snd.sample_rate < 8000 || snd.sample_rate > 48000)
+  if(snd.sample_rate < 8000 || snd.sample_rate > 96000)
     return 0;
 
   /* Assign stream mixing callback if none provided */
@@ -82,24 +136,10 @@ int sound_init(void)
   /* Calculate size of sample buffer */
   snd.buffer_size = snd.sample_count * 2;
 
-  /* Free sample buffer position table if previously allocated */
-  if(smptab)
-  {
-    free(smptab);
-    smptab = NULL;
-  }
-
   /* Prepare incremental info */
-  snd.done_so_far = 0;
-  smptab_len = (sms.display == DISPLAY_NTSC) ? 262 : 313;
-  smptab = malloc(smptab_len * sizeof(int));
-  if(!smptab) return 0;
-  for (i = 0; i < smptab_len; i++)
-  {
-    double calc = (snd.sample_count * i);
-    calc = calc / (double)smptab_len;
-    smptab[i] = (int)calc;
-  }
+  snd.psg_done = 0;
+  snd.fm_done = 0;
+  snd.frame_cycles = ((sms.display == DISPLAY_NTSC) ? 262 : 313) * CYCLES_PER_LINE;
 
   /* Allocate emulated sound streams */
   for(i = 0; i < STREAM_MAX; i++)
@@ -109,6 +149,14 @@ int sound_init(void)
     memset(snd.stream[i], 0, snd.buffer_size);
   }
 
+  /* Allocate PSG step buffers */
+  if(snd.psg_blep)
+  {
+    snd.blip[0] = blip_new(snd.sample_count);
+    snd.blip[1] = blip_new(snd.sample_count);
+    if(!snd.blip[0] || !snd.blip[1]) return 0;
+  }
+
 #ifndef NGC
   /* Allocate sound output streams */
   snd.output[0] = malloc(snd.buffer_size);
@@ -116,10 +164,6 @@ int sound_init(void)
   if(!snd.output[0] || !snd.output[1]) return 0;
 #endif
 
-  /* Set up buffer pointers */
-  fm_buffer = (int16 **)&snd.stream[STREAM_FM_MO];
-  psg_buffer = (int16 **)&snd.stream[STREAM_PSG_L];
-
   /* Set up SN76489 emulation */
   SN76489_Init(0, snd.psg_clock, snd.sample_rate);
   SN76489_Config(0, MUTE_ALLON, BOOST_ON, VOL_TRUNC, (sms.console < CONSOLE_SMS) ? FB_SC3000 : FB_SEGAVDP);
@@ -130,7 +174,8 @@ int sound_init(void)
   /* Restore YM2413 register settings */
   if(restore_sound)
   {
-    memcpy (SN76489_GetContextPtr (0),psgbuf,SN76489_GetContextSize ());
+    SN76489_LoadState (0, psgbuf, STATE_VERSION);
+    SN76489_SetClock(0, snd.psg_clock, snd.sample_rate);
     FM_SetContext(fmbuf);
     free(fmbuf);
     free(psgbuf);
@@ -172,6 +217,13 @@ void sound_shutdown(void)
   }
 #endif
 
+  /* Free PSG step buffers */
+  for(i = 0; i < 2; i++)
+  {
+    blip_delete(snd.blip[i]);
+    snd.blip[i] = NULL;
+  }
+
   /* Shut down SN76489 emulation */
   SN76489_Shutdown();
 
@@ -186,64 +238,44 @@ void sound_reset(void)
     return;
 
   /* Reset SN76489 emulator */
+  psg_sync(sound_position());
   SN76489_Reset(0);
 
   /* Reset YM2413 emulator */
+  fm_sync(sound_position());
   FM_Reset();
 }
 
 
-void sound_update(int line)
+void sound_end(void)
 {
-  int16 *fm[2], *psg[2];
-
-  if(!snd.enabled)
+  if(!snd.enabled || snd.skip)
     return;
 
   /* Finish buffers at end of frame */
-  if(line == smptab_len - 1)
+  psg_sync(snd.sample_count);
+  if(snd.psg_blep)
   {
-    psg[0] = psg_buffer[0] + snd.done_so_far;
-    psg[1] = psg_buffer[1] + snd.done_so_far;
-    fm[0]  = fm_buffer[0] + snd.done_so_far;
-    fm[1]  = fm_buffer[1] + snd.done_so_far;
-
-    /* Generate SN76489 sample data */
-    SN76489_Update(0, psg, snd.sample_count - snd.done_so_far);
-
-    /* Generate YM2413 sample data */
-    FM_Update(fm, snd.sample_count - snd.done_so_far);
+    PROFILE_BEGIN(PROF_PSG);
+    blip_read(snd.blip[0], psg_buffer[0], snd.sample_count);
+    blip_read(snd.blip[1], psg_buffer[1], snd.sample_count);
+    SN76489_BlipEndFrame(0, snd.sample_count);
+    PROFILE_END();
+  }
+  fm_sync(snd.sample_count);
 
-    /* Mix streams into output buffer */
+  /* Mix streams into output buffer */
+  PROFILE_BEGIN(PROF_MIXER);
 #ifndef NGC
-    snd.mixer_callback(snd.stream, snd.output, snd.sample_count);
+  snd.mixer_callback(snd.stream, snd.output, snd.sample_count);
 #else
-    sound_mixer_ngc (snd.sample_count);
+  sound_mixer_ngc (snd.sample_count);
 #endif
-    /* Reset */
-    snd.done_so_far = 0;
-  }
-  else
-  {
-    int tinybit;
+  PROFILE_END();
 
-    tinybit = smptab[line] - snd.done_so_far;
-
-    /* Do a tiny bit */
-    psg[0] = psg_buffer[0] + snd.done_so_far;
-    psg[1] = psg_buffer[1] + snd.done_so_far;
-    fm[0]  = fm_buffer[0] + snd.done_so_far;
-    fm[1]  = fm_buffer[1] + snd.done_so_far;
-
-    /* Generate SN76489 sample data */
-    SN76489_Update(0, psg, tinybit);
-
-    /* Generate YM2413 sample data */
-    FM_Update(fm, tinybit);
-
-    /* Sum total */
-    snd.done_so_far += tinybit;
-  }
+  /* Reset */
+  snd.psg_done = 0;
+  snd.fm_done = 0;
 }
 
 /* Generic FM+PSG stereo mixer callback */
@@ -292,6 +324,7 @@ void sound_mixer_ngc (int length)
 void psg_stereo_w(int data)
 {
   if(!snd.enabled) return;
+  psg_sync(sound_position());
   SN76489_GGStereoWrite(0, data);
 }
 
@@ -303,6 +336,7 @@ void stream_update(int which, int position)
 void psg_write(int data)
 {
   if(!snd.enabled) return;
+  psg_sync(sound_position());
   SN76489_Write(0, data);
 }
 
@@ -324,5 +358,6 @@ void fmunit_detect_w(int data)
 void fmunit_write(int offset, int data)
 {
   if(!snd.enabled || !sms.use_fm) return;
+  fm_sync(sound_position());
   FM_Write(offset, data);
 }
@@ -41,19 +41,21 @@ typedef struct
   int16 *stream[STREAM_MAX];
   int fm_which;
   int enabled;
+  int skip;           /* 1= no sample is generated for current frame */
   int fps;
   int buffer_size;
   int sample_count;
   int sample_rate;
-  int done_so_far;
+  int frame_cycles;   /* Z80 cycles per frame */
+  int psg_done;       /* PSG samples generated for current frame */
+  int fm_done;        /* YM2413 samples generated for current frame */
+  int psg_blep;       /* PSG synthesis: 0= one step per output sample, 1= band-limited steps */
+                      /* at PSG clock rate (set before sound_init)                        */
+  blip_t *blip[2];    /* PSG left & right step buffers */
   uint32 fm_clock;
   uint32 psg_clock;
 } snd_t;
 
-
-/* Global data */
-extern snd_t snd;
-
 /* Function prototypes */
 void psg_write(int data);
 void psg_stereo_w(int data);
@@ -63,7 +65,7 @@ void fmunit_write(int offset, int data);
 int sound_init(void);
 void sound_shutdown(void);
 void sound_reset(void);
-void sound_update(int line);
+void sound_end(void);
 void sound_mixer_callback(int16 **stream, int16 **output, int length);
 
 #endif /* _SOUND_H_ */
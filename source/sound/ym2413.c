@@ -31,6 +31,11 @@ to do:
 #define MAME_INLINE static __inline__
 #define logerror(...)
 
+/* use AVX2 table gathers for melody channels where available */
+#ifndef YM2413_SIMD
+#define YM2413_SIMD 1
+#endif
+
 #ifndef PI
 #define PI 3.14159265358979323846
 #endif
@@ -599,18 +604,18 @@ static unsigned char table[19][8] = {
   {0x05, 0x01, 0x00, 0x00, 0xf8, 0xba, 0x49, 0x55 },/* TOM(multi,env verified), TOP CYM(multi verified, env verified) */
 };
 
-/* lock level of common table */
-static int num_lock = 0;
+/* common tables are shared by all machine contexts */
+static worker_once_t tables_once = WORKER_ONCE_INIT;
 
-/* work table */
-static void *cur_chip = NULL;  /* current chip pointer */
-static YM2413_OPLL_SLOT *SLOT7_1,*SLOT7_2,*SLOT8_1,*SLOT8_2;
+/* work table (per thread) */
+static THREAD_LOCAL void *cur_chip = NULL;  /* current chip pointer */
+static THREAD_LOCAL YM2413_OPLL_SLOT *SLOT7_1,*SLOT7_2,*SLOT8_1,*SLOT8_2;
 
-static signed int output[2];
-static signed int outchan;
+static THREAD_LOCAL signed int output[2];
+static THREAD_LOCAL signed int outchan;
 
-static UINT32  LFO_AM;
-static INT32  LFO_PM;
+static THREAD_LOCAL UINT32  LFO_AM;
+static THREAD_LOCAL INT32  LFO_PM;
 
 
 MAME_INLINE int limit( int val, int max, int min ) {
@@ -637,205 +642,205 @@ MAME_INLINE void advance_lfo(YM2413 *chip)
   LFO_PM = (chip->lfo_pm_cnt>>LFO_SH) & 7;
 }
 
-/* advance to next sample */
-MAME_INLINE void advance(YM2413 *chip)
+/* advance envelope generator of one slot by one tick */
+MAME_INLINE void advance_eg(YM2413 *chip, YM2413_OPLL_CH *CH, YM2413_OPLL_SLOT *op, unsigned int i, UINT32 eg_cnt)
 {
-    YM2413_OPLL_CH *CH;
-    YM2413_OPLL_SLOT *op;
-  unsigned int i;
-
-//profiler_mark(PROFILER_USER3);
-
-  /* Envelope Generator */
-  chip->eg_timer += chip->eg_timer_add;
-
-  while (chip->eg_timer >= chip->eg_timer_overflow)
+  switch(op->state)
   {
-    chip->eg_timer -= chip->eg_timer_overflow;
-
-    chip->eg_cnt++;
 
-    for (i=0; i<9*2; i++)
+  case EG_DMP:    /* dump phase */
+  /*dump phase is performed by both operators in each channel*/
+  /*when CARRIER envelope gets down to zero level,
+  **  phases in BOTH opearators are reset (at the same time ?)
+  */
+    if ( !(eg_cnt & ((1<<op->eg_sh_dp)-1) ) )
     {
-      CH  = &chip->P_CH[i/2];
+      op->volume += eg_inc[op->eg_sel_dp + ((eg_cnt>>op->eg_sh_dp)&7)];
 
-      op  = &CH->SLOT[i&1];
-
-      switch(op->state)
+      if ( op->volume >= MAX_ATT_INDEX )
       {
+        op->volume = MAX_ATT_INDEX;
+        op->state = EG_ATT;
+        /* restart Phase Generator  */
+        op->phase = 0;
+      }
+    }
+  break;
 
-      case EG_DMP:    /* dump phase */
-      /*dump phase is performed by both operators in each channel*/
-      /*when CARRIER envelope gets down to zero level,
-      **  phases in BOTH opearators are reset (at the same time ?)
-      */
-        if ( !(chip->eg_cnt & ((1<<op->eg_sh_dp)-1) ) )
-        {
-          op->volume += eg_inc[op->eg_sel_dp + ((chip->eg_cnt>>op->eg_sh_dp)&7)];
+  case EG_ATT:    /* attack phase */
+    if ( !(eg_cnt & ((1<<op->eg_sh_ar)-1) ) )
+    {
+      op->volume += (~op->volume *
+                                     (eg_inc[op->eg_sel_ar + ((eg_cnt>>op->eg_sh_ar)&7)])
+                                    ) >>2;
 
-          if ( op->volume >= MAX_ATT_INDEX )
-          {
-            op->volume = MAX_ATT_INDEX;
-            op->state = EG_ATT;
-            /* restart Phase Generator  */
-            op->phase = 0;
-          }
-        }
-      break;
+      if (op->volume <= MIN_ATT_INDEX)
+      {
+        op->volume = MIN_ATT_INDEX;
+        op->state = EG_DEC;
+      }
+    }
+  break;
 
-      case EG_ATT:    /* attack phase */
-        if ( !(chip->eg_cnt & ((1<<op->eg_sh_ar)-1) ) )
-        {
-          op->volume += (~op->volume *
-                                         (eg_inc[op->eg_sel_ar + ((chip->eg_cnt>>op->eg_sh_ar)&7)])
-                                        ) >>2;
+  case EG_DEC:  /* decay phase */
+    if ( !(eg_cnt & ((1<<op->eg_sh_dr)-1) ) )
+    {
+      op->volume += eg_inc[op->eg_sel_dr + ((eg_cnt>>op->eg_sh_dr)&7)];
 
-          if (op->volume <= MIN_ATT_INDEX)
-          {
-            op->volume = MIN_ATT_INDEX;
-            op->state = EG_DEC;
-          }
-        }
-      break;
+      if ( op->volume >= op->sl )
+        op->state = EG_SUS;
+    }
+  break;
 
-      case EG_DEC:  /* decay phase */
-        if ( !(chip->eg_cnt & ((1<<op->eg_sh_dr)-1) ) )
-        {
-          op->volume += eg_inc[op->eg_sel_dr + ((chip->eg_cnt>>op->eg_sh_dr)&7)];
+  case EG_SUS:  /* sustain phase */
+    /* this is important behaviour:
+    one can change percusive/non-percussive modes on the fly and
+    the chip will remain in sustain phase - verified on real YM3812 */
 
-          if ( op->volume >= op->sl )
-            op->state = EG_SUS;
-        }
-      break;
+    if(op->eg_type)    /* non-percussive mode (sustained tone) */
+    {
+              /* do nothing */
+    }
+    else        /* percussive mode */
+    {
+      /* during sustain phase chip adds Release Rate (in percussive mode) */
+      if ( !(eg_cnt & ((1<<op->eg_sh_rr)-1) ) )
+      {
+        op->volume += eg_inc[op->eg_sel_rr + ((eg_cnt>>op->eg_sh_rr)&7)];
 
-      case EG_SUS:  /* sustain phase */
-        /* this is important behaviour:
-        one can change percusive/non-percussive modes on the fly and
-        the chip will remain in sustain phase - verified on real YM3812 */
+        if ( op->volume >= MAX_ATT_INDEX )
+          op->volume = MAX_ATT_INDEX;
+      }
+      /* else do nothing in sustain phase */
+    }
+  break;
 
-        if(op->eg_type)    /* non-percussive mode (sustained tone) */
-        {
-                  /* do nothing */
-        }
-        else        /* percussive mode */
+  case EG_REL:  /* release phase */
+  /* exclude modulators in melody channels from performing anything in this mode*/
+  /* allowed are only carriers in melody mode and rhythm slots in rhythm mode */
+
+  /*This table shows which operators and on what conditions are allowed to perform EG_REL:
+  (a) - always perform EG_REL
+  (n) - never perform EG_REL
+  (r) - perform EG_REL in Rhythm mode ONLY
+    0: 0 (n),  1 (a)
+    1: 2 (n),  3 (a)
+    2: 4 (n),  5 (a)
+    3: 6 (n),  7 (a)
+    4: 8 (n),  9 (a)
+    5: 10(n),  11(a)
+    6: 12(r),  13(a)
+    7: 14(r),  15(a)
+    8: 16(r),  17(a)
+  */
+    if ( (i&1) || ((chip->rhythm&0x20) && (i>=12)) )/* exclude modulators */
+    {
+      if(op->eg_type)    /* non-percussive mode (sustained tone) */
+      /*this is correct: use RR when SUS = OFF*/
+      /*and use RS when SUS = ON*/
+      {
+        if (CH->sus)
         {
-          /* during sustain phase chip adds Release Rate (in percussive mode) */
-          if ( !(chip->eg_cnt & ((1<<op->eg_sh_rr)-1) ) )
+          if ( !(eg_cnt & ((1<<op->eg_sh_rs)-1) ) )
           {
-            op->volume += eg_inc[op->eg_sel_rr + ((chip->eg_cnt>>op->eg_sh_rr)&7)];
-
+            op->volume += eg_inc[op->eg_sel_rs + ((eg_cnt>>op->eg_sh_rs)&7)];
             if ( op->volume >= MAX_ATT_INDEX )
+            {
               op->volume = MAX_ATT_INDEX;
+              op->state = EG_OFF;
+            }
           }
-          /* else do nothing in sustain phase */
         }
-      break;
-
-      case EG_REL:  /* release phase */
-      /* exclude modulators in melody channels from performing anything in this mode*/
-      /* allowed are only carriers in melody mode and rhythm slots in rhythm mode */
-
-      /*This table shows which operators and on what conditions are allowed to perform EG_REL:
-      (a) - always perform EG_REL
-      (n) - never perform EG_REL
-      (r) - perform EG_REL in Rhythm mode ONLY
-        0: 0 (n),  1 (a)
-        1: 2 (n),  3 (a)
-        2: 4 (n),  5 (a)
-        3: 6 (n),  7 (a)
-        4: 8 (n),  9 (a)
-        5: 10(n),  11(a)
-        6: 12(r),  13(a)
-        7: 14(r),  15(a)
-        8: 16(r),  17(a)
-      */
-        if ( (i&1) || ((chip->rhythm&0x20) && (i>=12)) )/* exclude modulators */
+        else
         {
-          if(op->eg_type)    /* non-percussive mode (sustained tone) */
-          /*this is correct: use RR when SUS = OFF*/
-          /*and use RS when SUS = ON*/
+          if ( !(eg_cnt & ((1<<op->eg_sh_rr)-1) ) )
           {
-            if (CH->sus)
-            {
-              if ( !(chip->eg_cnt & ((1<<op->eg_sh_rs)-1) ) )
-              {
-                op->volume += eg_inc[op->eg_sel_rs + ((chip->eg_cnt>>op->eg_sh_rs)&7)];
-                if ( op->volume >= MAX_ATT_INDEX )
-                {
-                  op->volume = MAX_ATT_INDEX;
-                  op->state = EG_OFF;
-                }
-              }
-            }
-            else
+            op->volume += eg_inc[op->eg_sel_rr + ((eg_cnt>>op->eg_sh_rr)&7)];
+            if ( op->volume >= MAX_ATT_INDEX )
             {
-              if ( !(chip->eg_cnt & ((1<<op->eg_sh_rr)-1) ) )
-              {
-                op->volume += eg_inc[op->eg_sel_rr + ((chip->eg_cnt>>op->eg_sh_rr)&7)];
-                if ( op->volume >= MAX_ATT_INDEX )
-                {
-                  op->volume = MAX_ATT_INDEX;
-                  op->state = EG_OFF;
-                }
-              }
+              op->volume = MAX_ATT_INDEX;
+              op->state = EG_OFF;
             }
           }
-          else        /* percussive mode */
+        }
+      }
+      else        /* percussive mode */
+      {
+        if ( !(eg_cnt & ((1<<op->eg_sh_rs)-1) ) )
+        {
+          op->volume += eg_inc[op->eg_sel_rs + ((eg_cnt>>op->eg_sh_rs)&7)];
+          if ( op->volume >= MAX_ATT_INDEX )
           {
-            if ( !(chip->eg_cnt & ((1<<op->eg_sh_rs)-1) ) )
-            {
-              op->volume += eg_inc[op->eg_sel_rs + ((chip->eg_cnt>>op->eg_sh_rs)&7)];
-              if ( op->volume >= MAX_ATT_INDEX )
-              {
-                op->volume = MAX_ATT_INDEX;
-                op->state = EG_OFF;
-              }
-            }
+            op->volume = MAX_ATT_INDEX;
+            op->state = EG_OFF;
           }
         }
-      break;
-
-      default:
-      break;
       }
     }
-  }
-
-//profiler_mark(PROFILER_END);
+  break;
 
-//profiler_mark(PROFILER_USER4);
+  default:
+  break;
+  }
+}
 
-  for (i=0; i<9*2; i++)
+/* phase increment of one slot for a given LFO PM step */
+MAME_INLINE UINT32 phase_inc(YM2413 *chip, YM2413_OPLL_CH *CH, YM2413_OPLL_SLOT *op, INT32 lfo_pm)
+{
+  /* Phase Generator */
+  if(op->vib)
   {
-    CH  = &chip->P_CH[i/2];
-    op  = &CH->SLOT[i&1];
-
-    /* Phase Generator */
-    if(op->vib)
-    {
-      UINT8 block;
+    UINT8 block;
 
-      unsigned int fnum_lfo   = 8*((CH->block_fnum&0x01c0) >> 6);
-      unsigned int block_fnum = CH->block_fnum * 2;
-      signed int lfo_fn_table_index_offset = lfo_pm_table[LFO_PM + fnum_lfo ];
+    unsigned int fnum_lfo   = 8*((CH->block_fnum&0x01c0) >> 6);
+    unsigned int block_fnum = CH->block_fnum * 2;
+    signed int lfo_fn_table_index_offset = lfo_pm_table[lfo_pm + fnum_lfo ];
 
-      if (lfo_fn_table_index_offset)  /* LFO phase modulation active */
-      {
-        block_fnum += lfo_fn_table_index_offset;
-        block = (block_fnum&0x1c00) >> 10;
-        op->phase += (chip->fn_tab[block_fnum&0x03ff] >> (7-block)) * op->mul;
-      }
-      else  /* LFO phase modulation  = zero */
-      {
-        op->phase += op->freq;
-      }
-    }
-    else  /* LFO phase modulation disabled for this operator */
+    if (lfo_fn_table_index_offset)  /* LFO phase modulation active */
     {
-      op->phase += op->freq;
+      block_fnum += lfo_fn_table_index_offset;
+      block = (block_fnum&0x1c00) >> 10;
+      return (chip->fn_tab[block_fnum&0x03ff] >> (7-block)) * op->mul;
     }
   }
 
+  /* LFO phase modulation disabled for this operator or zero */
+  return op->freq;
+}
+
+/* advance phase generator of one slot to next sample */
+MAME_INLINE void advance_pg(YM2413 *chip, YM2413_OPLL_CH *CH, YM2413_OPLL_SLOT *op)
+{
+  op->phase += phase_inc(chip, CH, op, LFO_PM);
+}
+
+/* advance to next sample */
+MAME_INLINE void advance(YM2413 *chip)
+{
+  unsigned int i;
+
+//profiler_mark(PROFILER_USER3);
+
+  /* Envelope Generator */
+  chip->eg_timer += chip->eg_timer_add;
+
+  while (chip->eg_timer >= chip->eg_timer_overflow)
+  {
+    chip->eg_timer -= chip->eg_timer_overflow;
+
+    chip->eg_cnt++;
+
+    for (i=0; i<9*2; i++)
+      advance_eg(chip, &chip->P_CH[i/2], &chip->P_CH[i/2].SLOT[i&1], i, chip->eg_cnt);
+  }
+
+//profiler_mark(PROFILER_END);
+
+//profiler_mark(PROFILER_USER4);
+
+  for (i=0; i<9*2; i++)
+    advance_pg(chip, &chip->P_CH[i/2], &chip->P_CH[i/2].SLOT[i&1]);
+
   /*  The Noise Generator of the YM3812 is 23-bit shift register.
   *  Period is equal to 2^23-2 samples.
   *  Register works at sampling frequency of the chip, so output
@@ -874,6 +879,19 @@ MAME_INLINE void advance(YM2413 *chip)
 //profiler_mark(PROFILER_END);
 }
 
+/* advance noise generator by 'length' samples */
+MAME_INLINE void advance_noise(YM2413 *chip, int length)
+{
+  UINT64 sum = chip->noise_p + (UINT64)chip->noise_f * length;
+
+  chip->noise_p = (UINT32)(sum & FREQ_MASK);
+  for (sum >>= FREQ_SH; sum; sum--)
+  {
+    if (chip->noise_rng & 1) chip->noise_rng ^= 0x800302;
+    chip->noise_rng >>= 1;
+  }
+}
+
 
 MAME_INLINE signed int op_calc(UINT32 phase, unsigned int env, signed int pm, unsigned int wave_tab)
 {
@@ -948,6 +966,169 @@ outchan=0;
   }
 }
 
+/* melody channels are calculated in blocks, one lane per channel */
+#define BLOCK_LEN 32
+
+typedef struct
+{
+  UINT32 volume[2][BLOCK_LEN][9]; /* slot envelope at each sample */
+  UINT32 am[BLOCK_LEN];           /* LFO output at each sample */
+  INT32  pm[BLOCK_LEN];
+  UINT32 tll[2][9];               /* slot total level and AM enable */
+  UINT32 am_mask[2][9];
+  UINT32 inc[2][8][9];            /* slot phase increment for each LFO PM step */
+  UINT32 phase[2][9];             /* slot phase */
+  INT32  reset[2][9];             /* sample after which slot phase restarts */
+  UINT32 wave[2][9];              /* slot waveform */
+  UINT32 fb_shift[9];             /* modulator feedback */
+  INT32  op1_out[2][9];           /* modulator output history */
+  INT32  out[BLOCK_LEN];          /* mixed channels output */
+} YM2413_BLOCK;
+
+/* same as volume_calc() for one slot and sample of a block */
+#define block_volume_calc(b,k,i,j) ((b)->tll[k][i] + (b)->volume[k][j][i] + ((b)->am[j] & (b)->am_mask[k][i]))
+
+/* slot phase at one sample of a block, then advance it */
+MAME_INLINE UINT32 block_phase(YM2413_BLOCK *b, int k, int i, int j)
+{
+  UINT32 phase = b->phase[k][i];
+
+  if (b->reset[k][i] == j)
+    b->phase[k][i] = 0;
+  b->phase[k][i] += b->inc[k][b->pm[j]][i];
+
+  return phase;
+}
+
+/* same as chan_calc() for one channel and sample of a block */
+MAME_INLINE signed int chan_calc_block_one(YM2413_BLOCK *b, int i, int j)
+{
+  unsigned int env;
+  UINT32 phase;
+  signed int out;
+  signed int phase_modulation;
+
+  /* SLOT 1 */
+  env = block_volume_calc(b, SLOT1, i, j);
+  phase = block_phase(b, SLOT1, i, j);
+  out = b->op1_out[0][i] + b->op1_out[1][i];
+
+  b->op1_out[0][i] = b->op1_out[1][i];
+  phase_modulation = b->op1_out[0][i];
+
+  b->op1_out[1][i] = 0;
+
+  if( env < ENV_QUIET )
+  {
+    if (!b->fb_shift[i])
+      out = 0;
+    b->op1_out[1][i] = op_calc1(phase, env, (out<<b->fb_shift[i]), b->wave[SLOT1][i] );
+  }
+
+  /* SLOT 2 */
+  env = block_volume_calc(b, SLOT2, i, j);
+  phase = block_phase(b, SLOT2, i, j);
+  if( env < ENV_QUIET )
+    return op_calc(phase, env, phase_modulation, b->wave[SLOT2][i]);
+
+  return 0;
+}
+
+static void chan_calc_block_c(YM2413_BLOCK *b, int length)
+{
+  int i, j;
+
+  for (j=0; j<length; j++)
+  {
+    for (i=0; i<9; i++)
+      b->out[j] += chan_calc_block_one(b, i, j);
+  }
+}
+
+/* AVX2 table gathers for channels 0-7 (picked at runtime) */
+#if YM2413_SIMD && defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define YM2413_AVX2
+
+#define LOAD(x) _mm256_loadu_si256((const __m256i *)(x))
+
+__attribute__((target("avx2")))
+static void chan_calc_block_avx2(YM2413_BLOCK *b, int length)
+{
+  const __m256i phase_mask = _mm256_set1_epi32(~FREQ_MASK);
+  const __m256i sin_mask   = _mm256_set1_epi32(SIN_MASK);
+  const __m256i env_quiet  = _mm256_set1_epi32(ENV_QUIET);
+  const __m256i tl_len     = _mm256_set1_epi32(TL_TAB_LEN);
+  const __m256i zero       = _mm256_setzero_si256();
+  const __m256i fb    = LOAD(b->fb_shift);
+  const __m256i no_fb = _mm256_cmpeq_epi32(fb, zero);
+  __m256i phase[2], cur[2], env[2];
+  __m256i out0 = LOAD(b->op1_out[0]);
+  __m256i out1 = LOAD(b->op1_out[1]);
+  __m256i am, sample, idx, p, out;
+  __m128i sum;
+  int j, k;
+
+  phase[SLOT1] = LOAD(b->phase[SLOT1]);
+  phase[SLOT2] = LOAD(b->phase[SLOT2]);
+
+  for (j=0; j<length; j++)
+  {
+    /* channel 8 */
+    b->out[j] += chan_calc_block_one(b, 8, j);
+
+    /* slot attenuation and phase, then advance phase */
+    am = _mm256_set1_epi32(b->am[j]);
+    sample = _mm256_set1_epi32(j);
+    for (k=0; k<2; k++)
+    {
+      env[k] = _mm256_add_epi32(_mm256_add_epi32(LOAD(b->tll[k]), LOAD(b->volume[k][j])),
+                                _mm256_and_si256(am, LOAD(b->am_mask[k])));
+      cur[k] = phase[k];
+      phase[k] = _mm256_add_epi32(_mm256_andnot_si256(_mm256_cmpeq_epi32(LOAD(b->reset[k]), sample), phase[k]),
+                                  LOAD(b->inc[k][b->pm[j]]));
+    }
+
+    /* SLOT 1 */
+    out = _mm256_andnot_si256(no_fb, _mm256_sllv_epi32(_mm256_add_epi32(out0, out1), fb));
+    out0 = out1;
+
+    idx = _mm256_and_si256(cur[SLOT1], phase_mask);
+    idx = _mm256_and_si256(_mm256_srli_epi32(_mm256_add_epi32(idx, out), FREQ_SH), sin_mask);
+    p = _mm256_add_epi32(_mm256_slli_epi32(env[SLOT1], 5),
+                         _mm256_i32gather_epi32((const int *)sin_tab, _mm256_add_epi32(idx, LOAD(b->wave[SLOT1])), 4));
+    out1 = _mm256_mask_i32gather_epi32(zero, tl_tab, p,
+                                       _mm256_and_si256(_mm256_cmpgt_epi32(env_quiet, env[SLOT1]),
+                                                        _mm256_cmpgt_epi32(tl_len, p)), 4);
+
+    /* SLOT 2 */
+    idx = _mm256_and_si256(cur[SLOT2], phase_mask);
+    idx = _mm256_and_si256(_mm256_srli_epi32(_mm256_add_epi32(idx, _mm256_slli_epi32(out0, 17)), FREQ_SH), sin_mask);
+    p = _mm256_add_epi32(_mm256_slli_epi32(env[SLOT2], 5),
+                         _mm256_i32gather_epi32((const int *)sin_tab, _mm256_add_epi32(idx, LOAD(b->wave[SLOT2])), 4));
+    out = _mm256_mask_i32gather_epi32(zero, tl_tab, p,
+                                      _mm256_and_si256(_mm256_cmpgt_epi32(env_quiet, env[SLOT2]),
+                                                       _mm256_cmpgt_epi32(tl_len, p)), 4);
+
+    /* mix channels */
+    sum = _mm_add_epi32(_mm256_castsi256_si128(out), _mm256_extracti128_si256(out, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+    b->out[j] += _mm_cvtsi128_si32(sum);
+  }
+
+  /* lane 8 is kept by chan_calc_block_one() */
+  _mm256_storeu_si256((__m256i *)b->phase[SLOT1], phase[SLOT1]);
+  _mm256_storeu_si256((__m256i *)b->phase[SLOT2], phase[SLOT2]);
+  _mm256_storeu_si256((__m256i *)b->op1_out[0], out0);
+  _mm256_storeu_si256((__m256i *)b->op1_out[1], out1);
+}
+
+#undef LOAD
+#endif
+
+static void (*chan_calc_block)(YM2413_BLOCK *b, int length) = chan_calc_block_c;
+
 /*
   operators used in the rhythm sounds generation process:
 
@@ -1238,14 +1419,13 @@ static int init_tables(void)
   sample[0]=fopen("sampsum.pcm","wb");
 #endif
 
-  return 1;
-}
-
-static void OPLCloseTable( void )
-{
-#ifdef SAVE_SAMPLE
-  fclose(sample[0]);
+  /* Pick melody channels block routine */
+#ifdef YM2413_AVX2
+  if (__builtin_cpu_supports("avx2"))
+    chan_calc_block = chan_calc_block_avx2;
 #endif
+
+  return 1;
 }
 
 
@@ -1848,21 +2028,11 @@ static void cymfile_callback (int n)
 }
 #endif
 
-/* lock/unlock for common table */
-static int OPLL_LockTable(void)
+/* common tables are built once and kept for all chips */
+static void OPLL_InitTables(void)
 {
-  num_lock++;
-  if(num_lock>1) return 0;
-
-  /* first time */
-
-  cur_chip = NULL;
   /* allocate total level table (128kb space) */
-  if( !init_tables() )
-  {
-    num_lock--;
-    return -1;
-  }
+  init_tables();
 
 #ifdef LOG_CYM_FILE
   cymfile = fopen("2413_.cym","wb");
@@ -1871,25 +2041,19 @@ static int OPLL_LockTable(void)
   else
     logerror("Could not create file 2413_.cym\n");
 #endif
+}
+
+static int OPLL_LockTable(void)
+{
+  worker_once(&tables_once, OPLL_InitTables);
 
+  cur_chip = NULL;
   return 0;
 }
 
 static void OPLL_UnLockTable(void)
 {
-  if(num_lock) num_lock--;
-  if(num_lock) return;
-
-  /* last time */
-
   cur_chip = NULL;
-  OPLCloseTable();
-
-#ifdef LOG_CYM_FILE
-  fclose (cymfile);
-  cymfile = NULL;
-#endif
-
 }
 
 static void OPLLResetChip(YM2413 *chip)
@@ -2010,11 +2174,9 @@ static unsigned char OPLLRead(YM2413 *chip,int a)
 
 
 
-#define MAX_OPLL_CHIPS 4
-
-
-static YM2413 *OPLL_YM2413[MAX_OPLL_CHIPS];  /* array of pointers to the YM2413's */
-static int YM2413NumChips = 0;        /* number of chips */
+/* YM2413 chips belong to the current machine context */
+#define OPLL_YM2413     (machine->fm.ym2413)  /* array of pointers to the YM2413's */
+#define YM2413NumChips  (machine->fm.ym2413_num)  /* number of chips */
 
 int YM2413Init(int num, int clock, int rate)
 {
@@ -2075,6 +2237,227 @@ void YM2413SetUpdateHandler(int which,OPLL_UPDATEHANDLER UpdateHandler,int param
 }
 
 
+/* all slots are off: chip output stays silent until next key on */
+static int OPLLIdle(YM2413 *chip)
+{
+  int i;
+
+  for (i=0; i<9*2; i++)
+  {
+    if (chip->P_CH[i/2].SLOT[i&1].state != EG_OFF)
+      return 0;
+  }
+
+  return 1;
+}
+
+/* advance a silent chip by 'length' samples: leaves it in the same state
+   as 'length' calls to advance_lfo() and advance() from YM2413UpdateOne */
+static void OPLLSkip(YM2413 *chip, int length)
+{
+  YM2413_OPLL_CH *CH;
+  YM2413_OPLL_SLOT *op;
+  UINT64 sum;
+  UINT32 run, left;
+  int i;
+
+  /* feedback history of calculated slots only gets zeroes */
+  for (i=0; i<9; i++)
+  {
+    if ((i < 7) || !(chip->rhythm&0x20))
+    {
+      op = &chip->P_CH[i].SLOT[SLOT1];
+      op->op1_out[0] = (length > 1) ? 0 : op->op1_out[1];
+      op->op1_out[1] = 0;
+    }
+  }
+
+  /* LFO AM */
+  sum = chip->lfo_am_cnt + (UINT64)chip->lfo_am_inc * length;
+  chip->lfo_am_cnt = (UINT32)(sum % ((UINT64)LFO_AM_TAB_ELEMENTS<<LFO_SH));
+  LFO_AM = lfo_am_table[ chip->lfo_am_cnt >> LFO_SH ] >> 1;
+
+  /* Envelope Generator: slots in EG_OFF don't change */
+  sum = chip->eg_timer + (UINT64)chip->eg_timer_add * length;
+  chip->eg_cnt += (UINT32)(sum / chip->eg_timer_overflow);
+  chip->eg_timer = (UINT32)(sum % chip->eg_timer_overflow);
+
+  /* Noise Generator */
+  advance_noise(chip, length);
+
+  /* Phase Generator: by runs of samples with the same LFO PM value */
+  while (length > 0)
+  {
+    chip->lfo_pm_cnt += chip->lfo_pm_inc;
+    LFO_PM = (chip->lfo_pm_cnt>>LFO_SH) & 7;
+
+    run = length;
+    if (chip->lfo_pm_inc)
+    {
+      left = ((~chip->lfo_pm_cnt) & ((1<<LFO_SH)-1)) / chip->lfo_pm_inc + 1;
+      if (left < run)
+        run = left;
+    }
+    chip->lfo_pm_cnt += chip->lfo_pm_inc * (run - 1);
+
+    for (i=0; i<9*2; i++)
+    {
+      CH  = &chip->P_CH[i/2];
+      op  = &CH->SLOT[i&1];
+
+      if(op->vib)
+      {
+        UINT8 block;
+
+        unsigned int fnum_lfo   = 8*((CH->block_fnum&0x01c0) >> 6);
+        unsigned int block_fnum = CH->block_fnum * 2;
+        signed int lfo_fn_table_index_offset = lfo_pm_table[LFO_PM + fnum_lfo ];
+
+        if (lfo_fn_table_index_offset)  /* LFO phase modulation active */
+        {
+          block_fnum += lfo_fn_table_index_offset;
+          block = (block_fnum&0x1c00) >> 10;
+          op->phase += (chip->fn_tab[block_fnum&0x03ff] >> (7-block)) * op->mul * run;
+          continue;
+        }
+      }
+
+      op->phase += op->freq * run;
+    }
+
+    length -= run;
+  }
+}
+
+
+/* generate melody mode samples by blocks: envelope and phase generators
+   run ahead for each slot, then all channels are calculated at once */
+static void OPLLUpdateMelody(YM2413 *chip, SAMP *bufMO, SAMP *bufRO, int length)
+{
+  YM2413_BLOCK b;
+  YM2413_OPLL_CH *CH;
+  YM2413_OPLL_SLOT *op;
+  UINT32 ticks[BLOCK_LEN];
+  UINT32 eg_cnt = chip->eg_cnt;
+  UINT32 k;
+  int i, j, n, mo, eg_on;
+
+  for (i=0; i<9; i++)
+  {
+    CH = &chip->P_CH[i];
+    b.wave[SLOT1][i] = CH->SLOT[SLOT1].wavetable;
+    b.wave[SLOT2][i] = CH->SLOT[SLOT2].wavetable;
+    b.fb_shift[i] = CH->SLOT[SLOT1].fb_shift;
+    b.op1_out[0][i] = CH->SLOT[SLOT1].op1_out[0];
+    b.op1_out[1][i] = CH->SLOT[SLOT1].op1_out[1];
+  }
+
+  while (length > 0)
+  {
+    n = (length < BLOCK_LEN) ? length : BLOCK_LEN;
+
+    /* LFO and envelope generator clock */
+    for (j=0; j<n; j++)
+    {
+      advance_lfo(chip);
+      b.am[j] = LFO_AM;
+      b.pm[j] = LFO_PM;
+
+      ticks[j] = 0;
+      chip->eg_timer += chip->eg_timer_add;
+      while (chip->eg_timer >= chip->eg_timer_overflow)
+      {
+        chip->eg_timer -= chip->eg_timer_overflow;
+        ticks[j]++;
+      }
+    }
+
+    /* slot envelope at each sample */
+    for (i=0; i<9*2; i++)
+    {
+      CH  = &chip->P_CH[i/2];
+      op  = &CH->SLOT[i&1];
+      eg_cnt = chip->eg_cnt;
+
+      b.tll[i&1][i/2] = op->TLL;
+      b.am_mask[i&1][i/2] = op->AMmask;
+      b.phase[i&1][i/2] = op->phase;
+      b.reset[i&1][i/2] = -1;
+      for (k=0; k<8; k++)
+        b.inc[i&1][k][i/2] = phase_inc(chip, CH, op, k);
+
+      /* envelope stays constant when off, sustained, or for a released modulator */
+      eg_on = !((op->state == EG_OFF) ||
+                ((op->state == EG_SUS) && op->eg_type) ||
+                ((op->state == EG_REL) && !(i&1)));
+
+      if (eg_on)
+      {
+        for (j=0; j<n; j++)
+        {
+          b.volume[i&1][j][i/2] = op->volume;
+
+          if (ticks[j])
+          {
+            /* phase restarts when leaving damp phase */
+            if (op->state == EG_DMP)
+            {
+              for (k=ticks[j]; k; k--)
+                advance_eg(chip, CH, op, i, ++eg_cnt);
+              if (op->state != EG_DMP)
+                b.reset[i&1][i/2] = j;
+            }
+            else
+            {
+              for (k=ticks[j]; k; k--)
+                advance_eg(chip, CH, op, i, ++eg_cnt);
+            }
+          }
+        }
+      }
+      else
+      {
+        for (j=0; j<n; j++)
+        {
+          b.volume[i&1][j][i/2] = op->volume;
+          eg_cnt += ticks[j];
+        }
+      }
+    }
+
+    LFO_PM = b.pm[n-1];
+
+    chip->eg_cnt = eg_cnt;
+    advance_noise(chip, n);
+
+    /* FM part */
+    memset(b.out, 0, n * sizeof(INT32));
+    chan_calc_block(&b, n);
+
+    for (i=0; i<9; i++)
+    {
+      chip->P_CH[i].SLOT[SLOT1].phase = b.phase[SLOT1][i];
+      chip->P_CH[i].SLOT[SLOT2].phase = b.phase[SLOT2][i];
+    }
+
+    for (j=0; j<n; j++)
+    {
+      mo = b.out[j] >> FINAL_SH;
+      *bufMO++ = limit( mo , MAXOUT, MINOUT );
+      *bufRO++ = 0;
+    }
+
+    length -= n;
+  }
+
+  for (i=0; i<9; i++)
+  {
+    chip->P_CH[i].SLOT[SLOT1].op1_out[0] = b.op1_out[0][i];
+    chip->P_CH[i].SLOT[SLOT1].op1_out[1] = b.op1_out[1][i];
+  }
+}
+
+
 /*
 ** Generate samples for one of the YM2413's
 **
@@ -2100,6 +2483,22 @@ void YM2413UpdateOne(int which, INT16 **buffers, int length)
     SLOT8_2 = &chip->P_CH[8].SLOT[SLOT2];
   }
 
+  /* silent chip: skip sound generation */
+  if (OPLLIdle(chip))
+  {
+    memset(bufMO, 0, length * sizeof(SAMP));
+    memset(bufRO, 0, length * sizeof(SAMP));
+    OPLLSkip(chip, length);
+    return;
+  }
+
+  /* melody mode: block processing */
+  if (!rhythm)
+  {
+    OPLLUpdateMelody(chip, bufMO, bufRO, length);
+    return;
+  }
+
 
   for( i=0; i < length ; i++ )
   {
@@ -22,6 +22,8 @@ typedef INT16 SAMP;
 typedef INT8 SAMP;
 #endif
 
+#define MAX_OPLL_CHIPS 4
+
 int  YM2413Init(int num, int clock, int rate);
 void YM2413Shutdown(void);
 void YM2413ResetChip(int which);
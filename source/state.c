@@ -23,17 +23,26 @@
  ******************************************************************************/
 
 #include "shared.h"
+#include "context.h"
 
-static unsigned char state[0x10000];
-static unsigned int bufferptr;
+#define STATE_SIZE 0x10000
 
-
-int system_save_state(void *mem)
+int system_save_state(machine_t *m, void *mem)
 {
   int i;
+  unsigned int bufferptr = 0;
 
   /* allocate temporary buffer */
-  bufferptr = 0;
+  uint8 *state = calloc(1, STATE_SIZE);
+  if (!state) return 0;
+
+  machine_select(m);
+
+  /*** Save header & version ***/
+  memcpy (&state[bufferptr], STATE_HEADER, 4);
+  bufferptr += 4;
+  state[bufferptr++] = STATE_VERSION >> 8;
+  state[bufferptr++] = STATE_VERSION & 0xff;
 
   /*** Save VDP state ***/
   memcpy (&state[bufferptr], &vdp, sizeof (vdp_t));
@@ -63,14 +72,14 @@ int system_save_state(void *mem)
   bufferptr += FM_GetContextSize ();
 
   /*** Save SN76489 ***/
-  memcpy (&state[bufferptr], SN76489_GetContextPtr (0),SN76489_GetContextSize ());
-  bufferptr += SN76489_GetContextSize ();
+  bufferptr += SN76489_SaveState (0, &state[bufferptr]);
 
 #ifdef NGC
   /* compress state file */
   unsigned long inbytes  = bufferptr;
   unsigned long outbytes = 0x12000;
   compress2 ((Bytef *)(mem + 4), &outbytes, (Bytef *)state, inbytes, 9);
+  free(state);
 
   /* write compressed size in the first 32 bits for decompression */
   memcpy(mem, &outbytes, 4);
@@ -80,16 +89,24 @@ int system_save_state(void *mem)
 
 #else
   /* write to FILE */
-  fwrite(&state[0], 0x10000, 1, mem);
+  fwrite(&state[0], STATE_SIZE, 1, mem);
+  free(state);
   return 0;
 #endif
 
 }
 
-void system_load_state(void *mem)
+void system_load_state(machine_t *m, void *mem)
 {
-  int i;
+  int i, version;
   uint8 *buf;
+  unsigned int bufferptr = 0;
+
+  /* allocate temporary buffer */
+  uint8 *state = calloc(1, STATE_SIZE);
+  if (!state) return;
+
+  machine_select(m);
 
 #ifdef NGC
   unsigned long inbytes, outbytes;
@@ -98,15 +115,25 @@ void system_load_state(void *mem)
   memcpy(&inbytes,mem,4);
 
   /* uncompress state file */
-  outbytes = 0x10000;
+  outbytes = STATE_SIZE;
   uncompress ((Bytef *)state, &outbytes, (Bytef *)(mem + 4), inbytes);
 #else
   /* write to FILE */
-  fread(&state[0], 0x10000, 1, mem);
+  fread(&state[0], STATE_SIZE, 1, mem);
 #endif
   
+  /* States without header were saved by version 1.4 */
+  if (!memcmp (&state[bufferptr], STATE_HEADER, 4))
+  {
+    version = (state[bufferptr + 4] << 8) | state[bufferptr + 5];
+    bufferptr += 6;
+  }
+  else
+  {
+    version = 0x0104;
+  }
+
   /* Initialize everything */
-  bufferptr = 0;
   system_reset();
    
   /*** Set vdp state ***/
@@ -144,8 +171,10 @@ void system_load_state(void *mem)
   bufferptr += FM_GetContextSize ();
 
   /*** Set SN76489 ***/
-  memcpy (SN76489_GetContextPtr(0), &state[bufferptr], SN76489_GetContextSize ());
-  bufferptr += SN76489_GetContextSize ();
+  bufferptr += SN76489_LoadState (0, &state[bufferptr], version);
+  SN76489_SetClock (0, snd.psg_clock, snd.sample_rate);
+
+  free(state);
 
   if ((sms.console != CONSOLE_COLECO) && (sms.console != CONSOLE_SG1000))
   {
@@ -182,6 +211,9 @@ void system_load_state(void *mem)
     bg_name_dirty[i] = -1;
   }
 
+  /* Force sprite line index update */
+  spr_dirty = 1;
+
   /* Restore palette */
   for(i = 0; i < PALETTE_SIZE; i++)
     palette_sync(i);
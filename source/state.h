@@ -26,11 +26,11 @@
 #define _STATE_H_
 
 
-#define STATE_VERSION   0x0104      /* Version 1.4 (BCD) */
+#define STATE_VERSION   0x0105      /* Version 1.5 (BCD) */
 #define STATE_HEADER    "SST\0"     /* State file header */
 
 /* Function prototypes */
-extern int system_save_state(void *mem);
-extern void system_load_state(void *mem);
+extern int system_save_state(machine_t *m, void *mem);
+extern void system_load_state(machine_t *m, void *mem);
 
 #endif /* _STATE_H_ */
@@ -23,15 +23,72 @@
  ******************************************************************************/
 
 #include "shared.h"
+#include "context.h"
 
-bitmap_t bitmap;
-cart_t cart;
-input_t input;
+/* Default machine context */
+static machine_t default_machine;
+
+/* Current machine context */
+THREAD_LOCAL machine_t *machine = &default_machine;
+
+/* Allocate a new machine context, set up with the frontend settings */
+machine_t *machine_new(void)
+{
+  machine_t *m = calloc(1, sizeof(machine_t));
+
+  if (m)
+    m->option = option;
+
+  return m;
+}
+
+/* Release a machine context and its allocated data */
+void machine_delete(machine_t *m)
+{
+  machine_t *current = machine;
+
+  if (!m || (m == &default_machine))
+    return;
+
+  machine = m;
+  vdplog_shutdown();
+  output_shutdown();
+  sound_shutdown();
+#ifndef NGC
+  if (cart.rom)
+  {
+    free(cart.rom);
+    cart.rom = NULL;
+  }
+#endif
+  machine = (current == m) ? &default_machine : current;
+
+  free(m);
+}
+
+/* Set the machine context used by the current thread */
+void machine_select(machine_t *m)
+{
+  machine = m ? m : &default_machine;
+}
+
+/* Z80 I/O port access: catch up with lines run through since last access */
+static void system_io_sync(int cycles)
+{
+  int line = cycles / CYCLES_PER_LINE;
+
+  if (line > vdp.line)
+    vdp.line = line;
+}
 
 /* Run the virtual console emulation for one frame */
-void system_frame(int skip_render)
+void system_frame(machine_t *m, int skip_render)
 {
-  int iline, line_z80 = 0;
+  int iline, line, next;
+
+  machine_select(m);
+
+  PROFILE_BEGIN(PROF_FRAME);
 
   /* Debounce pause key */
   if(input.system & INPUT_PAUSE)
@@ -52,7 +109,7 @@ void system_frame(int skip_render)
   text_counter = 0;
 
   /* 3D glasses faking */
-  if (sms.glasses_3d) skip_render = sms.wram[0x1ffb];
+  if (sms.glasses_3d) skip_render = (skip_render & SKIP_AUDIO) | (sms.wram[0x1ffb] ? SKIP_VIDEO : 0);
 
   /* VDP register 9 is latched during VBLANK */
   vdp.vscroll = vdp.reg[9];
@@ -63,17 +120,22 @@ void system_frame(int skip_render)
   /* Reset collision flag infos */
   vdp.spr_col = 0xff00;
 
-  /* Line processing */
-  for(vdp.line = 0; vdp.line < vdp.lpf; vdp.line++)
+  /* Lines are rendered on VDP accesses and at the end of the frame */
+  render_start(skip_render & SKIP_VIDEO);
+
+  /* Sound chips are only run when audio output is needed */
+  snd.skip = (skip_render & SKIP_AUDIO) ? 1 : 0;
+
+  /* Line processing: the Z80 runs straight up to the next line where */
+  /* something has to be done (HINT or VINT)                           */
+  machine->z80.io_sync = system_io_sync;
+  vdp.line = 0;
+
+  while (vdp.line < vdp.lpf)
   {
+    line = vdp.line;
     iline = vdp.height;
 
-    /* VDP line rendering */
-    if(!skip_render)
-    {
-      render_line(vdp.line);
-    }
-
     /* Horizontal Interrupt */
     if (sms.console >= CONSOLE_SMS)
     {
@@ -89,7 +151,11 @@ void system_frame(int skip_render)
             /* This means that if Z80 cycle count is exactly a multiple of CYCLES_PER_LINE, */
             /* interrupt should be triggered AFTER the next instruction.                    */
             if (!(z80_get_elapsed_cycles()%CYCLES_PER_LINE))
+            {
+              PROFILE_BEGIN(PROF_Z80);
               z80_execute(1);
+              PROFILE_END();
+            }
               
             z80_set_irq_line(0, ASSERT_LINE);
           }
@@ -97,9 +163,28 @@ void system_frame(int skip_render)
       }
     }
 
-    /* Run Z80 CPU */
-    line_z80 += CYCLES_PER_LINE;
-    z80_execute(line_z80 - z80_cycle_count);
+    /* Next line to raise VINT (after last active line) or HINT */
+    next = vdp.lpf;
+    if (line <= iline)
+    {
+      next = iline + 1;
+      if ((sms.console >= CONSOLE_SMS) && (line + vdp.left + 1 < next))
+        next = line + vdp.left + 1;
+    }
+
+    /* Run Z80 CPU (VDP register writes changing the display height end the run) */
+    PROFILE_BEGIN(PROF_Z80);
+    z80_execute(next * CYCLES_PER_LINE - z80_cycle_count);
+    PROFILE_END();
+
+    /* Last line run through (an instruction never overlaps a whole line) */
+    next = z80_cycle_count / CYCLES_PER_LINE;
+
+    /* HINT counter of lines run through */
+    if ((sms.console >= CONSOLE_SMS) && (line <= iline))
+      vdp.left -= next - line - 1;
+
+    vdp.line = next - 1;
 
     /* Vertical Interrupt */
     if(vdp.line == iline)
@@ -112,12 +197,22 @@ void system_frame(int skip_render)
       }
     }
 
-    /* Run sound chips */
-    sound_update(vdp.line);
+    vdp.line = next;
   }
 
+  /* Render remaining lines */
+  render_sync(vdp.lpf - 1);
+  render_end();
+
+  /* Run sound chips up to the end of frame */
+  PROFILE_BEGIN(PROF_SOUND);
+  sound_end();
+  PROFILE_END();
+
   /* Adjust Z80 cycle count for next frame */
-  z80_cycle_count -= line_z80;
+  z80_cycle_count -= vdp.lpf * CYCLES_PER_LINE;
+
+  PROFILE_END();
 }
 
 void system_init(void)
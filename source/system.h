@@ -81,26 +81,73 @@ typedef struct
   int width;
   int height;
   int pitch;
-  int depth;
+  int depth;        /* 8 (palette indexes), 15, 16 or 32 bits per pixel */
   int granularity;
   struct {
     int x, y, w, h;
     int ox, oy, ow, oh;
     int changed;
   } viewport;    
+  struct {
+    uint8 color[PALETTE_SIZE][3]; /* RGB values of each palette entry */
+    uint8 dirty[PALETTE_SIZE];    /* 1= entry was modified */
+    uint8 update;                 /* 1= one or more entries were modified */
+  } pal;
 } bitmap_t;
 
-/* Global variables */
-extern bitmap_t bitmap;   /* Display bitmap */
-extern cart_t cart;       /* Game cartridge data */
-extern input_t input;     /* Controller input */
+/* Emulated machine context */
+typedef struct
+{
+  sms_t sms;                  /* SMS context */
+  bios_t bios;                /* BIOS ROM */
+  slot_t slot;                /* Active ROM slot */
+  t_coleco coleco;            /* Colecovision support */
+  cart_t cart;                /* Game cartridge data */
+  vdp_t vdp;                  /* VDP context */
+  bitmap_t bitmap;            /* Display bitmap */
+  input_t input;              /* Controller input */
+  snd_t snd;                  /* Sound emulation */
+  z80_t z80;                  /* Z80 CPU context */
+  uint8 dummy_write[0x400];   /* Unmapped memory */
+  uint8 dummy_read[0x400];
+  uint8 data_bus_pullup;      /* Pull-up resistors on data bus */
+  uint8 data_bus_pulldown;
+  render_t render;
+  tms_t tms;
+  pio_t pio;
+  fm_t fm;
+  SN76489_Context psg[MAX_SN76489];
+  profile_t profile;          /* Subsystem timing */
+  output_t output;            /* Pipelined frame output */
+  vdplog_t *vdplog;           /* Render thread (NULL: lines are drawn by the Z80 thread) */
+  t_option option;            /* Emulation settings (copy of the frontend ones) */
+#ifndef NGC
+  char game_name[PATH_MAX];   /* Loaded ROM file (name of the file inside zip archives) */
+#endif
+} machine_t;
+
+/* Current machine context */
+extern THREAD_LOCAL machine_t *machine;
+
+/* Global variables (current machine context) */
+#define sms                 (machine->sms)
+#define bitmap              (machine->bitmap)
+#define input               (machine->input)
+#define snd                 (machine->snd)
+
+/* system_frame() output skipping flags: guest-visible state is emulated the same way */
+#define SKIP_VIDEO          0x01    /* no video output (sprite status flags are kept) */
+#define SKIP_AUDIO          0x02    /* no audio output (sound chip registers are kept) */
 
 /* Function prototypes */
-extern void system_frame(int skip_render);
+extern machine_t *machine_new(void);
+extern void machine_delete(machine_t *m);
+extern void machine_select(machine_t *m);
+extern void system_frame(machine_t *m, int skip_render);
 extern void system_init(void);
 extern void system_shutdown(void);
 extern void system_reset(void);
-extern void system_manage_sram(uint8 *sram, int slot, int mode);
+extern void system_manage_sram(uint8 *sram, int which, int mode);
 extern void system_poweron(void);
 extern void system_poweroff(void);
 
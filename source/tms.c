@@ -21,8 +21,11 @@
  ******************************************************************************/
 
 #include "shared.h"
+#include "context.h"
 
-int text_counter;               /* Text offset counter */
+/* TMS9918 rendering context (current machine) */
+#define sprites        (machine->tms.sprites)
+#define sprites_found  (machine->tms.sprites_found)
 
 static uint8 tms_lookup[16][256][2];   /* Expand BD, PG data into 8-bit pixels (G1,G2) */
 static uint8 mc_lookup[16][256][8];    /* Expand BD, PG data into 8-bit pixels (MC) */
@@ -35,16 +38,6 @@ static const uint8 name_mask[]  = {0xFF, 0xFF, 0xFC, 0xFC};
 static const uint8 diff_shift[] = {0, 1, 0, 1};
 static const uint8 size_tab[]   = {8, 16, 16, 32};
 
-/* Internally latched sprite data in the VDP */
-typedef struct {
-    int xpos;
-    uint8 attr;
-    uint8 sg[2];
-} tms_sprite;
-
-static tms_sprite sprites[4];
-static int sprites_found;
-
 static void render_bg_m0(int line);
 static void render_bg_m1(int line);
 static void render_bg_m1x(int line);
@@ -53,6 +46,38 @@ static void render_bg_m3(int line);
 static void render_bg_m3x(int line);
 static void render_bg_m2(int line);
 
+/* Rebuild the sprite line index: SA entries falling on each line */
+static void update_spr_index(int size)
+{
+    int yp, i, v, end;
+
+    memset(spr_mask, 0, sizeof(spr_mask));
+
+    for(i = 0; i < 32; i++)
+    {
+        /* Fetch Y coordinate */
+        yp = vdp.vram[vdp.sa + (i << 2)];
+
+        /* Check for end marker */
+        if(yp == 0xD0)
+            break;
+
+        /* Wrap Y position */
+        if(yp > 0xE0)
+            yp -= 256;
+
+        /* Lines within vertical range */
+        end = yp + size;
+        if(end > 256)
+            end = 256;
+        for(v = (yp < 0) ? 0 : yp; v < end; v++)
+            spr_mask[v][0] |= (1U << i);
+    }
+
+    /* Number of entries before end marker */
+    spr_end = i;
+}
+
 void parse_line(int line)
 {
     int yp, i;
@@ -60,68 +85,72 @@ void parse_line(int line)
     int size = size_tab[mode];
     int diff, name;
     uint8 *sa, *sg;
+    uint32 bits, key;
     tms_sprite *p;
 
     /* Reset # of sprites found */
     sprites_found = 0;
 
-    /* Parse sprites */
-    for(i = 0; i < 32; i++)
+    /* Update sprite line index if SA or sprite size were modified */
+    key = (mode << 16) | vdp.sa;
+    if(spr_dirty || (spr_key != key))
     {
-        /* Point to current sprite in SA and our current sprite record */
-        p = &sprites[sprites_found];
-        sa = &vdp.vram[vdp.sa + (i << 2)];
+        update_spr_index(size);
+        spr_key = key;
+        spr_dirty = 0;
+    }
 
-        /* Fetch Y coordinate */
-        yp = sa[0];
+    /* Last entry processed when no overflow occurs */
+    i = spr_end;
 
-        /* Check for end marker */
-        if(yp == 0xD0)
+    /* Parse sprites falling on following line, in SA order */
+    for(bits = ((unsigned)line < 256) ? spr_mask[line][0] : 0; bits; bits &= (bits - 1))
+    {
+        /* Sprite overflow on this line */
+        if(sprites_found == 4)
+        {
+            /* Set 5S and abort parsing */
+            vdp.status |= 0x40;
+            i = lowest_bit(bits);
             goto parse_end;
+        }
+
+        /* Point to current sprite in SA and our current sprite record */
+        p = &sprites[sprites_found];
+        sa = &vdp.vram[vdp.sa + (lowest_bit(bits) << 2)];
 
         /* Wrap Y position */
+        yp = sa[0];
         if(yp > 0xE0)
             yp -= 256;
 
-        /* Check if sprite falls on following line */
-        if(line >= yp && line < (yp + size))
-        {
-            /* Sprite overflow on this line */
-            if(sprites_found == 4)
-            {
-                /* Set 5S and abort parsing */
-                vdp.status |= 0x40;
-                goto parse_end;
-            }
+        /* Fetch X position */
+        p->xpos = sa[1];
 
-            /* Fetch X position */
-            p->xpos = sa[1];
+        /* Fetch name */
+        name = sa[2] & name_mask[mode];
 
-            /* Fetch name */
-            name = sa[2] & name_mask[mode];
+        /* Load attribute into attribute storage */
+        p->attr = sa[3];
 
-            /* Load attribute into attribute storage */
-            p->attr = sa[3];
+        /* Apply early clock bit */
+        if(p->attr & 0x80)
+            p->xpos -= 32;
 
-            /* Apply early clock bit */
-            if(p->attr & 0x80)
-                p->xpos -= 32;
+        /* Calculate offset in pattern */
+        diff = ((line - yp) >> diff_shift[mode]) & diff_mask[mode];
 
-            /* Calculate offset in pattern */
-            diff = ((line - yp) >> diff_shift[mode]) & diff_mask[mode];
+        /* Insert additional name bit for 16-pixel tall sprites */
+        if(diff & 8)
+            name |= 1;
 
-            /* Insert additional name bit for 16-pixel tall sprites */
-            if(diff & 8)
-                name |= 1;
+        /* Fetch SG data */
+        sg = &vdp.vram[vdp.sg | (name << 3) | (diff & 7)];
+        p->sg[0] = sg[0x00];
+        p->sg[1] = sg[0x10];
 
-            /* Fetch SG data */
-            sg = &vdp.vram[vdp.sg | (name << 3) | (diff & 7)];
-            p->sg[0] = sg[0x00];
-            p->sg[1] = sg[0x10];
-
-            /* Bump found sprite count */
-            ++sprites_found;
-        }
+        /* Bump found sprite count */
+        ++sprites_found;
     }
 parse_end:
 
@@ -427,6 +456,14 @@ void render_bg_tms(int line)
     }
 }
 
+/* Skipped frames: clear what render_bg_tms() would draw (sprite collisions */
+/* only depend on the sprite marker, which background pixels never set)     */
+void skip_bg_tms(int line)
+{
+    /* Invalid modes do not draw the right border */
+    memset(linebuf, 0, ((vdp.mode & 5) == 5) ? 240 : 256);
+}
+
 /* Graphics I */
 static void render_bg_m0(int line)
 {
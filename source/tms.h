@@ -23,12 +23,24 @@
 #ifndef _TMS_H_
 #define _TMS_H_
 
-/* Global variables */
-extern int text_counter;
+/* Internally latched sprite data in the VDP */
+typedef struct {
+    int xpos;
+    uint8 attr;
+    uint8 sg[2];
+} tms_sprite;
+
+/* TMS9918 rendering context */
+typedef struct {
+    int text_counter;           /* Text offset counter */
+    tms_sprite sprites[4];
+    int sprites_found;
+} tms_t;
 
 /* Function prototypes */
 extern void make_tms_tables(void);
 extern void render_bg_tms(int line);
+extern void skip_bg_tms(int line);
 extern void render_obj_tms(int line);
 extern void parse_line(int line);
 
@@ -5,6 +5,6 @@
 /* Function prototypes */
 uint8 *loadFromZipByName(char *archive, char *filename, int *filesize);
 int check_zip(char *filename);
-int gzsize(gzFile *gd);
+int gzsize(gzFile gd);
 
 #endif /* _FILEIO_H_ */
@@ -23,6 +23,7 @@
  ******************************************************************************/
 
 #include "shared.h"
+#include "context.h"
 #include "hvc.h"
 
 /* Mark a pattern as dirty */
@@ -37,15 +38,19 @@
   bg_name_dirty[name] |= (1 << ((addr >> 2) & 7));  \
 }
 
-
-/* VDP context */
-vdp_t vdp;
+/* Mark the sprite line index as dirty when a sprite Y coordinate is modified */
+#define MARK_SPR_DIRTY(addr)                        \
+{                                                   \
+  if((((addr) & 0x3FC0) == vdp.satb) ||             \
+     (((addr) & 0x3F83) == vdp.sa))                 \
+    spr_dirty = 1;                                  \
+}
 
 /* Initialize VDP emulation */
 void vdp_init(void)
 {
   /* display area */
-  if ((sms.console == CONSOLE_GG) && (!option.extra_gg))
+  if ((sms.console == CONSOLE_GG) && (!machine->option.extra_gg))
   {
     bitmap.viewport.w = 160;
     bitmap.viewport.x = 48;
@@ -57,7 +62,7 @@ void vdp_init(void)
   }
 
   /* overscan area */
-  if (option.overscan)
+  if (machine->option.overscan)
   {
     bitmap.viewport.x += 14;
   }
@@ -121,6 +126,7 @@ void vdp_reset(void)
 void viewport_check(void)
 {
   int i;
+  int height = vdp.height;
   int m1 = (vdp.reg[1] >> 4) & 1;
   int m3 = (vdp.reg[1] >> 3) & 1;
   int m2 = (vdp.reg[0] >> 1) & 1;
@@ -166,8 +172,12 @@ void viewport_check(void)
     if ((vdp.mode & 0x09) == 0x09) vdp.mode = 1;
   }
 
+  /* VINT & HINT lines have changed: Z80 has to stop at the end of this line */
+  if (vdp.height != height)
+    z80_end_timeslice((vdp.line + 1) * CYCLES_PER_LINE);
+
   /* update display area */
-  if ((sms.console != CONSOLE_GG) || option.extra_gg)
+  if ((sms.console != CONSOLE_GG) || machine->option.extra_gg)
   {
     if(bitmap.viewport.h != vdp.height)
     {
@@ -184,7 +194,7 @@ void viewport_check(void)
 
   /* update border area */
   bitmap.viewport.y = 0;
-  if (option.overscan)
+  if (machine->option.overscan)
   {
     int max = sms.display ? 288 : 240;
     bitmap.viewport.y = (max - bitmap.viewport.h) / 2;
@@ -219,6 +229,7 @@ void vdp_reg_w(uint8 r, uint8 d)
 {
   /* Store register data */
   vdp.reg[r] = d;
+  VDPLOG_WRITE(VDPLOG_REG | (r << 8) | d);
 
   switch(r)
   {
@@ -269,15 +280,21 @@ void vdp_reg_w(uint8 r, uint8 d)
 }
 
 
+/* VRAM write replayed by the render thread (see vdplog.c) */
+void vdp_vram_replay(int index, uint8 data)
+{
+  vdp.vram[index] = data;
+  MARK_BG_DIRTY(index);
+  MARK_SPR_DIRTY(index);
+}
+
+
 void vdp_write(int offset, uint8 data)
 {
   int index;
 
-  if (((z80_get_elapsed_cycles() + 1) / CYCLES_PER_LINE) > vdp.line)
-  {
-    /* render next line now BEFORE updating register */
-    render_line((vdp.line+1)%vdp.lpf);
-  }
+  /* render lines up to next one now BEFORE updating register */
+  render_sync((z80_get_elapsed_cycles() + 1) / CYCLES_PER_LINE);
 
   switch(offset & 1)
   {
@@ -295,6 +312,8 @@ void vdp_write(int offset, uint8 data)
           {
             vdp.vram[index] = data;
             MARK_BG_DIRTY(vdp.addr);
+            MARK_SPR_DIRTY(index);
+            VDPLOG_WRITE(VDPLOG_VRAM | (index << 8) | data);
           }
           vdp.buffer = data;
           break;
@@ -305,6 +324,7 @@ void vdp_write(int offset, uint8 data)
           {
             vdp.cram[index] = data;
             palette_sync(index);
+            VDPLOG_WRITE(VDPLOG_CRAM | (index << 16) | (index << 8) | data);
           }
           vdp.buffer = data;
           break;
@@ -364,8 +384,8 @@ uint8 vdp_read(int offset)
       {
         if (line == vdp.height) vdp.status |= 0x80;
         line = (line + 1)%vdp.lpf;
-        render_line(line);
       }
+      render_sync(cyc / CYCLES_PER_LINE);
 
       /* low 5 bits return non-zero data (fixes PGA Tour Golf course map introduction) */
       temp = vdp.status | 0x1f;
@@ -396,6 +416,22 @@ uint8 vdp_read(int offset)
   return -1;
 }
 
+/* V counter is constant during a line */
+int vdp_counter_idle(int start)
+{
+  return (start / CYCLES_PER_LINE + 1) * CYCLES_PER_LINE;
+}
+
+/* Status flags are only raised before the current line is executed */
+/* (except for delayed SPR_COL flag), then cleared by the first read */
+int vdp_status_idle(int start)
+{
+  if ((vdp.status & 0x20) || ((start / CYCLES_PER_LINE) != vdp.line))
+    return 0;
+
+  return (vdp.line + 1) * CYCLES_PER_LINE;
+}
+
 uint8 vdp_counter_r(int offset)
 {
   switch(offset & 1)
@@ -420,11 +456,8 @@ void gg_vdp_write(int offset, uint8 data)
 {
   int index;
 
-  if (((z80_get_elapsed_cycles() + 1) / CYCLES_PER_LINE) > vdp.line)
-  {
-    /* render next line now BEFORE updating register */
-    render_line((vdp.line+1)%vdp.lpf);
-  }
+  /* render lines up to next one now BEFORE updating register */
+  render_sync((z80_get_elapsed_cycles() + 1) / CYCLES_PER_LINE);
 
   switch(offset & 1)
   {
@@ -440,6 +473,8 @@ void gg_vdp_write(int offset, uint8 data)
           {
             vdp.vram[index] = data;
             MARK_BG_DIRTY(vdp.addr);
+            MARK_SPR_DIRTY(index);
+            VDPLOG_WRITE(VDPLOG_VRAM | (index << 8) | data);
           }
           vdp.buffer = data;
           break;
@@ -451,6 +486,8 @@ void gg_vdp_write(int offset, uint8 data)
             vdp.cram[(vdp.addr & 0x3E) | (0)] = (vdp.cram_latch >> 0) & 0xFF;
             vdp.cram[(vdp.addr & 0x3E) | (1)] = (vdp.cram_latch >> 8) & 0xFF;
             palette_sync((vdp.addr >> 1) & 0x1F);
+            VDPLOG_WRITE(VDPLOG_CRAM | (((vdp.addr >> 1) & 0x1F) << 16) | ((vdp.addr & 0x3E) << 8) | (vdp.cram_latch & 0xFF));
+            VDPLOG_WRITE(VDPLOG_CRAM | (((vdp.addr >> 1) & 0x1F) << 16) | (((vdp.addr & 0x3E) | 1) << 8) | (vdp.cram_latch >> 8));
           }
           else
           {
@@ -500,6 +537,9 @@ void md_vdp_write(int offset, uint8 data)
 {
   int index;
 
+  /* render lines up to current one BEFORE updating register */
+  render_sync(vdp.line);
+
   switch(offset & 1)
   {
     case 0: /* Data port */
@@ -515,6 +555,8 @@ void md_vdp_write(int offset, uint8 data)
           {
             vdp.vram[index] = data;
             MARK_BG_DIRTY(vdp.addr);
+            MARK_SPR_DIRTY(index);
+            VDPLOG_WRITE(VDPLOG_VRAM | (index << 8) | data);
           }
           break;
     
@@ -525,6 +567,7 @@ void md_vdp_write(int offset, uint8 data)
           {
             vdp.cram[index] = data;
             palette_sync(index);
+            VDPLOG_WRITE(VDPLOG_CRAM | (index << 16) | (index << 8) | data);
           }
           break;
       }
@@ -568,6 +611,9 @@ void tms_write(int offset, int data)
 {
   int index;
 
+  /* render lines up to current one BEFORE updating register */
+  render_sync(vdp.line);
+
   switch(offset & 1)
   {
     case 0: /* Data port */
@@ -585,6 +631,8 @@ void tms_write(int offset, int data)
           {
             vdp.vram[index] = data;
             MARK_BG_DIRTY(vdp.addr);
+            MARK_SPR_DIRTY(index);
+            VDPLOG_WRITE(VDPLOG_VRAM | (index << 8) | data);
           }
           break;
       }
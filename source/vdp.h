@@ -69,7 +69,6 @@ typedef struct
 } vdp_t;
 
 /* Global data */
-extern vdp_t vdp;
 extern uint8 hc_256[228];
 
 /* Function prototypes */
@@ -77,9 +76,13 @@ extern void vdp_init(void);
 extern void vdp_shutdown(void);
 extern void vdp_reset(void);
 extern void viewport_check(void);
+extern void vdp_reg_w(uint8 r, uint8 d);
 extern uint8 vdp_counter_r(int offset);
+extern int vdp_counter_idle(int start);
+extern int vdp_status_idle(int start);
 extern uint8 vdp_read(int offset);
 extern void vdp_write(int offset, uint8 data);
+extern void vdp_vram_replay(int index, uint8 data);
 extern void gg_vdp_write(int offset, uint8 data);
 extern void md_vdp_write(int offset, uint8 data);
 extern void tms_write(int offset, int data);
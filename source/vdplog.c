@@ -0,0 +1,298 @@
+/******************************************************************************
+ *  Sega Master System / GameGear Emulator
+ *  Copyright (C) 1998-2007  Charles MacDonald
+ *
+ *  additionnal code by Eke-Eke (SMS Plus GX)
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *   VDP state log (render thread)
+ *
+ *   The Z80 thread only runs the sprite part of rendering, which is what
+ *   status flags depend on, and logs every VRAM, CRAM and register change
+ *   as well as each run of lines to be drawn. A render thread replays the
+ *   log on a shadow copy of the VDP & rendering context and draws the
+ *   lines, while the Z80 thread keeps on emulating the frame. Both sides
+ *   only meet at the end of each frame.
+ *
+ ******************************************************************************/
+
+#include "shared.h"
+#include "context.h"
+
+#if WORKER_THREADS
+#include <pthread.h>
+#include <sched.h>
+
+struct vdplog_t
+{
+  machine_t *shadow;              /* Render thread context */
+  uint32 event[VDPLOG_SIZE];
+  unsigned int head;              /* # of events logged (Z80 thread) */
+  unsigned int tail;              /* # of events replayed (render thread) */
+  unsigned int frames;            /* # of frames logged */
+  unsigned int done;              /* # of frames drawn */
+  int sleeping;                   /* 1= render thread waits for events */
+  int resync;                     /* 1= shadow context has to be copied again */
+  int quit;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t idle;
+};
+
+/* Replay one event on the shadow context */
+static void vdplog_replay(vdplog_t *log, uint32 event)
+{
+  switch (event & VDPLOG_TYPE)
+  {
+    case VDPLOG_VRAM:
+      vdp_vram_replay((event >> 8) & 0x3FFF, event & 0xFF);
+      break;
+
+    case VDPLOG_CRAM:
+      vdp.cram[(event >> 8) & 0x3F] = event & 0xFF;
+      palette_sync((event >> 16) & 0x1F);
+      break;
+
+    case VDPLOG_REG:
+      vdp_reg_w((event >> 8) & 0x0F, event & 0xFF);
+      break;
+
+    case VDPLOG_RUN:
+      vdp.line = (event >> 12) & 0xFFF;
+      render_sync(event & 0xFFF);
+      break;
+
+    case VDPLOG_END:
+      render_end();
+      pthread_mutex_lock(&log->lock);
+      log->done++;
+      pthread_cond_signal(&log->idle);
+      pthread_mutex_unlock(&log->lock);
+      break;
+  }
+}
+
+static void *vdplog_main(void *arg)
+{
+  vdplog_t *log = arg;
+  unsigned int tail = 0;
+
+  machine_select(log->shadow);
+
+  for (;;)
+  {
+    unsigned int head = __atomic_load_n(&log->head, __ATOMIC_SEQ_CST);
+
+    if (tail == head)
+    {
+      /* wait for more events */
+      pthread_mutex_lock(&log->lock);
+      __atomic_store_n(&log->sleeping, 1, __ATOMIC_SEQ_CST);
+      while (!log->quit && (__atomic_load_n(&log->head, __ATOMIC_SEQ_CST) == tail))
+        pthread_cond_wait(&log->wake, &log->lock);
+      __atomic_store_n(&log->sleeping, 0, __ATOMIC_SEQ_CST);
+      pthread_mutex_unlock(&log->lock);
+
+      if (log->quit) break;
+      continue;
+    }
+
+    while (tail != head)
+    {
+      vdplog_replay(log, log->event[tail & (VDPLOG_SIZE - 1)]);
+      __atomic_store_n(&log->tail, ++tail, __ATOMIC_RELEASE);
+    }
+  }
+
+  return NULL;
+}
+
+/* Wake the render thread up if it waits for events */
+static void vdplog_wake(vdplog_t *log)
+{
+  if (__atomic_load_n(&log->sleeping, __ATOMIC_SEQ_CST))
+  {
+    pthread_mutex_lock(&log->lock);
+    pthread_cond_signal(&log->wake);
+    pthread_mutex_unlock(&log->lock);
+  }
+}
+
+/* Z80 thread: add an event to the log */
+void vdplog_put(uint32 event)
+{
+  vdplog_t *log = machine->vdplog;
+  unsigned int head = log->head;
+
+  /* log is full: let the render thread catch up */
+  while ((head - __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE)) >= VDPLOG_SIZE)
+  {
+    vdplog_wake(log);
+    sched_yield();
+  }
+
+  log->event[head & (VDPLOG_SIZE - 1)] = event;
+  __atomic_store_n(&log->head, head + 1, __ATOMIC_SEQ_CST);
+
+  /* lines are drawn as soon as possible */
+  if (event >= VDPLOG_RUN)
+    vdplog_wake(log);
+}
+
+/* Start a render thread for the current machine context */
+int vdplog_init(void)
+{
+  vdplog_t *log;
+
+  if (machine->vdplog)
+    return 1;
+
+  log = calloc(1, sizeof(vdplog_t));
+  if (!log)
+    return 0;
+
+  log->shadow = machine_new();
+  if (!log->shadow)
+  {
+    free(log);
+    return 0;
+  }
+
+  pthread_mutex_init(&log->lock, NULL);
+  pthread_cond_init(&log->wake, NULL);
+  pthread_cond_init(&log->idle, NULL);
+  log->resync = 1;
+
+  if (pthread_create(&log->thread, NULL, vdplog_main, log))
+  {
+    pthread_cond_destroy(&log->idle);
+    pthread_cond_destroy(&log->wake);
+    pthread_mutex_destroy(&log->lock);
+    free(log->shadow);
+    free(log);
+    return 0;
+  }
+
+  machine->vdplog = log;
+  return 1;
+}
+
+/* Stop the render thread: lines are drawn by the Z80 thread again */
+void vdplog_shutdown(void)
+{
+  vdplog_t *log = machine->vdplog;
+
+  if (!log)
+    return;
+
+  pthread_mutex_lock(&log->lock);
+  log->quit = 1;
+  pthread_cond_signal(&log->wake);
+  pthread_mutex_unlock(&log->lock);
+  pthread_join(log->thread, NULL);
+
+  pthread_cond_destroy(&log->idle);
+  pthread_cond_destroy(&log->wake);
+  pthread_mutex_destroy(&log->lock);
+  free(log->shadow);
+  free(log);
+
+  machine->vdplog = NULL;
+}
+
+/* VDP state was modified outside of emulation (reset, state loading) */
+void vdplog_resync(void)
+{
+  if (machine->vdplog)
+    machine->vdplog->resync = 1;
+}
+
+/* Start of frame (render thread is idle): copy what is not logged */
+void vdplog_start(int skip)
+{
+  machine_t *m = machine;
+  vdp_t *v = &vdp;
+  sms_t *sm = &sms;
+  bitmap_t *b = &bitmap;
+  input_t *in = &input;
+  int counter = text_counter;
+  int resync = m->vdplog->resync;
+
+  m->vdplog->resync = 0;
+  machine_select(m->vdplog->shadow);
+
+  if (resync)
+  {
+    vdp = *v;
+    machine->render = m->render;
+    machine->tms = m->tms;
+  }
+
+  sms = *sm;
+  bitmap = *b;
+  input = *in;
+  vdp.vscroll = v->vscroll;
+  vdp.spr_col = v->spr_col;
+  text_counter = counter;
+  render_start(skip);
+
+  machine_select(m);
+}
+
+/* End of frame: wait until all lines are drawn */
+void vdplog_end(void)
+{
+  vdplog_t *log = machine->vdplog;
+
+  vdplog_put(VDPLOG_END);
+  log->frames++;
+
+  pthread_mutex_lock(&log->lock);
+  while (log->done != log->frames)
+    pthread_cond_wait(&log->idle, &log->lock);
+  pthread_mutex_unlock(&log->lock);
+}
+
+#else
+
+/* No thread support: lines are always drawn by the emulation thread */
+int vdplog_init(void)
+{
+  return 0;
+}
+
+void vdplog_shutdown(void)
+{
+}
+
+void vdplog_resync(void)
+{
+}
+
+void vdplog_start(int skip)
+{
+}
+
+void vdplog_end(void)
+{
+}
+
+void vdplog_put(uint32 event)
+{
+}
+
+#endif
@@ -0,0 +1,56 @@
+/******************************************************************************
+ *  Sega Master System / GameGear Emulator
+ *  Copyright (C) 1998-2007  Charles MacDonald
+ *
+ *  additionnal code by Eke-Eke (SMS Plus GX)
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *   VDP state log (render thread)
+ *
+ ******************************************************************************/
+
+#ifndef _VDPLOG_H_
+#define _VDPLOG_H_
+
+/* Log events (type in upper bits) */
+#define VDPLOG_VRAM   0x00000000  /* VRAM address << 8 | data */
+#define VDPLOG_CRAM   0x10000000  /* palette entry << 16 | CRAM address << 8 | data */
+#define VDPLOG_REG    0x20000000  /* register << 8 | data */
+#define VDPLOG_RUN    0x30000000  /* VDP line << 12 | last line to draw */
+#define VDPLOG_END    0x40000000  /* end of frame */
+#define VDPLOG_TYPE   0xF0000000
+
+/* Log buffer size (events, power of 2) */
+#define VDPLOG_SIZE   0x10000
+
+/* Log an event when a render thread is running */
+#define VDPLOG_WRITE(event)                         \
+{                                                   \
+  if (machine->vdplog)                              \
+    vdplog_put(event);                              \
+}
+
+typedef struct vdplog_t vdplog_t;
+
+/* Function prototypes */
+extern int vdplog_init(void);
+extern void vdplog_shutdown(void);
+extern void vdplog_resync(void);
+extern void vdplog_start(int skip);
+extern void vdplog_end(void);
+extern void vdplog_put(uint32 event);
+
+#endif /* _VDPLOG_H_ */
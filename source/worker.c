@@ -0,0 +1,166 @@
+/******************************************************************************
+ *  Sega Master System / GameGear Emulator
+ *  Copyright (C) 1998-2007  Charles MacDonald
+ *
+ *  additionnal code by Eke-Eke (SMS Plus GX)
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *   Worker thread pool
+ *
+ ******************************************************************************/
+
+#include "shared.h"
+
+#if WORKER_THREADS
+#include <pthread.h>
+
+static pthread_mutex_t run_lock = PTHREAD_MUTEX_INITIALIZER;  /* one batch at a time */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;      /* batch state */
+static pthread_cond_t start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+static pthread_t thread[WORKER_MAX];
+static int thread_count = 0;
+static int quit = 0;
+
+/* Current batch */
+static void (*job_func)(void *arg, int index);
+static void *job_arg;
+static unsigned int batch = 0;
+static int job_next, job_count, job_left;
+
+/* Run jobs of current batch until none is left (lock held) */
+static void run_jobs(void)
+{
+  while (job_next < job_count)
+  {
+    int index = job_next++;
+    pthread_mutex_unlock(&lock);
+    job_func(job_arg, index);
+    pthread_mutex_lock(&lock);
+    if (--job_left == 0)
+      pthread_cond_signal(&done);
+  }
+}
+
+static void *worker_main(void *arg)
+{
+  unsigned int seen;
+
+  pthread_mutex_lock(&lock);
+  seen = batch;
+  while (!quit)
+  {
+    if (batch == seen)
+    {
+      pthread_cond_wait(&start, &lock);
+      continue;
+    }
+    seen = batch;
+    run_jobs();
+  }
+  pthread_mutex_unlock(&lock);
+
+  return NULL;
+}
+#endif
+
+/* Run job(arg, index) for index = 0 to count-1 on up to 'threads' threads */
+/* (the calling one included), then wait until all jobs are done          */
+void worker_run(int threads, int count, void (*job)(void *arg, int index), void *arg)
+{
+  int i;
+
+#if WORKER_THREADS
+  if (threads > WORKER_MAX)
+    threads = WORKER_MAX;
+
+  if ((threads > 1) && (count > 1))
+  {
+    pthread_mutex_lock(&run_lock);
+    pthread_mutex_lock(&lock);
+
+    /* start missing worker threads */
+    while (thread_count < threads - 1)
+    {
+      if (pthread_create(&thread[thread_count], NULL, worker_main, NULL))
+        break;
+      thread_count++;
+    }
+
+    if (thread_count)
+    {
+      job_func = job;
+      job_arg = arg;
+      job_next = 0;
+      job_count = count;
+      job_left = count;
+      batch++;
+      pthread_cond_broadcast(&start);
+
+      /* calling thread works too */
+      run_jobs();
+      while (job_left)
+        pthread_cond_wait(&done, &lock);
+
+      pthread_mutex_unlock(&lock);
+      pthread_mutex_unlock(&run_lock);
+      return;
+    }
+
+    pthread_mutex_unlock(&lock);
+    pthread_mutex_unlock(&run_lock);
+  }
+#endif
+
+  for (i = 0; i < count; i++)
+    job(arg, i);
+}
+
+/* Run func() the first time it is called with 'once', from any thread; */
+/* other callers wait until it has returned                              */
+void worker_once(worker_once_t *once, void (*func)(void))
+{
+#if WORKER_THREADS
+  pthread_once(once, func);
+#else
+  if (!*once)
+  {
+    func();
+    *once = 1;
+  }
+#endif
+}
+
+/* Stop worker threads */
+void worker_shutdown(void)
+{
+#if WORKER_THREADS
+  int i;
+
+  pthread_mutex_lock(&run_lock);
+  pthread_mutex_lock(&lock);
+  quit = 1;
+  pthread_cond_broadcast(&start);
+  pthread_mutex_unlock(&lock);
+
+  for (i = 0; i < thread_count; i++)
+    pthread_join(thread[i], NULL);
+
+  thread_count = 0;
+  quit = 0;
+  pthread_mutex_unlock(&run_lock);
+#endif
+}
@@ -0,0 +1,53 @@
+/******************************************************************************
+ *  Sega Master System / GameGear Emulator
+ *  Copyright (C) 1998-2007  Charles MacDonald
+ *
+ *  additionnal code by Eke-Eke (SMS Plus GX)
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *   Worker thread pool (parallel jobs within a frame)
+ *
+ ******************************************************************************/
+
+#ifndef _WORKER_H_
+#define _WORKER_H_
+
+/* POSIX threads are used where available, jobs run serially otherwise */
+#if !defined(NGC) && !defined(_MSC_VER)
+#define WORKER_THREADS 1
+#else
+#define WORKER_THREADS 0
+#endif
+
+/* Maximal number of threads (including the calling one) */
+#define WORKER_MAX 16
+
+/* One-time initialization flag (look-up tables shared by all machine contexts) */
+#if WORKER_THREADS
+#include <pthread.h>
+typedef pthread_once_t worker_once_t;
+#define WORKER_ONCE_INIT PTHREAD_ONCE_INIT
+#else
+typedef int worker_once_t;
+#define WORKER_ONCE_INIT 0
+#endif
+
+/* Function prototypes */
+extern void worker_run(int threads, int count, void (*job)(void *arg, int index), void *arg);
+extern void worker_once(worker_once_t *once, void (*func)(void));
+extern void worker_shutdown(void);
+
+#endif /* _WORKER_H_ */